@@ -0,0 +1,135 @@
+#ifndef DEVOUT_H
+#define DEVOUT_H
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// devout native backend interface
+//
+// Another package can handle devout's device calls in C/C++ instead of an
+// R callback.  Fill in a 'devout_backend' table and register it under a
+// name (usually from the package's R_init_<pkg>()):
+//
+//     #include <devout.h>
+//
+//     static void my_circle(double x, double y, double r, const pGEcontext gc,
+//                           pDevDesc dd, void *user) { ... }
+//
+//     void R_init_mypkg(DllInfo *dll) {
+//       devout_backend be = {0};
+//       be.version = DEVOUT_BACKEND_VERSION;
+//       be.circle  = my_circle;
+//       devout_register_backend("mypkg", &be);
+//     }
+//
+// then in R:  devout::rdevice(NULL, backend = "mypkg")
+//
+// Add 'LinkingTo: devout' to the DESCRIPTION to find this header, and
+// make sure devout is loaded (e.g. 'Imports: devout' and import something
+// from it) before registering.
+//
+// Each slot mirrors the graphics engine's device call of the same name,
+// with 'user' appended.  A slot left NULL is handled as usual i.e. by the
+// R callback, if there is one.  A call handled by the backend is not sent
+// to R (nor logged), but is still recorded natively (recording(), streams,
+// hashing) before the backend is called.  With rdevice(lod = ...),
+// primitives too small to see reach the backend as a one pixel rect or
+// line, or not at all.
+//
+// dev.capabilities() claims none of the newer graphics features (patterns,
+// masks etc) unless declared.  A backend which draws them should set
+// 'dd->capabilities' to its own function in its 'open'.
+//
+// The table is copied when registered.  Registering the same name again
+// replaces it for devices opened later.  Registering NULL removes it.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/GraphicsEngine.h>
+#include <R_ext/Rdynload.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Version of the table layout.  New slots are only ever added at the end,
+// and tables of an older version are still accepted (the newer slots are
+// taken to be NULL)
+//   1 - initial
+//   2 - 'geometry'
+#define DEVOUT_BACKEND_VERSION 2
+
+typedef struct devout_backend {
+  int   version;   // set to DEVOUT_BACKEND_VERSION
+  void *user;      // passed unchanged to every call
+
+  void     (*open)        (pDevDesc dd, void *user);
+  void     (*close)       (pDevDesc dd, void *user);
+  void     (*activate)    (pDevDesc dd, void *user);
+  void     (*deactivate)  (pDevDesc dd, void *user);
+  void     (*newPage)     (const pGEcontext gc, pDevDesc dd, void *user);
+  void     (*mode)        (int mode, pDevDesc dd, void *user);
+  int      (*holdflush)   (pDevDesc dd, int level, void *user);
+  void     (*size)        (double *left, double *right, double *bottom, double *top,
+                           pDevDesc dd, void *user);
+  void     (*clip)        (double x0, double x1, double y0, double y1, pDevDesc dd, void *user);
+
+  void     (*circle)      (double x, double y, double r, const pGEcontext gc, pDevDesc dd,
+                           void *user);
+  void     (*line)        (double x1, double y1, double x2, double y2, const pGEcontext gc,
+                           pDevDesc dd, void *user);
+  void     (*polyline)    (int n, double *x, double *y, const pGEcontext gc, pDevDesc dd,
+                           void *user);
+  void     (*polygon)     (int n, double *x, double *y, const pGEcontext gc, pDevDesc dd,
+                           void *user);
+  void     (*path)        (double *x, double *y, int npoly, int *nper, Rboolean winding,
+                           const pGEcontext gc, pDevDesc dd, void *user);
+  void     (*rect)        (double x0, double y0, double x1, double y1, const pGEcontext gc,
+                           pDevDesc dd, void *user);
+  void     (*raster)      (unsigned int *raster, int w, int h, double x, double y,
+                           double width, double height, double rot, Rboolean interpolate,
+                           const pGEcontext gc, pDevDesc dd, void *user);
+  void     (*text)        (double x, double y, const char *str, double rot, double hadj,
+                           const pGEcontext gc, pDevDesc dd, void *user);
+  void     (*textUTF8)    (double x, double y, const char *str, double rot, double hadj,
+                           const pGEcontext gc, pDevDesc dd, void *user);
+
+  double   (*strWidth)    (const char *str, const pGEcontext gc, pDevDesc dd, void *user);
+  double   (*strWidthUTF8)(const char *str, const pGEcontext gc, pDevDesc dd, void *user);
+  void     (*metricInfo)  (int c, const pGEcontext gc, double *ascent, double *descent,
+                           double *width, pDevDesc dd, void *user);
+  SEXP     (*cap)         (pDevDesc dd, void *user);
+  Rboolean (*locator)     (double *x, double *y, pDevDesc dd, void *user);
+
+  // Version 2.
+  // With rdevice(geometry_cache = TRUE), called just before the polyline,
+  // polygon or path call whose vertices have the given id.  The same
+  // vertices always get the same id (until the device is reset), so work
+  // done on them (transformed, tessellated, uploaded) the first time, when
+  // 'first' is TRUE, can be kept under 'id' and reused.  'id' is NA_INTEGER
+  // if the device's table is full
+  void     (*geometry)    (int id, Rboolean first, pDevDesc dd, void *user);
+} devout_backend;
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Register (or with backend = NULL, remove) a backend.
+//
+// @return 0 on success. -1 if the table's version is not supported by the
+//         installed devout
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#ifndef DEVOUT_INTERNAL
+static inline int devout_register_backend(const char *name, const devout_backend *backend) {
+  static int (*fun)(const char *, const devout_backend *) = NULL;
+  if (fun == NULL) {
+    fun = (int (*)(const char *, const devout_backend *))
+      R_GetCCallable("devout", "devout_register_backend");
+  }
+  return fun(name, backend);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,6 +10,80 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// ansi_redraw_
+int ansi_redraw_(Rcpp::CharacterVector lines, int fd, SEXP colours, int mode);
+RcppExport SEXP _devout_ansi_redraw_(SEXP linesSEXP, SEXP fdSEXP, SEXP coloursSEXP, SEXP modeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type lines(linesSEXP);
+    Rcpp::traits::input_parameter< int >::type fd(fdSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type colours(coloursSEXP);
+    Rcpp::traits::input_parameter< int >::type mode(modeSEXP);
+    rcpp_result_gen = Rcpp::wrap(ansi_redraw_(lines, fd, colours, mode));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ansi_colour_lines_
+Rcpp::CharacterVector ansi_colour_lines_(Rcpp::CharacterVector lines, SEXP colours, int mode);
+RcppExport SEXP _devout_ansi_colour_lines_(SEXP linesSEXP, SEXP coloursSEXP, SEXP modeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type lines(linesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type colours(coloursSEXP);
+    Rcpp::traits::input_parameter< int >::type mode(modeSEXP);
+    rcpp_result_gen = Rcpp::wrap(ansi_colour_lines_(lines, colours, mode));
+    return rcpp_result_gen;
+END_RCPP
+}
+// subcell_canvas_
+Rcpp::List subcell_canvas_(SEXP rec, int mode, int width, int height);
+RcppExport SEXP _devout_subcell_canvas_(SEXP recSEXP, SEXP modeSEXP, SEXP widthSEXP, SEXP heightSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< int >::type mode(modeSEXP);
+    Rcpp::traits::input_parameter< int >::type width(widthSEXP);
+    Rcpp::traits::input_parameter< int >::type height(heightSEXP);
+    rcpp_result_gen = Rcpp::wrap(subcell_canvas_(rec, mode, width, height));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ansi_reset_
+void ansi_reset_(int fd);
+RcppExport SEXP _devout_ansi_reset_(SEXP fdSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type fd(fdSEXP);
+    ansi_reset_(fd);
+    return R_NilValue;
+END_RCPP
+}
+// capture_tables_
+Rcpp::List capture_tables_(SEXP rec);
+RcppExport SEXP _devout_capture_tables_(SEXP recSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    rcpp_result_gen = Rcpp::wrap(capture_tables_(rec));
+    return rcpp_result_gen;
+END_RCPP
+}
+// lazy_state_
+SEXP lazy_state_(double serial, std::string field);
+RcppExport SEXP _devout_lazy_state_(SEXP serialSEXP, SEXP fieldSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type serial(serialSEXP);
+    Rcpp::traits::input_parameter< std::string >::type field(fieldSEXP);
+    rcpp_result_gen = Rcpp::wrap(lazy_state_(serial, field));
+    return rcpp_result_gen;
+END_RCPP
+}
 // rdevice_
 bool rdevice_(SEXP rdata, std::string device_name);
 RcppExport SEXP _devout_rdevice_(SEXP rdataSEXP, SEXP device_nameSEXP) {
@@ -23,12 +97,113 @@ BEGIN_RCPP
 END_RCPP
 }
 
+// rdevice_reset_
+bool rdevice_reset_(int devnum);
+RcppExport SEXP _devout_rdevice_reset_(SEXP devnumSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type devnum(devnumSEXP);
+    rcpp_result_gen = Rcpp::wrap(rdevice_reset_(devnum));
+    return rcpp_result_gen;
+END_RCPP
+}
+// recording_
+SEXP recording_();
+RcppExport SEXP _devout_recording_() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(recording_());
+    return rcpp_result_gen;
+END_RCPP
+}
+// recording_info_
+Rcpp::List recording_info_(SEXP rec);
+RcppExport SEXP _devout_recording_info_(SEXP recSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    rcpp_result_gen = Rcpp::wrap(recording_info_(rec));
+    return rcpp_result_gen;
+END_RCPP
+}
+// recording_hashes_
+Rcpp::CharacterVector recording_hashes_(SEXP rec, double quantum);
+RcppExport SEXP _devout_recording_hashes_(SEXP recSEXP, SEXP quantumSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< double >::type quantum(quantumSEXP);
+    rcpp_result_gen = Rcpp::wrap(recording_hashes_(rec, quantum));
+    return rcpp_result_gen;
+END_RCPP
+}
+// recording_diff_
+Rcpp::List recording_diff_(SEXP rec_a, SEXP rec_b, double tolerance);
+RcppExport SEXP _devout_recording_diff_(SEXP rec_aSEXP, SEXP rec_bSEXP, SEXP toleranceSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec_a(rec_aSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type rec_b(rec_bSEXP);
+    Rcpp::traits::input_parameter< double >::type tolerance(toleranceSEXP);
+    rcpp_result_gen = Rcpp::wrap(recording_diff_(rec_a, rec_b, tolerance));
+    return rcpp_result_gen;
+END_RCPP
+}
+// recording_query_
+Rcpp::List recording_query_(SEXP rec, int page, double x0, double y0, double x1, double y1);
+RcppExport SEXP _devout_recording_query_(SEXP recSEXP, SEXP pageSEXP, SEXP x0SEXP, SEXP y0SEXP, SEXP x1SEXP, SEXP y1SEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< int >::type page(pageSEXP);
+    Rcpp::traits::input_parameter< double >::type x0(x0SEXP);
+    Rcpp::traits::input_parameter< double >::type y0(y0SEXP);
+    Rcpp::traits::input_parameter< double >::type x1(x1SEXP);
+    Rcpp::traits::input_parameter< double >::type y1(y1SEXP);
+    rcpp_result_gen = Rcpp::wrap(recording_query_(rec, page, x0, y0, x1, y1));
+    return rcpp_result_gen;
+END_RCPP
+}
+// replay_
+int replay_(SEXP rec, Rcpp::IntegerVector pages);
+RcppExport SEXP _devout_replay_(SEXP recSEXP, SEXP pagesSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type rec(recSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type pages(pagesSEXP);
+    rcpp_result_gen = Rcpp::wrap(replay_(rec, pages));
+    return rcpp_result_gen;
+END_RCPP
+}
+
 static const R_CallMethodDef CallEntries[] = {
+    {"_devout_ansi_redraw_", (DL_FUNC) &_devout_ansi_redraw_, 4},
+    {"_devout_ansi_colour_lines_", (DL_FUNC) &_devout_ansi_colour_lines_, 3},
+    {"_devout_subcell_canvas_", (DL_FUNC) &_devout_subcell_canvas_, 4},
+    {"_devout_ansi_reset_", (DL_FUNC) &_devout_ansi_reset_, 1},
+    {"_devout_capture_tables_", (DL_FUNC) &_devout_capture_tables_, 1},
+    {"_devout_lazy_state_", (DL_FUNC) &_devout_lazy_state_, 2},
     {"_devout_rdevice_", (DL_FUNC) &_devout_rdevice_, 2},
+    {"_devout_rdevice_reset_", (DL_FUNC) &_devout_rdevice_reset_, 1},
+    {"_devout_recording_", (DL_FUNC) &_devout_recording_, 0},
+    {"_devout_recording_info_", (DL_FUNC) &_devout_recording_info_, 1},
+    {"_devout_recording_hashes_", (DL_FUNC) &_devout_recording_hashes_, 2},
+    {"_devout_recording_diff_", (DL_FUNC) &_devout_recording_diff_, 3},
+    {"_devout_recording_query_", (DL_FUNC) &_devout_recording_query_, 6},
+    {"_devout_replay_", (DL_FUNC) &_devout_replay_, 2},
     {NULL, NULL, 0}
 };
 
+void devout_init(DllInfo* dll);
 RcppExport void R_init_devout(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    devout_init(dll);
 }
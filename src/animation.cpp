@@ -0,0 +1,505 @@
+#include "animation.h"
+#include "image-encode.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Pack/unpack a rendered frame: width, height, then the pixels
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string frame_to_bytes(const rgba_image &img) {
+  int dims[2] = {img.width, img.height};
+  std::string out((const char *)dims, sizeof(dims));
+  out.append((const char *)img.pixels.data(), img.pixels.size() * sizeof(unsigned int));
+  return out;
+}
+
+bool frame_from_bytes(const char *data, size_t len, rgba_image &img) {
+  int dims[2];
+  if (len < sizeof(dims)) return false;
+  memcpy(dims, data, sizeof(dims));
+  if (dims[0] <= 0 || dims[1] <= 0) return false;
+
+  size_t npixels = (size_t)dims[0] * dims[1];
+  if (len != sizeof(dims) + npixels * sizeof(unsigned int)) return false;
+
+  img.width  = dims[0];
+  img.height = dims[1];
+  img.pixels.resize(npixels);
+  memcpy(img.pixels.data(), data + sizeof(dims), npixels * sizeof(unsigned int));
+  return true;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Little-endian 16 bit value (GIF)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void put_u16le(std::string &out, unsigned int v) {
+  out += (char)( v       & 255);
+  out += (char)((v >> 8) & 255);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GIF has no partial transparency: composite everything onto white
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void flatten(rgba_image &img) {
+  for (size_t i = 0; i < img.pixels.size(); i++) {
+    unsigned int c = img.pixels[i];
+    unsigned int a = c >> 24;
+    if (a == 255) continue;
+    unsigned int out = 0xff000000u;
+    for (int shift = 0; shift < 24; shift += 8) {
+      unsigned int v = (c >> shift) & 255;
+      out |= ((v * a + 255 * (255 - a) + 127) / 255) << shift;
+    }
+    img.pixels[i] = out;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Fixed 6x7x6 colour cube used when a frame has too many colours
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define CUBE_SIZE 252
+
+static inline int cube_index(unsigned int c) {
+  int r = ((c      ) & 255) * 5 + 127;
+  int g = ((c >>  8) & 255) * 6 + 127;
+  int b = ((c >> 16) & 255) * 5 + 127;
+  return ((r / 255) * 7 + (g / 255)) * 6 + (b / 255);
+}
+
+static std::vector<unsigned int> cube_palette() {
+  std::vector<unsigned int> pal;
+  for (int r = 0; r < 6; r++) {
+    for (int g = 0; g < 7; g++) {
+      for (int b = 0; b < 6; b++) {
+        pal.push_back((r * 255 / 5) | ((g * 255 / 6) << 8) | ((b * 255 / 5) << 16));
+      }
+    }
+  }
+  return pal;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Number of bits for a GIF colour table holding 'n' entries (1 to 8)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static int table_bits(size_t n) {
+  int bits = 1;
+  while ((size_t)(1 << bits) < n && bits < 8) bits++;
+  return bits;
+}
+
+static void put_color_table(std::string &out, const std::vector<unsigned int> &pal, int bits) {
+  for (int i = 0; i < (1 << bits); i++) {
+    unsigned int c = (i < (int)pal.size()) ? pal[i] : 0;
+    out += (char)( c        & 255);
+    out += (char)((c >>  8) & 255);
+    out += (char)((c >> 16) & 255);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GIF LZW.  Codes are packed LSB first into sub-blocks of up to 255 bytes.
+// The dictionary is an open-addressed hash of (prefix code, next index).
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct lzw_writer {
+  std::string   &out;
+  std::string    block;
+  unsigned long  bits;
+  int            nbits;
+
+  explicit lzw_writer(std::string &out) : out(out), bits(0), nbits(0) {}
+
+  void write(int code, int code_size) {
+    bits  |= (unsigned long)code << nbits;
+    nbits += code_size;
+    while (nbits >= 8) {
+      byte((char)(bits & 255));
+      bits  >>= 8;
+      nbits  -= 8;
+    }
+  }
+
+  void byte(char b) {
+    block += b;
+    if (block.size() == 255) flush_block();
+  }
+
+  void flush_block() {
+    if (block.empty()) return;
+    out += (char)block.size();
+    out += block;
+    block.clear();
+  }
+
+  void finish() {
+    if (nbits > 0) byte((char)(bits & 255));
+    bits  = 0;
+    nbits = 0;
+    flush_block();
+    out += (char)0;
+  }
+};
+
+#define LZW_HASH_SIZE 8192
+
+std::string gif_lzw(const std::vector<unsigned char> &indices, int min_code_size) {
+  std::string out;
+  out += (char)min_code_size;
+
+  lzw_writer lw(out);
+  int clear_code = 1 << min_code_size;
+  int eoi_code   = clear_code + 1;
+  int code_size  = min_code_size + 1;
+  int max_code   = eoi_code;
+
+  std::vector<int>   keys(LZW_HASH_SIZE, -1);
+  std::vector<short> codes(LZW_HASH_SIZE, 0);
+
+  lw.write(clear_code, code_size);
+
+  if (!indices.empty()) {
+    int cur = indices[0];
+    for (size_t i = 1; i < indices.size(); i++) {
+      int next = indices[i];
+      int key  = (cur << 8) | next;
+      unsigned int h = ((unsigned int)key * 2654435761u) >> 19;  // 13 bits
+
+      while (keys[h] != -1 && keys[h] != key) h = (h + 1) & (LZW_HASH_SIZE - 1);
+      if (keys[h] == key) {
+        cur = codes[h];
+        continue;
+      }
+
+      lw.write(cur, code_size);
+
+      ++max_code;
+      keys[h]  = key;
+      codes[h] = (short)max_code;
+      if (max_code >= (1 << code_size)) code_size++;
+
+      if (max_code == 4095) {
+        lw.write(clear_code, code_size);
+        std::fill(keys.begin(), keys.end(), -1);
+        code_size = min_code_size + 1;
+        max_code  = eoi_code;
+      }
+
+      cur = next;
+    }
+    lw.write(cur, code_size);
+  }
+
+  lw.write(eoi_code, code_size);
+  lw.finish();
+
+  return out;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Animation sink
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+anim_page_sink::anim_page_sink(const std::string &path, bool apng, double delay, int loop)
+  : path(path), apng(apng), delay(delay), loop(loop), fp(NULL), nframes(0), seq(0),
+    actl_pos(0), palette_is_cube(false) {}
+
+anim_page_sink::~anim_page_sink() {
+  close();
+}
+
+
+bool anim_page_sink::put(const std::string &bytes) {
+  if (fwrite(bytes.data(), 1, bytes.size(), fp) != bytes.size()) {
+    error = "could not write to '" + path + "'";
+    return false;
+  }
+  return true;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Add one frame, encoding only what changed since the last one
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool anim_page_sink::write_page(int page, const char *data, size_t len) {
+  rgba_image img;
+  if (!frame_from_bytes(data, len, img)) {
+    error = "invalid frame data for page " + std::to_string(page);
+    return false;
+  }
+  if (!apng) flatten(img);
+
+  bool first = (nframes == 0);
+  int x0 = 0, y0 = 0, x1 = img.width - 1, y1 = img.height - 1;
+
+  if (first) {
+    if (!start(img)) return false;
+  } else {
+    if (img.width != prev.width || img.height != prev.height) {
+      error = "page " + std::to_string(page) + " is not the same size as the first page";
+      return false;
+    }
+
+    // Bounding box of changed pixels
+    x0 = img.width; y0 = img.height; x1 = -1; y1 = -1;
+    for (int row = 0; row < img.height; row++) {
+      const unsigned int *a = &img .pixels[(size_t)row * img.width];
+      const unsigned int *b = &prev.pixels[(size_t)row * img.width];
+      if (memcmp(a, b, img.width * sizeof(unsigned int)) == 0) continue;
+      for (int col = 0; col < img.width; col++) {
+        if (a[col] != b[col]) {
+          if (col < x0) x0 = col;
+          if (col > x1) x1 = col;
+        }
+      }
+      if (row < y0) y0 = row;
+      y1 = row;
+    }
+
+    // Nothing changed: still need a frame to keep the timing
+    if (x1 < 0) {
+      x0 = x1 = y0 = y1 = 0;
+    }
+  }
+
+  int w = x1 - x0 + 1, h = y1 - y0 + 1;
+  bool ok = apng ? add_apng_frame(img, x0, y0, w, h, first) :
+                   add_gif_frame (img, x0, y0, w, h, first);
+  if (!ok) return false;
+
+  fflush(fp);
+  std::swap(prev, img);
+  nframes++;
+  return true;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Open the file and write the header. For GIF the first frame also decides
+// the global palette
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool anim_page_sink::start(const rgba_image &img) {
+  fp = fopen(path.c_str(), "wb");
+  if (fp == NULL) {
+    error = "could not open '" + path + "': " + strerror(errno);
+    return false;
+  }
+
+  std::string out;
+
+  if (apng) {
+    out.append(PNG_SIGNATURE, 8);
+    png_chunk(out, "IHDR", png_ihdr(img.width, img.height));
+
+    // 'acTL' is rewritten with the real frame count at close()
+    actl_pos = (long)out.size();
+    std::string actl;
+    put_u32be(actl, 0);
+    put_u32be(actl, (unsigned int)loop);
+    png_chunk(out, "acTL", actl);
+    return put(out);
+  }
+
+  if (img.width > 65535 || img.height > 65535) {
+    error = "image is too large for GIF";
+    return false;
+  }
+
+  // Global palette: exact if possible, else the colour cube
+  palette.clear();
+  palette_index.clear();
+  for (size_t i = 0; i < img.pixels.size() && palette.size() <= 255; i++) {
+    unsigned int c = img.pixels[i] & 0xffffff;
+    if (palette_index.find(c) == palette_index.end()) {
+      palette_index[c] = (int)palette.size();
+      palette.push_back(c);
+    }
+  }
+  palette_is_cube = palette.size() > 255;
+  if (palette_is_cube) {
+    palette = cube_palette();
+    palette_index.clear();
+  }
+
+  // +1 entry for the transparent index
+  int bits = table_bits(palette.size() + 1);
+
+  out += "GIF89a";
+  put_u16le(out, img.width);
+  put_u16le(out, img.height);
+  out += (char)(0x80 | ((bits - 1) << 4) | (bits - 1));
+  out += (char)0;  // background colour index
+  out += (char)0;  // pixel aspect ratio
+  put_color_table(out, palette, bits);
+
+  // Looping.  GIF counts repeats after the first play (0 = forever), and
+  // with no NETSCAPE extension plays once
+  if (loop != 1) {
+    out += "\x21\xff\x0b" "NETSCAPE2.0" "\x03\x01";
+    put_u16le(out, (unsigned int)(loop == 0 ? 0 : loop - 1));
+    out += (char)0;
+  }
+
+  return put(out);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GIF frame: graphic control extension, image descriptor, optional local
+// palette and LZW data
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool anim_page_sink::add_gif_frame(const rgba_image &img, int x, int y, int w, int h,
+                                   bool first) {
+
+  //--------------------------------------------------------------------------
+  // Colours of the changed pixels. Can the global palette be reused?
+  //--------------------------------------------------------------------------
+  bool use_global = true;
+  std::vector<unsigned int>             local;
+  std::unordered_map<unsigned int, int> local_index;
+
+  if (!palette_is_cube) {
+    for (int row = y; row < y + h; row++) {
+      for (int col = x; col < x + w; col++) {
+        size_t i = (size_t)row * img.width + col;
+        unsigned int c = img.pixels[i] & 0xffffff;
+        if (!first && img.pixels[i] == prev.pixels[i]) continue;
+        if (local_index.find(c) == local_index.end()) {
+          local_index[c] = (int)local.size();
+          local.push_back(c);
+          if (use_global && palette_index.find(c) == palette_index.end()) {
+            use_global = false;
+          }
+        }
+      }
+    }
+  }
+
+  bool cube = use_global ? palette_is_cube : local.size() > 255;
+  if (!use_global && cube) {
+    local = cube_palette();
+  }
+
+  const std::vector<unsigned int>             &pal   = use_global ? palette       : local;
+  const std::unordered_map<unsigned int, int> &index = use_global ? palette_index : local_index;
+  int transparent = cube ? CUBE_SIZE : (int)pal.size();
+  int bits        = table_bits(transparent + 1);
+
+  //--------------------------------------------------------------------------
+  // Palette indices.  Unchanged pixels are transparent
+  //--------------------------------------------------------------------------
+  std::vector<unsigned char> indices((size_t)w * h);
+  unsigned char *dst = indices.data();
+  for (int row = y; row < y + h; row++) {
+    for (int col = x; col < x + w; col++) {
+      size_t i = (size_t)row * img.width + col;
+      if (!first && img.pixels[i] == prev.pixels[i]) {
+        *dst++ = (unsigned char)transparent;
+      } else if (cube) {
+        *dst++ = (unsigned char)cube_index(img.pixels[i]);
+      } else {
+        *dst++ = (unsigned char)index.find(img.pixels[i] & 0xffffff)->second;
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  // Write the frame
+  //--------------------------------------------------------------------------
+  std::string out;
+
+  int cs = (int)std::floor(delay * 100 + 0.5);
+  if (cs > 65535) cs = 65535;
+  out += "\x21\xf9\x04";
+  out += (char)((1 << 2) | 1);  // disposal: do not dispose. Has transparency
+  put_u16le(out, (unsigned int)cs);
+  out += (char)transparent;
+  out += (char)0;
+
+  out += (char)0x2c;
+  put_u16le(out, x);
+  put_u16le(out, y);
+  put_u16le(out, w);
+  put_u16le(out, h);
+  if (use_global) {
+    out += (char)0;
+  } else {
+    out += (char)(0x80 | (bits - 1));
+    put_color_table(out, pal, bits);
+  }
+
+  out += gif_lzw(indices, bits < 2 ? 2 : bits);
+
+  return put(out);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// APNG frame: 'fcTL' then 'IDAT' (first frame) or 'fdAT'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool anim_page_sink::add_apng_frame(const rgba_image &img, int x, int y, int w, int h,
+                                    bool first) {
+  std::string out;
+
+  int ms = (int)std::floor(delay * 1000 + 0.5);
+  if (ms > 65535) ms = 65535;
+
+  std::string fctl;
+  put_u32be(fctl, seq++);
+  put_u32be(fctl, (unsigned int)w);
+  put_u32be(fctl, (unsigned int)h);
+  put_u32be(fctl, (unsigned int)x);
+  put_u32be(fctl, (unsigned int)y);
+  fctl += (char)((ms >> 8) & 255);  // delay numerator
+  fctl += (char)( ms       & 255);
+  fctl += (char)(1000 >> 8);        // delay denominator
+  fctl += (char)(1000 & 255);
+  fctl += (char)0;                  // dispose: none
+  fctl += (char)0;                  // blend: source (replace the region)
+  png_chunk(out, "fcTL", fctl);
+
+  std::string data = zlib_deflate(png_scanlines(img, x, y, w, h));
+  if (first) {
+    png_chunk(out, "IDAT", data);
+  } else {
+    std::string fdat;
+    put_u32be(fdat, seq++);
+    fdat += data;
+    png_chunk(out, "fdAT", fdat);
+  }
+
+  return put(out);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Finish the file
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void anim_page_sink::close() {
+  if (fp == NULL) return;
+
+  if (apng) {
+    std::string iend;
+    png_chunk(iend, "IEND", std::string());
+    put(iend);
+
+    std::string actl, chunk;
+    put_u32be(actl, (unsigned int)nframes);
+    put_u32be(actl, (unsigned int)loop);
+    png_chunk(chunk, "acTL", actl);
+    if (fseek(fp, actl_pos, SEEK_SET) == 0) {
+      put(chunk);
+    }
+  } else {
+    put(std::string(1, '\x3b'));
+  }
+
+  fclose(fp);
+  fp = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef DEVOUT_ANIMATION_H
+#define DEVOUT_ANIMATION_H
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "page-sink.h"
+#include "rasterise.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Write all pages of a device into a single animated GIF or APNG.
+//
+// Each page is a rendered frame (see 'frame_to_bytes()').  Only the
+// bounding box of pixels which changed since the previous frame is encoded,
+// and the previous frame stays underneath ('do not dispose').
+//
+// GIF:
+//   - frames are flattened onto white (GIF has only on/off transparency)
+//   - the global palette is built from the first frame and reused for every
+//     later frame whose changed pixels all appear in it.  Otherwise a frame
+//     gets a local palette: exact if it has <= 255 colours, else a fixed
+//     6x7x6 colour cube
+//   - unchanged pixels inside the bounding box are written as transparent,
+//     which compresses well with LZW
+// APNG:
+//   - frames are RGBA and compressed with zlib
+//   - the frame count in 'acTL' is filled in when the sink is closed
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class anim_page_sink : public page_sink {
+public:
+  // 'delay' is seconds per frame. 'loop' is the number of times to play
+  // (0 = forever)
+  anim_page_sink(const std::string &path, bool apng, double delay, int loop);
+  ~anim_page_sink();
+
+  bool write_page(int page, const char *data, size_t len);
+  void close();
+
+private:
+  bool start(const rgba_image &img);
+  bool add_gif_frame(const rgba_image &img, int x, int y, int w, int h, bool first);
+  bool add_apng_frame(const rgba_image &img, int x, int y, int w, int h, bool first);
+  bool put(const std::string &bytes);
+
+  std::string  path;
+  bool         apng;
+  double       delay;
+  int          loop;
+
+  FILE        *fp;
+  rgba_image   prev;      // last frame written (flattened for GIF)
+  int          nframes;
+  unsigned int seq;       // APNG chunk sequence number
+  long         actl_pos;  // APNG file offset of 'acTL' chunk
+
+  // GIF global palette (R colours without alpha) and colour -> index
+  std::vector<unsigned int>             palette;
+  std::unordered_map<unsigned int, int> palette_index;
+  bool                                  palette_is_cube;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Pack/unpack a rendered frame for passing through a page_pipeline
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string frame_to_bytes(const rgba_image &img);
+bool        frame_from_bytes(const char *data, size_t len, rgba_image &img);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GIF LZW compression of palette indices, returned as data sub-blocks
+// (including the leading minimum code size and the trailing 0 block)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string gif_lzw(const std::vector<unsigned char> &indices, int min_code_size);
+
+#endif
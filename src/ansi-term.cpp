@@ -0,0 +1,256 @@
+#include "ansi-term.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// UTF-8 decoding
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void utf8_decode(const char *s, std::vector<unsigned int> &out) {
+  const unsigned char *p = (const unsigned char *)s;
+  while (*p) {
+    unsigned int c = *p;
+    int extra;
+    if      (c < 0x80)           { extra = 0;             }
+    else if ((c & 0xe0) == 0xc0) { extra = 1; c &= 0x1f;  }
+    else if ((c & 0xf0) == 0xe0) { extra = 2; c &= 0x0f;  }
+    else if ((c & 0xf8) == 0xf0) { extra = 3; c &= 0x07;  }
+    else {
+      out.push_back(0xfffd);
+      p++;
+      continue;
+    }
+
+    p++;
+    bool ok = true;
+    for (int i = 0; i < extra; i++) {
+      if ((*p & 0xc0) != 0x80) {
+        ok = false;
+        break;
+      }
+      c = (c << 6) | (*p++ & 0x3f);
+    }
+    out.push_back(ok ? c : 0xfffd);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// UTF-8 encoding
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void utf8_append(std::string &out, unsigned int cp) {
+  if (cp < 0x80) {
+    out += (char)cp;
+  } else if (cp < 0x800) {
+    out += (char)(0xc0 |  (cp >> 6));
+    out += (char)(0x80 |  (cp        & 0x3f));
+  } else if (cp < 0x10000) {
+    out += (char)(0xe0 |  (cp >> 12));
+    out += (char)(0x80 | ((cp >>  6) & 0x3f));
+    out += (char)(0x80 |  (cp        & 0x3f));
+  } else {
+    out += (char)(0xf0 |  (cp >> 18));
+    out += (char)(0x80 | ((cp >> 12) & 0x3f));
+    out += (char)(0x80 | ((cp >>  6) & 0x3f));
+    out += (char)(0x80 |  (cp        & 0x3f));
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Move the cursor to (1-based) row/col
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void cursor_to(std::string &out, int row, int col) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "\033[%d;%dH", row, col);
+  out += buf;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// xterm's 16 colours
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static const unsigned char ansi16_rgb[16][3] = {
+  {  0,   0,   0}, {205,   0,   0}, {  0, 205,   0}, {205, 205,   0},
+  {  0,   0, 238}, {205,   0, 205}, {  0, 205, 205}, {229, 229, 229},
+  {127, 127, 127}, {255,   0,   0}, {  0, 255,   0}, {255, 255,   0},
+  { 92,  92, 255}, {255,   0, 255}, {  0, 255, 255}, {255, 255, 255}
+};
+
+static const int cube_levels[6] = {0, 95, 135, 175, 215, 255};
+
+
+static int dist2(int r1, int g1, int b1, int r2, int g2, int b2) {
+  return (r1 - r2) * (r1 - r2) + (g1 - g2) * (g1 - g2) + (b1 - b2) * (b1 - b2);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Nearest of the 16 colours
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static int nearest_16(int r, int g, int b) {
+  int best = 0, best_d = 1 << 30;
+  for (int i = 0; i < 16; i++) {
+    int d = dist2(r, g, b, ansi16_rgb[i][0], ansi16_rgb[i][1], ansi16_rgb[i][2]);
+    if (d < best_d) {
+      best_d = d;
+      best   = i;
+    }
+  }
+  return best;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Nearest of the 256 colour cube (16-231) and grey ramp (232-255).
+// The 'system' colours 0-15 are skipped as terminals often redefine them
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static int cube_level(int v) {
+  int best = 0;
+  for (int i = 1; i < 6; i++) {
+    if (abs(v - cube_levels[i]) < abs(v - cube_levels[best])) best = i;
+  }
+  return best;
+}
+
+static int nearest_256(int r, int g, int b) {
+  int cr = cube_level(r), cg = cube_level(g), cb = cube_level(b);
+  int cube_d = dist2(r, g, b, cube_levels[cr], cube_levels[cg], cube_levels[cb]);
+
+  int grey = ((r + g + b) / 3 - 8 + 5) / 10;
+  if (grey < 0)  grey = 0;
+  if (grey > 23) grey = 23;
+  int gv = 8 + 10 * grey;
+  int grey_d = dist2(r, g, b, gv, gv, gv);
+
+  return grey_d < cube_d ? 232 + grey : 16 + 36 * cr + 6 * cg + cb;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// 32x32x32 lookup tables, evaluated at the centre of each bucket
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct colour_lut {
+  unsigned char lut16 [32 * 32 * 32];
+  unsigned char lut256[32 * 32 * 32];
+
+  colour_lut() {
+    for (int r = 0; r < 32; r++) {
+      for (int g = 0; g < 32; g++) {
+        for (int b = 0; b < 32; b++) {
+          int idx = (r << 10) | (g << 5) | b;
+          lut16 [idx] = (unsigned char)nearest_16 (r * 8 + 4, g * 8 + 4, b * 8 + 4);
+          lut256[idx] = (unsigned char)nearest_256(r * 8 + 4, g * 8 + 4, b * 8 + 4);
+        }
+      }
+    }
+  }
+};
+
+
+unsigned int ansi_style(unsigned int rgb, int mode) {
+  static const colour_lut lut;
+
+  unsigned int idx = ((rgb >> 9) & 0x7c00) | ((rgb >> 6) & 0x3e0) | ((rgb >> 3) & 0x1f);
+
+  switch (mode) {
+  case ANSI_COLOUR_16  : return (ANSI_COLOUR_16   << 24) | lut.lut16 [idx];
+  case ANSI_COLOUR_256 : return (ANSI_COLOUR_256  << 24) | lut.lut256[idx];
+  case ANSI_COLOUR_TRUE: return (ANSI_COLOUR_TRUE << 24) | (rgb & 0xffffff);
+  default              : return 0;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// SGR escape to select the foreground colour of a style
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void put_style(std::string &out, unsigned int style) {
+  char buf[32];
+  unsigned int code = style & 0xffffff;
+
+  switch (style >> 24) {
+  case ANSI_COLOUR_16:
+    snprintf(buf, sizeof(buf), "\033[%dm", (int)(code < 8 ? 30 + code : 90 + code - 8));
+    break;
+  case ANSI_COLOUR_256:
+    snprintf(buf, sizeof(buf), "\033[38;5;%um", code);
+    break;
+  case ANSI_COLOUR_TRUE:
+    snprintf(buf, sizeof(buf), "\033[38;2;%u;%u;%um",
+             (code >> 16) & 0xff, (code >> 8) & 0xff, code & 0xff);
+    break;
+  default:
+    snprintf(buf, sizeof(buf), "\033[39m");
+  }
+
+  out += buf;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Write a run of cells
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ansi_put_cells(std::string &out, const term_cell *cells, int n) {
+  unsigned int style = 0;
+  for (int i = 0; i < n; i++) {
+    if (cells[i].style != style) {
+      style = cells[i].style;
+      put_style(out, style);
+    }
+    utf8_append(out, cells[i].ch);
+  }
+  if (style != 0) {
+    out += "\033[0m";
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Changed cells only
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ansi_redraw(const term_screen *prev, const term_screen &next, std::string &out) {
+
+  // A cursor movement costs ~8 bytes. Rather re-send a few unchanged cells
+  const int max_gap = 6;
+
+  if (prev == NULL || prev->width != next.width || prev->height != next.height) {
+    out += "\033[H\033[2J";
+    for (int row = 0; row < next.height; row++) {
+      cursor_to(out, row + 1, 1);
+      ansi_put_cells(out, &next.cells[(size_t)row * next.width], next.width);
+    }
+    cursor_to(out, next.height + 1, 1);
+    return;
+  }
+
+  bool changed = false;
+  for (int row = 0; row < next.height; row++) {
+    const term_cell *a = &prev->cells[(size_t)row * next.width];
+    const term_cell *b = &next.cells [(size_t)row * next.width];
+
+    int col = 0;
+    while (col < next.width) {
+      if (a[col] == b[col]) {
+        col++;
+        continue;
+      }
+
+      // Extend the run while the next change is within 'max_gap' cells
+      int start = col, end = col;
+      for (int k = col + 1; k < next.width && k - end <= max_gap; k++) {
+        if (a[k] != b[k]) end = k;
+      }
+
+      cursor_to(out, row + 1, start + 1);
+      ansi_put_cells(out, b + start, end - start + 1);
+      changed = true;
+      col = end + 1;
+    }
+  }
+
+  if (changed) {
+    cursor_to(out, next.height + 1, 1);
+  }
+}
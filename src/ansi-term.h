@@ -0,0 +1,84 @@
+#ifndef DEVOUT_ANSI_TERM_H
+#define DEVOUT_ANSI_TERM_H
+
+#include <string>
+#include <vector>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A character cell on the terminal: a unicode code point and a style
+// (0 = terminal default, otherwise see 'ansi_style()')
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct term_cell {
+  unsigned int ch;
+  unsigned int style;
+
+  bool operator==(const term_cell &other) const {
+    return ch == other.ch && style == other.style;
+  }
+  bool operator!=(const term_cell &other) const { return !(*this == other); }
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A full screen of cells, stored row by row
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct term_screen {
+  int                    width;
+  int                    height;
+  std::vector<term_cell> cells;
+
+  term_screen() : width(0), height(0) {}
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Build the ANSI output which turns 'prev' into 'next' on a terminal
+// where 'prev' is already displayed at the top left.
+//
+// Only changed cells are written, each run preceded by a cursor movement.
+// Nearby runs are merged when re-sending the unchanged cells between them
+// is shorter than another cursor movement.  If 'prev' is NULL or a
+// different size, the screen is cleared and everything is drawn.
+//
+// Output is empty if nothing changed.  Otherwise the cursor is left on the
+// line after the last row.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ansi_redraw(const term_screen *prev, const term_screen &next, std::string &out);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Write a run of cells, changing the foreground colour only where the style
+// changes.  Colour is reset at the end of the run
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ansi_put_cells(std::string &out, const term_cell *cells, int n);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Foreground colour modes
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define ANSI_COLOUR_NONE 0
+#define ANSI_COLOUR_16   1
+#define ANSI_COLOUR_256  2
+#define ANSI_COLOUR_TRUE 3
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Quantise a 0xRRGGBB colour to a cell style for the given mode.
+//
+// The style is '(mode << 24) | code' where code is the ANSI 16 or 256
+// colour index, or the colour itself for truecolor.  The 16 and 256 colour
+// modes use a 32x32x32 lookup table (5 bits per channel), built once, so
+// quantising is a single table lookup.  Neighbouring cells with similar
+// colours end up with equal styles and share one escape sequence.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+unsigned int ansi_style(unsigned int rgb, int mode);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// UTF-8 helpers.  Invalid bytes decode as U+FFFD
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void utf8_decode(const char *s, std::vector<unsigned int> &out);
+void utf8_append(std::string &out, unsigned int cp);
+
+#endif
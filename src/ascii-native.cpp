@@ -0,0 +1,226 @@
+#include <Rcpp.h>
+#include <algorithm>
+#include <map>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "ansi-term.h"
+#include "display-list.h"
+#include "subcell.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// What is currently displayed on each output (fd, or -1 for the R console).
+// This outlives any single device so a plot which is redrawn by opening a
+// new ascii() device each time is still only sent as changes.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static std::map<int, term_screen> screens;
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Write to the R console (fd < 0) or a file descriptor
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void write_output(int fd, const std::string &out) {
+  if (out.empty()) return;
+
+  if (fd < 0) {
+    Rprintf("%s", out.c_str());
+    R_FlushConsole();
+    return;
+  }
+
+  size_t pos = 0;
+  while (pos < out.size()) {
+#ifdef _WIN32
+    int n = _write(fd, out.data() + pos, (unsigned int)(out.size() - pos));
+#else
+    ssize_t n = write(fd, out.data() + pos, out.size() - pos);
+#endif
+    if (n <= 0) {
+      Rcpp::stop("ansi_redraw_(): write to fd %d failed", fd);
+    }
+    pos += (size_t)n;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// One string per row -> screen.  Short rows are padded with spaces.
+//
+// 'colours' is NULL, or an integer matrix (rows x columns) of 0xRRGGBB
+// colours per cell with NA for the terminal default
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void screen_from_lines(Rcpp::CharacterVector lines, SEXP colours, int mode,
+                              term_screen &screen) {
+  std::vector<std::vector<unsigned int> > rows(lines.size());
+  int width = 0;
+  for (R_xlen_t i = 0; i < lines.size(); i++) {
+    if (lines[i] != NA_STRING) {
+      utf8_decode(Rf_translateCharUTF8(lines[i]), rows[i]);
+    }
+    if ((int)rows[i].size() > width) width = (int)rows[i].size();
+  }
+
+  screen.width  = width;
+  screen.height = (int)rows.size();
+  term_cell blank = {' ', 0};
+  screen.cells.assign((size_t)width * screen.height, blank);
+  for (size_t i = 0; i < rows.size(); i++) {
+    for (size_t j = 0; j < rows[i].size(); j++) {
+      screen.cells[i * width + j].ch = rows[i][j];
+    }
+  }
+
+  if (Rf_isNull(colours) || mode == ANSI_COLOUR_NONE) return;
+
+  Rcpp::IntegerMatrix col(colours);
+  int nr = std::min(col.nrow(), screen.height);
+  int nc = std::min(col.ncol(), width);
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < nc; j++) {
+      int rgb = col(i, j);
+      if (rgb != NA_INTEGER) {
+        screen.cells[(size_t)i * width + j].style = ansi_style((unsigned int)rgb, mode);
+      }
+    }
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Redraw a character canvas on a terminal, sending only the changes
+//'
+//' The first time (or when the size changes) the screen is cleared and all
+//' rows are drawn.  After that only cells which differ from the last
+//' frame sent to the same output are written, using ANSI cursor movement.
+//'
+//' @param lines character vector. One string per row
+//' @param fd file descriptor to write to. -1 for the R console
+//' @param colours NULL or integer matrix of colours (0xRRGGBB) per cell
+//' @param mode colour mode. 0 = none, 1 = 16 colours, 2 = 256 colours,
+//'        3 = truecolor
+//'
+//' @return number of bytes written
+//'
+// [[Rcpp::export]]
+int ansi_redraw_(Rcpp::CharacterVector lines, int fd, SEXP colours, int mode) {
+  term_screen next;
+  screen_from_lines(lines, colours, mode, next);
+
+  std::map<int, term_screen>::iterator it = screens.find(fd);
+  std::string out;
+  ansi_redraw(it == screens.end() ? NULL : &it->second, next, out);
+
+  write_output(fd, out);
+  std::swap(screens[fd], next);
+
+  return (int)out.size();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Add ANSI colour escapes to each row of a character canvas
+//'
+//' An escape is only written where the colour changes along a row.
+//'
+//' @inheritParams ansi_redraw_
+//'
+//' @return character vector of rows including escapes
+//'
+// [[Rcpp::export]]
+Rcpp::CharacterVector ansi_colour_lines_(Rcpp::CharacterVector lines, SEXP colours, int mode) {
+  term_screen screen;
+  screen_from_lines(lines, colours, mode, screen);
+
+  Rcpp::CharacterVector res(screen.height);
+  std::string row;
+  for (int i = 0; i < screen.height; i++) {
+    row.clear();
+    ansi_put_cells(row, &screen.cells[(size_t)i * screen.width], screen.width);
+    res[i] = Rf_mkCharCE(row.c_str(), CE_UTF8);
+  }
+
+  return res;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Render the latest page of a recording as Braille or half-block glyphs
+//'
+//' The page is rasterised at 2x4 (Braille) or 1x2 (half-block) pixels per
+//' character cell and packed into one glyph per cell.  Text is not drawn.
+//' All but the latest page are dropped from the recording so that memory
+//' use stays constant on a long-running device.
+//'
+//' @param rec recording
+//' @param mode 1 = Braille, 2 = half-block
+//' @param width,height size of the canvas in cells
+//'
+//' @return list of 'chars' (character matrix) and 'colours' (integer matrix
+//'         of 0xRRGGBB, NA where a cell is empty)
+//'
+// [[Rcpp::export]]
+Rcpp::List subcell_canvas_(SEXP rec, int mode, int width, int height) {
+  Rcpp::XPtr<dl_recording> ptr(rec);
+
+  if (mode != SUBCELL_BRAILLE && mode != SUBCELL_HALFBLOCK) {
+    Rcpp::stop("subcell_canvas_(): unknown mode %d", mode);
+  }
+
+  Rcpp::CharacterMatrix chars(height, width);
+  Rcpp::IntegerMatrix   colours(height, width);
+  for (R_xlen_t k = 0; k < chars.size(); k++) {
+    chars[k]   = " ";
+    colours[k] = NA_INTEGER;
+  }
+
+  std::vector<dl_page> &pages = ptr->pages;
+  if (pages.empty()) {
+    return Rcpp::List::create(Rcpp::Named("chars") = chars, Rcpp::Named("colours") = colours);
+  }
+  if (pages.size() > 1) {
+    pages.erase(pages.begin(), pages.end() - 1);
+  }
+
+  int xpix, ypix;
+  subcell_size(mode, xpix, ypix);
+
+  rgba_image img;
+  dl_rasterise(pages.back(), xpix, ypix, img);
+
+  std::vector<unsigned int> glyphs;
+  std::vector<int>          cols;
+  subcell_pack(img, mode, width, height, (unsigned int)pages.back().bg, glyphs, cols);
+
+  std::string ch;
+  for (int i = 0; i < height; i++) {
+    for (int j = 0; j < width; j++) {
+      size_t idx = (size_t)i * width + j;
+      if (glyphs[idx] != ' ') {
+        ch.clear();
+        utf8_append(ch, glyphs[idx]);
+        chars(i, j) = Rf_mkCharCE(ch.c_str(), CE_UTF8);
+      }
+      if (cols[idx] >= 0) {
+        colours(i, j) = cols[idx];
+      }
+    }
+  }
+
+  return Rcpp::List::create(Rcpp::Named("chars") = chars, Rcpp::Named("colours") = colours);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Forget what was last drawn on an output so the next redraw is in full
+//'
+//' @param fd file descriptor. -1 for the R console
+//'
+// [[Rcpp::export]]
+void ansi_reset_(int fd) {
+  screens.erase(fd);
+}
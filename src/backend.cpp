@@ -0,0 +1,54 @@
+#include <Rcpp.h>
+#include <cstddef>
+#include <cstring>
+#include <map>
+
+#include "backend.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Registered backends by name
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static std::map<std::string, devout_backend> backends;
+
+
+extern "C" int devout_register_backend(const char *name, const devout_backend *backend) {
+  if (name == NULL) return -1;
+
+  if (backend == NULL) {
+    backends.erase(name);
+    return 0;
+  }
+
+  // Tables only ever grow.  Copy as much as the registering package knows
+  // about so an older table isn't read past its end, and leave the rest NULL
+  size_t len;
+  switch (backend->version) {
+  case 1 : len = offsetof(devout_backend, geometry); break;
+  case 2 : len = sizeof(devout_backend);             break;
+  default: return -1;
+  }
+
+  devout_backend be;
+  std::memset(&be, 0, sizeof(be));
+  std::memcpy(&be, backend, len);
+  backends[name] = be;
+  return 0;
+}
+
+
+devout_backend *devout_find_backend(const std::string &name) {
+  std::map<std::string, devout_backend>::const_iterator it = backends.find(name);
+  if (it == backends.end()) return NULL;
+  return new devout_backend(it->second);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Make the registry available to other packages when devout is loaded
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// [[Rcpp::init]]
+void devout_init(DllInfo *dll) {
+  R_RegisterCCallable("devout", "devout_register_backend",
+                      (DL_FUNC)devout_register_backend);
+}
@@ -0,0 +1,29 @@
+#ifndef DEVOUT_BACKEND_H
+#define DEVOUT_BACKEND_H
+
+#include <string>
+
+// The inline wrapper in the public header is for other packages.  Here the
+// real function is declared instead
+#define DEVOUT_INTERNAL
+#include <devout.h>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Registry of native backends (see inst/include/devout.h).
+//
+// Other packages reach 'devout_register_backend()' through
+// R_GetCCallable().  It is registered in 'devout_init()' when the package
+// is loaded.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+extern "C" int devout_register_backend(const char *name, const devout_backend *backend);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A copy of the backend registered as 'name', or NULL if there isn't one.
+// The caller owns the copy, so later (re-)registration doesn't affect a
+// device which is already open
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+devout_backend *devout_find_backend(const std::string &name);
+
+#endif
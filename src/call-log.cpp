@@ -0,0 +1,272 @@
+#include "call-log.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+// Write out a file's buffer once it's this big
+#define CALL_LOG_BUFSIZE 65536
+
+
+call_log::call_log(const std::string &path, bool ndjson, bool append,
+                   const std::vector<std::string> &skip) :
+  fp(NULL), ndjson(ndjson), skip(skip.begin(), skip.end()) {
+
+  if (!path.empty()) {
+    fp = fopen(path.c_str(), append ? "ab" : "wb");
+    if (fp == NULL) {
+      error = "could not open '" + path + "': " + strerror(errno);
+    }
+  }
+  buf.reserve(CALL_LOG_BUFSIZE);
+}
+
+
+call_log::~call_log() {
+  flush();
+  if (fp != NULL) fclose(fp);
+}
+
+
+bool call_log::skipped(const char *device_call) const {
+  return !skip.empty() && skip.count(device_call) > 0;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Write out everything buffered so far
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void call_log::flush() {
+  if (buf.empty()) return;
+
+  if (fp != NULL) {
+    fwrite(buf.data(), 1, buf.size(), fp);
+    fflush(fp);
+  } else if (error.empty()) {
+    Rprintf("%s", buf.c_str());
+  }
+
+  buf.clear();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Doubles as R prints them with 15 significant digits
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void call_log::put_double(double d, bool json) {
+  char tmp[32];
+  if (ISNA(d)) {
+    buf += json ? "null" : "NA";
+  } else if (ISNAN(d)) {
+    buf += json ? "null" : "NaN";
+  } else if (!std::isfinite(d)) {
+    buf += json ? "null" : (d > 0 ? "Inf" : "-Inf");
+  } else {
+    snprintf(tmp, sizeof(tmp), "%.15g", d);
+    buf += tmp;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Text: as 'paste()' shows a list element. Single values as is, longer
+// vectors as 'c(...)' with strings quoted
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void call_log::text_value(SEXP x) {
+  char tmp[32];
+  R_xlen_t n = Rf_xlength(x);
+
+  if (TYPEOF(x) == NILSXP) {
+    buf += "NULL";
+    return;
+  }
+  if (TYPEOF(x) == VECSXP) {
+    buf += "list(";
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (i > 0) buf += ", ";
+      text_value(VECTOR_ELT(x, i));
+    }
+    buf += ")";
+    return;
+  }
+
+  bool multi = (n != 1);
+  if (multi) buf += "c(";
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (i > 0) buf += ", ";
+    switch (TYPEOF(x)) {
+    case REALSXP:
+      put_double(REAL(x)[i], false);
+      break;
+    case INTSXP:
+      if (INTEGER(x)[i] == NA_INTEGER) {
+        buf += "NA";
+      } else {
+        snprintf(tmp, sizeof(tmp), "%d", INTEGER(x)[i]);
+        buf += tmp;
+      }
+      break;
+    case LGLSXP:
+      buf += LOGICAL(x)[i] == NA_LOGICAL ? "NA" : (LOGICAL(x)[i] ? "TRUE" : "FALSE");
+      break;
+    case STRSXP:
+      if (STRING_ELT(x, i) == NA_STRING) {
+        buf += "NA";
+      } else if (multi) {
+        buf += '"';
+        buf += Rf_translateCharUTF8(STRING_ELT(x, i));
+        buf += '"';
+      } else {
+        buf += Rf_translateCharUTF8(STRING_ELT(x, i));
+      }
+      break;
+    case RAWSXP:
+      snprintf(tmp, sizeof(tmp), "%02x", RAW(x)[i]);
+      buf += tmp;
+      break;
+    default:
+      buf += "<";
+      buf += Rf_type2char(TYPEOF(x));
+      buf += ">";
+      i = n;
+    }
+  }
+
+  if (multi) buf += ")";
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// JSON string with escapes
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void call_log::json_string(const char *s) {
+  char tmp[8];
+  buf += '"';
+  for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+    switch (*p) {
+    case '"' : buf += "\\\""; break;
+    case '\\': buf += "\\\\"; break;
+    case '\n': buf += "\\n";  break;
+    case '\r': buf += "\\r";  break;
+    case '\t': buf += "\\t";  break;
+    default:
+      if (*p < 0x20) {
+        snprintf(tmp, sizeof(tmp), "\\u%04x", *p);
+        buf += tmp;
+      } else {
+        buf += (char)*p;
+      }
+    }
+  }
+  buf += '"';
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// JSON: named lists are objects, other lists and vectors are arrays.
+// Length 1 vectors are written as a single value if 'unbox'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void call_log::json_value(SEXP x, bool unbox) {
+  char tmp[32];
+  R_xlen_t n = Rf_xlength(x);
+
+  if (TYPEOF(x) == NILSXP) {
+    buf += "null";
+    return;
+  }
+
+  if (TYPEOF(x) == VECSXP) {
+    SEXP names = Rf_getAttrib(x, R_NamesSymbol);
+    bool named = !Rf_isNull(names);
+    buf += named ? '{' : '[';
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (i > 0) buf += ',';
+      if (named) {
+        json_string(Rf_translateCharUTF8(STRING_ELT(names, i)));
+        buf += ':';
+      }
+      json_value(VECTOR_ELT(x, i), true);
+    }
+    buf += named ? '}' : ']';
+    return;
+  }
+
+  bool array = !(unbox && n == 1);
+  if (array) buf += '[';
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (i > 0) buf += ',';
+    switch (TYPEOF(x)) {
+    case REALSXP:
+      put_double(REAL(x)[i], true);
+      break;
+    case INTSXP:
+      if (INTEGER(x)[i] == NA_INTEGER) {
+        buf += "null";
+      } else {
+        snprintf(tmp, sizeof(tmp), "%d", INTEGER(x)[i]);
+        buf += tmp;
+      }
+      break;
+    case LGLSXP:
+      buf += LOGICAL(x)[i] == NA_LOGICAL ? "null" : (LOGICAL(x)[i] ? "true" : "false");
+      break;
+    case STRSXP:
+      if (STRING_ELT(x, i) == NA_STRING) {
+        buf += "null";
+      } else {
+        json_string(Rf_translateCharUTF8(STRING_ELT(x, i)));
+      }
+      break;
+    case RAWSXP:
+      snprintf(tmp, sizeof(tmp), "%d", RAW(x)[i]);
+      buf += tmp;
+      break;
+    default:
+      buf += "null";
+      i = n;
+    }
+  }
+
+  if (array) buf += ']';
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Log a single device call
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void call_log::log(const char *device_call, SEXP args) {
+  if (skipped(device_call)) return;
+
+  if (ndjson) {
+    buf += "{\"call\":";
+    json_string(device_call);
+    buf += ",\"args\":";
+    if (Rf_xlength(args) == 0) {
+      buf += "{}";
+    } else {
+      json_value(args, true);
+    }
+    buf += "}\n";
+  } else {
+    buf += "[ ";
+    buf += device_call;
+    buf += " ]: ";
+
+    SEXP names = Rf_getAttrib(args, R_NamesSymbol);
+    R_xlen_t n = Rf_xlength(args);
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (i > 0) buf += ",  ";
+      if (!Rf_isNull(names)) buf += Rf_translateCharUTF8(STRING_ELT(names, i));
+      buf += " = ";
+      text_value(VECTOR_ELT(args, i));
+    }
+    buf += "\n";
+  }
+
+  // The console is written as it goes, so it keeps up with the drawing
+  if (fp == NULL || buf.size() >= CALL_LOG_BUFSIZE) {
+    flush();
+  }
+}
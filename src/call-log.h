@@ -0,0 +1,50 @@
+#ifndef DEVOUT_CALL_LOG_H
+#define DEVOUT_CALL_LOG_H
+
+#include <Rcpp.h>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Log of every device call (see call_log()).
+//
+// Each call is formatted in C++ straight from the argument list built for
+// the callback.  Console output is written after every call.  A file is
+// buffered and written out when the buffer gets large, at each new page,
+// when the engine stops drawing (mode 0) and when the log is closed.
+// Calls named in 'skip' are dropped before any formatting.
+//
+// Formats:
+//   - text:   [ line ]: x1 = 1,  y1 = 2,  ...   (as verbose_callback())
+//   - ndjson: {"call":"line","args":{"x1":1,"y1":2,...}}  one per line
+//
+// An empty 'path' writes to the R console.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class call_log {
+public:
+  call_log(const std::string &path, bool ndjson, bool append,
+           const std::vector<std::string> &skip);
+  ~call_log();
+
+  bool skipped(const char *device_call) const;
+  void log(const char *device_call, SEXP args);
+  void flush();
+
+  std::string error;
+
+private:
+  void text_value(SEXP x);
+  void json_value(SEXP x, bool unbox);
+  void json_string(const char *s);
+  void put_double(double d, bool json);
+
+  FILE                  *fp;
+  bool                   ndjson;
+  std::set<std::string>  skip;
+  std::string            buf;
+};
+
+#endif
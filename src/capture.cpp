@@ -0,0 +1,342 @@
+#include <Rcpp.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "display-list.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// R packed ABGR colour -> "#RRGGBB", "#RRGGBBAA" or "transparent"
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP col_to_hex(int col) {
+  unsigned int c = (unsigned int)col;
+  unsigned int alpha = (c >> 24) & 255;
+  if (alpha == 0) {
+    return Rf_mkChar("transparent");
+  }
+
+  char buf[10];
+  if (alpha == 255) {
+    snprintf(buf, sizeof(buf), "#%02X%02X%02X", c & 255, (c >> 8) & 255, (c >> 16) & 255);
+  } else {
+    snprintf(buf, sizeof(buf), "#%02X%02X%02X%02X", c & 255, (c >> 8) & 255, (c >> 16) & 255,
+             alpha);
+  }
+  return Rf_mkChar(buf);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A table under construction.  All columns are allocated at their final
+// length up front and filled by row index.
+//
+// Every table starts with 'id' (1-based position of the op in the whole
+// capture, so rows from different tables can be put back in drawing order)
+// and 'page', and ends with the graphics context columns.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class capture_table {
+public:
+  explicit capture_table(int n, bool with_gc = true) : n(n), with_gc(with_gc),
+    id(n), page(n),
+    col(with_gc ? n : 0), fill(with_gc ? n : 0), lwd(with_gc ? n : 0), lty(with_gc ? n : 0),
+    lend(with_gc ? n : 0), ljoin(with_gc ? n : 0), cex(with_gc ? n : 0), ps(with_gc ? n : 0),
+    fontface(with_gc ? n : 0), fontfamily(with_gc ? n : 0) {}
+
+  void set(int i, int op_id, int page_num, const dl_gc *gc) {
+    id  [i] = op_id;
+    page[i] = page_num;
+    if (!with_gc) return;
+
+    col       [i] = col_to_hex(gc->col);
+    fill      [i] = col_to_hex(gc->fill);
+    lwd       [i] = gc->lwd;
+    lty       [i] = gc->lty;
+    lend      [i] = gc->lend;
+    ljoin     [i] = gc->ljoin;
+    cex       [i] = gc->cex;
+    ps        [i] = gc->ps;
+    fontface  [i] = gc->fontface;
+    fontfamily[i] = Rf_mkChar(gc->fontfamily.c_str());
+  }
+
+  void add(const char *name, SEXP column) {
+    names.push_back(name);
+    columns.push_back(column);
+  }
+
+  // Build the data.frame: id, page, extra columns, then gc columns
+  Rcpp::List data_frame() {
+    std::vector<std::string> all_names;
+    std::vector<SEXP>        all_columns;
+
+    all_names.push_back("id");
+    all_columns.push_back(id);
+    all_names.push_back("page");
+    all_columns.push_back(page);
+    all_names.insert(all_names.end(), names.begin(), names.end());
+    all_columns.insert(all_columns.end(), columns.begin(), columns.end());
+
+    if (with_gc) {
+      const char *gc_names[] = {"col", "fill", "lwd", "lty", "lend", "ljoin", "cex", "ps",
+                                "fontface", "fontfamily"};
+      SEXP gc_columns[] = {col, fill, lwd, lty, lend, ljoin, cex, ps, fontface, fontfamily};
+      for (int k = 0; k < 10; k++) {
+        all_names.push_back(gc_names[k]);
+        all_columns.push_back(gc_columns[k]);
+      }
+    }
+
+    Rcpp::List df(all_columns.size());
+    Rcpp::CharacterVector df_names(all_columns.size());
+    for (size_t k = 0; k < all_columns.size(); k++) {
+      df[k]       = all_columns[k];
+      df_names[k] = all_names[k];
+    }
+
+    // Compact row names, as used by data.frame() itself
+    Rcpp::IntegerVector row_names(2);
+    row_names[0] = NA_INTEGER;
+    row_names[1] = -n;
+
+    df.attr("names")     = df_names;
+    df.attr("row.names") = row_names;
+    df.attr("class")     = "data.frame";
+
+    return df;
+  }
+
+private:
+  int  n;
+  bool with_gc;
+
+  Rcpp::IntegerVector   id, page;
+  Rcpp::CharacterVector col, fill;
+  Rcpp::NumericVector   lwd;
+  Rcpp::IntegerVector   lty, lend, ljoin;
+  Rcpp::NumericVector   cex, ps;
+  Rcpp::IntegerVector   fontface;
+  Rcpp::CharacterVector fontfamily;
+
+  std::vector<std::string> names;
+  std::vector<SEXP>        columns;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Convert a recording into one data.frame per type of primitive
+//'
+//' The recording is scanned twice: once to count the rows of each table
+//' (so every column is allocated only once at its final size) and once to
+//' fill them.
+//'
+//' Lines and polylines are in \code{lines}, polygons and paths in
+//' \code{polygons}.  Their coordinates are in \code{vertices}, with
+//' \code{id} linking each vertex to its primitive and \code{subpath}
+//' numbering the sub-paths of a path.  Clipping and glyph ops are not
+//' included.
+//'
+//' @param rec recording
+//'
+//' @return named list of data.frames: circles, rects, lines, polygons,
+//'         vertices, text, rasters
+//'
+// [[Rcpp::export]]
+Rcpp::List capture_tables_(SEXP rec) {
+  Rcpp::XPtr<dl_recording> ptr(rec);
+  const std::vector<dl_page> &pages = ptr->pages;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Pass 1: count rows
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  int ncircle = 0, nrect = 0, nline = 0, npoly = 0, nvert = 0, ntext = 0, nraster = 0;
+  for (size_t p = 0; p < pages.size(); p++) {
+    const std::vector<dl_op> &ops = pages[p].dl.ops;
+    for (size_t i = 0; i < ops.size(); i++) {
+      switch (ops[i].type) {
+      case DL_CIRCLE  : ncircle++;                        break;
+      case DL_RECT    : nrect++;                          break;
+      case DL_LINE    :
+      case DL_POLYLINE: nline++; nvert += ops[i].n;       break;
+      case DL_POLYGON :
+      case DL_PATH    : npoly++; nvert += ops[i].n;       break;
+      case DL_TEXT    : ntext++;                          break;
+      case DL_RASTER  : nraster++;                        break;
+      default         :                                   break;
+      }
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Allocate
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  capture_table circles(ncircle);
+  Rcpp::NumericVector circle_x(ncircle), circle_y(ncircle), circle_r(ncircle);
+
+  capture_table rects(nrect);
+  Rcpp::NumericVector rect_x0(nrect), rect_y0(nrect), rect_x1(nrect), rect_y1(nrect);
+
+  capture_table lines(nline);
+  Rcpp::CharacterVector line_type(nline);
+  Rcpp::IntegerVector   line_n(nline);
+
+  capture_table polygons(npoly);
+  Rcpp::CharacterVector poly_type(npoly);
+  Rcpp::IntegerVector   poly_n(npoly), poly_subpaths(npoly);
+  Rcpp::LogicalVector   poly_winding(npoly);
+
+  capture_table vertices(nvert, false);
+  Rcpp::IntegerVector vert_subpath(nvert);
+  Rcpp::NumericVector vert_x(nvert), vert_y(nvert);
+
+  capture_table text(ntext);
+  Rcpp::NumericVector   text_x(ntext), text_y(ntext), text_rot(ntext), text_hadj(ntext);
+  Rcpp::CharacterVector text_str(ntext);
+
+  capture_table rasters(nraster);
+  Rcpp::NumericVector rast_x(nraster), rast_y(nraster), rast_width(nraster),
+                      rast_height(nraster), rast_rot(nraster);
+  Rcpp::IntegerVector rast_w(nraster), rast_h(nraster);
+  Rcpp::LogicalVector rast_interpolate(nraster);
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Pass 2: fill
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  int ic = 0, ir = 0, il = 0, ip = 0, iv = 0, it = 0, ia = 0;
+  int op_id = 0;
+  for (size_t p = 0; p < pages.size(); p++) {
+    const dl_list &dl = pages[p].dl;
+    int page_num = (int)p + 1;
+
+    for (size_t i = 0; i < dl.ops.size(); i++) {
+      const dl_op &op = dl.ops[i];
+      const dl_gc *gc = &dl.gcs[op.gc];
+      op_id++;
+
+      switch (op.type) {
+      case DL_CIRCLE:
+        circles.set(ic, op_id, page_num, gc);
+        circle_x[ic] = dl.xs[op.start];
+        circle_y[ic] = dl.ys[op.start];
+        circle_r[ic] = op.a;
+        ic++;
+        break;
+      case DL_RECT:
+        rects.set(ir, op_id, page_num, gc);
+        rect_x0[ir] = dl.xs[op.start];
+        rect_y0[ir] = dl.ys[op.start];
+        rect_x1[ir] = dl.xs[op.start + 1];
+        rect_y1[ir] = dl.ys[op.start + 1];
+        ir++;
+        break;
+      case DL_LINE:
+      case DL_POLYLINE:
+      case DL_POLYGON:
+      case DL_PATH: {
+        if (op.type == DL_LINE || op.type == DL_POLYLINE) {
+          lines.set(il, op_id, page_num, gc);
+          line_type[il] = dl_op_names[op.type];
+          line_n   [il] = op.n;
+          il++;
+        } else {
+          polygons.set(ip, op_id, page_num, gc);
+          poly_type    [ip] = dl_op_names[op.type];
+          poly_n       [ip] = op.n;
+          poly_subpaths[ip] = op.type == DL_PATH ? op.ni : 1;
+          poly_winding [ip] = op.type == DL_PATH ? (op.flag != 0) : NA_LOGICAL;
+          ip++;
+        }
+
+        // Sub-path number of each vertex. Only paths have more than one
+        int subpath = 1, remaining = op.type == DL_PATH && op.ni > 0 ? dl.ints[op.istart] : op.n;
+        for (int k = 0; k < op.n; k++) {
+          while (remaining == 0 && subpath < op.ni) {
+            remaining = dl.ints[op.istart + subpath];
+            subpath++;
+          }
+          vertices.set(iv, op_id, page_num, NULL);
+          vert_subpath[iv] = subpath;
+          vert_x      [iv] = dl.xs[op.start + k];
+          vert_y      [iv] = dl.ys[op.start + k];
+          remaining--;
+          iv++;
+        }
+        break;
+      }
+      case DL_TEXT:
+        text.set(it, op_id, page_num, gc);
+        text_x   [it] = dl.xs[op.start];
+        text_y   [it] = dl.ys[op.start];
+        text_str [it] = Rf_mkCharCE(dl.strings[op.str].c_str(), op.flag ? CE_UTF8 : CE_NATIVE);
+        text_rot [it] = op.a;
+        text_hadj[it] = op.b;
+        it++;
+        break;
+      case DL_RASTER:
+        rasters.set(ia, op_id, page_num, gc);
+        rast_x          [ia] = dl.xs[op.start];
+        rast_y          [ia] = dl.ys[op.start];
+        rast_width      [ia] = op.a;
+        rast_height     [ia] = op.b;
+        rast_rot        [ia] = op.c;
+        rast_interpolate[ia] = op.flag != 0;
+        rast_w          [ia] = dl.ints[op.istart];
+        rast_h          [ia] = dl.ints[op.istart + 1];
+        ia++;
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Assemble
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  circles.add("x", circle_x);
+  circles.add("y", circle_y);
+  circles.add("r", circle_r);
+
+  rects.add("x0", rect_x0);
+  rects.add("y0", rect_y0);
+  rects.add("x1", rect_x1);
+  rects.add("y1", rect_y1);
+
+  lines.add("type", line_type);
+  lines.add("n"   , line_n);
+
+  polygons.add("type"    , poly_type);
+  polygons.add("n"       , poly_n);
+  polygons.add("subpaths", poly_subpaths);
+  polygons.add("winding" , poly_winding);
+
+  vertices.add("subpath", vert_subpath);
+  vertices.add("x"      , vert_x);
+  vertices.add("y"      , vert_y);
+
+  text.add("x"   , text_x);
+  text.add("y"   , text_y);
+  text.add("str" , text_str);
+  text.add("rot" , text_rot);
+  text.add("hadj", text_hadj);
+
+  rasters.add("x"          , rast_x);
+  rasters.add("y"          , rast_y);
+  rasters.add("width"      , rast_width);
+  rasters.add("height"     , rast_height);
+  rasters.add("rot"        , rast_rot);
+  rasters.add("interpolate", rast_interpolate);
+  rasters.add("w"          , rast_w);
+  rasters.add("h"          , rast_h);
+
+  return Rcpp::List::create(
+    Rcpp::Named("circles")  = circles.data_frame(),
+    Rcpp::Named("rects")    = rects.data_frame(),
+    Rcpp::Named("lines")    = lines.data_frame(),
+    Rcpp::Named("polygons") = polygons.data_frame(),
+    Rcpp::Named("vertices") = vertices.data_frame(),
+    Rcpp::Named("text")     = text.data_frame(),
+    Rcpp::Named("rasters")  = rasters.data_frame()
+  );
+}
@@ -0,0 +1,444 @@
+#include "display-list.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const char *dl_op_names[DL_NUM_OP_TYPES] = {
+  "circle", "line", "polyline", "polygon", "path", "rect", "text", "raster", "clip", "glyph"
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Compare graphics contexts
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool dl_gc::operator==(const dl_gc &other) const {
+  return col          == other.col          &&
+         fill         == other.fill         &&
+         gamma        == other.gamma        &&
+         lwd          == other.lwd          &&
+         lty          == other.lty          &&
+         lend         == other.lend         &&
+         ljoin        == other.ljoin        &&
+         lmitre       == other.lmitre       &&
+         cex          == other.cex          &&
+         ps           == other.ps           &&
+         lineheight   == other.lineheight   &&
+         fontface     == other.fontface     &&
+         pattern      == other.pattern      &&
+         pattern_hash == other.pattern_hash &&
+         clip_hash    == other.clip_hash    &&
+         mask_hash    == other.mask_hash    &&
+         fontfamily   == other.fontfamily;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Remove all ops
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_list::clear() {
+  ops.clear();
+  xs.clear();
+  ys.clear();
+  ints.clear();
+  gcs.clear();
+  strings.clear();
+  rasters.clear();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Approximate number of bytes used by the list
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+size_t dl_list::memory_size() const {
+  size_t total = ops.capacity() * sizeof(dl_op) +
+    (xs.capacity() + ys.capacity()) * sizeof(double) +
+    ints.capacity() * sizeof(int) +
+    gcs.capacity() * sizeof(dl_gc);
+
+  for (size_t i = 0; i < strings.size(); i++) total += strings[i].capacity();
+  for (size_t i = 0; i < rasters.size(); i++) total += rasters[i].capacity() * sizeof(unsigned int);
+
+  return total;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Add a graphics context. Re-use the last one if it's identical.
+//
+// @return index into 'gcs'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int dl_list::add_gc(const dl_gc &gc) {
+  if (!gcs.empty() && gcs.back() == gc) {
+    return (int)gcs.size() - 1;
+  }
+  gcs.push_back(gc);
+  return (int)gcs.size() - 1;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Add a generic op with 'n' coordinates
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+dl_op &dl_list::add_op(dl_op_type type, const dl_gc &gc, const double *x, const double *y, int n) {
+  dl_op op;
+  op.type   = type;
+  op.gc     = add_gc(gc);
+  op.start  = (int)xs.size();
+  op.n      = n;
+  op.istart = (int)ints.size();
+  op.ni     = 0;
+  op.str    = -1;
+  op.flag   = 0;
+  op.a      = 0;
+  op.b      = 0;
+  op.c      = 0;
+
+  xs.insert(xs.end(), x, x + n);
+  ys.insert(ys.end(), y, y + n);
+
+  ops.push_back(op);
+  return ops.back();
+}
+
+
+void dl_list::circle(const dl_gc &gc, double x, double y, double r) {
+  dl_op &op = add_op(DL_CIRCLE, gc, &x, &y, 1);
+  op.a = r;
+}
+
+void dl_list::line(const dl_gc &gc, double x1, double y1, double x2, double y2) {
+  double x[2] = {x1, x2};
+  double y[2] = {y1, y2};
+  add_op(DL_LINE, gc, x, y, 2);
+}
+
+void dl_list::polyline(const dl_gc &gc, int n, const double *x, const double *y) {
+  add_op(DL_POLYLINE, gc, x, y, n);
+}
+
+void dl_list::polygon(const dl_gc &gc, int n, const double *x, const double *y) {
+  add_op(DL_POLYGON, gc, x, y, n);
+}
+
+void dl_list::path(const dl_gc &gc, const double *x, const double *y, int npoly,
+                   const int *nper, bool winding) {
+  int total = 0;
+  for (int i = 0; i < npoly; i++) total += nper[i];
+
+  dl_op &op = add_op(DL_PATH, gc, x, y, total);
+  ints.insert(ints.end(), nper, nper + npoly);
+  op.ni   = npoly;
+  op.flag = winding;
+}
+
+void dl_list::rect(const dl_gc &gc, double x0, double y0, double x1, double y1) {
+  double x[2] = {x0, x1};
+  double y[2] = {y0, y1};
+  add_op(DL_RECT, gc, x, y, 2);
+}
+
+void dl_list::text(const dl_gc &gc, double x, double y, const std::string &str,
+                   double rot, double hadj, bool utf8) {
+  dl_op &op = add_op(DL_TEXT, gc, &x, &y, 1);
+  op.flag = utf8;
+  op.a   = rot;
+  op.b   = hadj;
+  op.str = (int)strings.size();
+  strings.push_back(str);
+}
+
+void dl_list::raster(const dl_gc &gc, const unsigned int *raster, int w, int h,
+                     double x, double y, double width, double height, double rot,
+                     bool interpolate) {
+  dl_op &op = add_op(DL_RASTER, gc, &x, &y, 1);
+  op.a    = width;
+  op.b    = height;
+  op.c    = rot;
+  op.flag = interpolate;
+  op.ni   = 2;
+  ints.push_back(w);
+  ints.push_back(h);
+  op.str  = (int)rasters.size();
+  rasters.push_back(std::vector<unsigned int>(raster, raster + (size_t)w * h));
+}
+
+void dl_list::clip(const dl_gc &gc, double x0, double x1, double y0, double y1) {
+  double x[2] = {x0, x1};
+  double y[2] = {y0, y1};
+  add_op(DL_CLIP, gc, x, y, 2);
+}
+
+void dl_list::glyph(const dl_gc &gc, int n, const int *glyphs, const double *x, const double *y,
+                    const std::string &font_file, int font_index, double size, double rot) {
+  dl_op &op = add_op(DL_GLYPH, gc, x, y, n);
+  ints.insert(ints.end(), glyphs, glyphs + n);
+  op.ni  = n;
+  op.a   = size;
+  op.b   = rot;
+  op.c   = font_index;
+  op.str = (int)strings.size();
+  strings.push_back(font_file);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Append a single op from another list
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_list::append_op(const dl_list &src, const dl_op &sop, const dl_gc *gc) {
+  dl_op &op = add_op(sop.type, gc ? *gc : src.gcs[sop.gc],
+                     src.xs.data() + sop.start, src.ys.data() + sop.start, sop.n);
+
+  op.istart = (int)ints.size();
+  op.ni     = sop.ni;
+  op.flag   = sop.flag;
+  op.a      = sop.a;
+  op.b      = sop.b;
+  op.c      = sop.c;
+  ints.insert(ints.end(), src.ints.begin() + sop.istart, src.ints.begin() + sop.istart + sop.ni);
+
+  if (sop.str >= 0) {
+    if (sop.type == DL_RASTER) {
+      op.str = (int)rasters.size();
+      rasters.push_back(src.rasters[sop.str]);
+    } else {
+      op.str = (int)strings.size();
+      strings.push_back(src.strings[sop.str]);
+    }
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Append all ops from another list, with an optional affine transform
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_list::append(const dl_list &src, const double *m) {
+
+  if (m == 0) {
+    for (size_t i = 0; i < src.ops.size(); i++) {
+      append_op(src, src.ops[i]);
+    }
+    return;
+  }
+
+  double scale   = std::sqrt(std::fabs(m[0] * m[3] - m[1] * m[2]));
+  double xscale  = std::sqrt(m[0] * m[0] + m[1] * m[1]);
+  double yscale  = std::sqrt(m[2] * m[2] + m[3] * m[3]);
+  double angle   = std::atan2(m[1], m[0]) * 180.0 / M_PI;
+  bool   aligned = m[1] == 0 && m[2] == 0;
+
+  for (size_t i = 0; i < src.ops.size(); i++) {
+    const dl_op &sop = src.ops[i];
+
+    dl_gc gc = src.gcs[sop.gc];
+    gc.lwd *= scale;
+    gc.cex *= scale;
+
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // A rect which is rotated or sheared becomes a polygon
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    if (sop.type == DL_RECT && !aligned) {
+      double x0 = src.xs[sop.start], x1 = src.xs[sop.start + 1];
+      double y0 = src.ys[sop.start], y1 = src.ys[sop.start + 1];
+      double x[4] = {x0, x1, x1, x0};
+      double y[4] = {y0, y0, y1, y1};
+      for (int j = 0; j < 4; j++) {
+        double tx = m[0] * x[j] + m[2] * y[j] + m[4];
+        double ty = m[1] * x[j] + m[3] * y[j] + m[5];
+        x[j] = tx;
+        y[j] = ty;
+      }
+      polygon(gc, 4, x, y);
+      continue;
+    }
+
+    append_op(src, sop, &gc);
+    dl_op &op = ops.back();
+
+    for (int j = op.start; j < op.start + op.n; j++) {
+      double tx = m[0] * xs[j] + m[2] * ys[j] + m[4];
+      double ty = m[1] * xs[j] + m[3] * ys[j] + m[5];
+      xs[j] = tx;
+      ys[j] = ty;
+    }
+
+    switch (op.type) {
+    case DL_CIRCLE:
+      op.a *= scale;
+      break;
+    case DL_TEXT:
+      op.a += angle;
+      break;
+    case DL_RASTER:
+      op.a *= xscale;
+      op.b *= yscale;
+      op.c += angle;
+      break;
+    case DL_GLYPH:
+      op.a *= scale;
+      op.b += angle;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Flatten geometry into sub-paths
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_to_subpaths(const dl_list &dl, std::vector<double> &xs, std::vector<double> &ys,
+                    std::vector<int> &nper) {
+
+  for (size_t i = 0; i < dl.ops.size(); i++) {
+    const dl_op &op = dl.ops[i];
+    const double *x = dl.xs.data() + op.start;
+    const double *y = dl.ys.data() + op.start;
+
+    switch (op.type) {
+    case DL_CIRCLE: {
+      const int nseg = 36;
+      for (int j = 0; j < nseg; j++) {
+        double theta = 2 * M_PI * j / nseg;
+        xs.push_back(x[0] + op.a * std::cos(theta));
+        ys.push_back(y[0] + op.a * std::sin(theta));
+      }
+      nper.push_back(nseg);
+      break;
+    }
+    case DL_RECT: {
+      double rx[4] = {x[0], x[1], x[1], x[0]};
+      double ry[4] = {y[0], y[0], y[1], y[1]};
+      xs.insert(xs.end(), rx, rx + 4);
+      ys.insert(ys.end(), ry, ry + 4);
+      nper.push_back(4);
+      break;
+    }
+    case DL_LINE:
+    case DL_POLYLINE:
+    case DL_POLYGON:
+      xs.insert(xs.end(), x, x + op.n);
+      ys.insert(ys.end(), y, y + op.n);
+      nper.push_back(op.n);
+      break;
+    case DL_PATH:
+      xs.insert(xs.end(), x, x + op.n);
+      ys.insert(ys.end(), y, y + op.n);
+      nper.insert(nper.end(), dl.ints.begin() + op.istart, dl.ints.begin() + op.istart + op.ni);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Bounding box of a set of points
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static bbox points_bbox(const double *x, const double *y, int n) {
+  bbox box = {x[0], y[0], x[0], y[0]};
+  for (int i = 1; i < n; i++) {
+    box.x0 = std::min(box.x0, x[i]);
+    box.x1 = std::max(box.x1, x[i]);
+    box.y0 = std::min(box.y0, y[i]);
+    box.y1 = std::max(box.y1, y[i]);
+  }
+  return box;
+}
+
+
+bool dl_op_bbox(const dl_list &dl, const dl_op &op, bool ydown, bbox &box) {
+  if (op.type == DL_CLIP || op.n == 0) return false;
+
+  const double *x  = dl.xs.data() + op.start;
+  const double *y  = dl.ys.data() + op.start;
+  const dl_gc  &gc = dl.gcs[op.gc];
+
+  // Half the line width in device units ('lwd' is in 1/96 inch)
+  double pad = std::isfinite(gc.lwd) ? gc.lwd * 72.0 / 96.0 / 2 : 0;
+
+  switch (op.type) {
+  case DL_CIRCLE:
+    box = points_bbox(x, y, 1);
+    pad += std::fabs(op.a);
+    break;
+  case DL_TEXT: {
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // Estimate: characters are half as wide as the font size.  Descent is a
+    // quarter of the size.  The box is rotated about the anchor point
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const std::string &str = dl.strings[op.str];
+    int nchar = 0;
+    for (size_t i = 0; i < str.size(); i++) {
+      if ((str[i] & 0xc0) != 0x80) nchar++;
+    }
+    double size = gc.ps * gc.cex;
+    double w    = 0.5 * size * nchar;
+    double u0 = -op.b * w, u1 = u0 + w;
+    double v0 = -0.25 * size, v1 = 0.75 * size;
+
+    double th = op.a * M_PI / 180;
+    double ct = std::cos(th), st = std::sin(th);
+    double sy = ydown ? -1 : 1;
+    double cx[4], cy[4];
+    double us[4] = {u0, u1, u1, u0}, vs[4] = {v0, v0, v1, v1};
+    for (int k = 0; k < 4; k++) {
+      cx[k] = x[0] + us[k] * ct - vs[k] * st;
+      cy[k] = y[0] + sy * (us[k] * st + vs[k] * ct);
+    }
+    box = points_bbox(cx, cy, 4);
+    pad = 0;
+    break;
+  }
+  case DL_RASTER: {
+    // Same corners as the rasteriser
+    double th = op.c * M_PI / 180;
+    double ct = std::cos(th), st = std::sin(th);
+    double cx[4] = {x[0], x[0] + op.a * ct, x[0] + op.a * ct - op.b * st, x[0] - op.b * st};
+    double cy[4] = {y[0], y[0] + op.a * st, y[0] + op.a * st + op.b * ct, y[0] + op.b * ct};
+    box = points_bbox(cx, cy, 4);
+    pad = 0;
+    break;
+  }
+  case DL_GLYPH:
+    box = points_bbox(x, y, op.n);
+    pad = std::fabs(op.a);
+    break;
+  default:
+    box = points_bbox(x, y, op.n);
+    break;
+  }
+
+  box.x0 -= pad;
+  box.y0 -= pad;
+  box.x1 += pad;
+  box.y1 += pad;
+
+  return true;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Spatial index of a page
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+const rtree &dl_page_index(dl_page &page) {
+  const std::vector<dl_op> &ops = page.dl.ops;
+  if (page.index.size() == ops.size()) {
+    return page.index;
+  }
+
+  bool ydown = page.bottom > page.top;
+  std::vector<bbox> boxes(ops.size());
+  std::vector<bool> valid(ops.size());
+  for (size_t i = 0; i < ops.size(); i++) {
+    valid[i] = dl_op_bbox(page.dl, ops[i], ydown, boxes[i]);
+  }
+  page.index.build(boxes, valid);
+
+  return page.index;
+}
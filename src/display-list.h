@@ -0,0 +1,177 @@
+#ifndef DEVOUT_DISPLAY_LIST_H
+#define DEVOUT_DISPLAY_LIST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "spatial-index.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Native record of drawing primitives
+//
+// A 'dl_list' is a compact, append-only list of primitives in DEVICE
+// coordinates.  It contains only plain C++ data (no R objects) so it can be
+// kept beyond the lifetime of a device call, replayed later, or handed to
+// another thread.
+//
+// Coordinates for all ops are stored in shared 'xs'/'ys' pools, integer
+// data (path 'nper', glyph ids, raster dimensions) in 'ints', and the
+// graphics context of each op is an index into 'gcs' (consecutive ops with
+// identical gc share the same entry).
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+enum dl_op_type {
+  DL_CIRCLE   = 0,  // xs[start], ys[start], radius = a
+  DL_LINE     = 1,  // 2 coords
+  DL_POLYLINE = 2,  // n coords
+  DL_POLYGON  = 3,  // n coords
+  DL_PATH     = 4,  // n coords, 'ints' holds 'ni' values of nper. flag = winding
+  DL_RECT     = 5,  // 2 coords: (x0, y0), (x1, y1)
+  DL_TEXT     = 6,  // 1 coord. a = rot, b = hadj. strings[str]. flag = UTF-8
+  DL_RASTER   = 7,  // 1 coord (bottom left). a = width, b = height, c = rot.
+                    // ints = (w, h). rasters[str]. flag = interpolate
+  DL_CLIP     = 8,  // 2 coords: (x0, y0), (x1, y1)
+  DL_GLYPH    = 9,  // n coords, 'ints' holds glyph ids. a = size, b = rot, c = font index.
+                    // strings[str] = font file
+  DL_NUM_OP_TYPES
+};
+
+extern const char *dl_op_names[DL_NUM_OP_TYPES];
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Snapshot of the graphics context (see R_GE_gcontext)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct dl_gc {
+  int         col;          // [int] pen colour (R packed ABGR)
+  int         fill;         // [int] fill colour (R packed ABGR)
+  double      gamma;
+  double      lwd;
+  int         lty;
+  int         lend;
+  int         ljoin;
+  double      lmitre;
+  double      cex;
+  double      ps;
+  double      lineheight;
+  int         fontface;
+  std::string fontfamily;
+  int         pattern;      // [int] pattern handle. NA_INTEGER if none
+
+  // Content hashes (see dl_content_hash()) of the pattern, clipping path
+  // and mask in force. 0 if none, or not known
+  uint64_t    pattern_hash;
+  uint64_t    clip_hash;
+  uint64_t    mask_hash;
+
+  bool operator==(const dl_gc &other) const;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A single drawing operation. See 'dl_op_type' for how fields are used
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct dl_op {
+  dl_op_type type;
+  int        gc;      // index into 'gcs'
+  int        start;   // first coordinate in 'xs'/'ys'
+  int        n;       // number of coordinates
+  int        istart;  // first value in 'ints'
+  int        ni;      // number of values in 'ints'
+  int        str;     // index into 'strings' or 'rasters'. -1 if unused
+  int        flag;
+  double     a, b, c;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// List of drawing operations.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct dl_list {
+  std::vector<dl_op>                      ops;
+  std::vector<double>                     xs;
+  std::vector<double>                     ys;
+  std::vector<int>                        ints;
+  std::vector<dl_gc>                      gcs;
+  std::vector<std::string>                strings;
+  std::vector<std::vector<unsigned int> > rasters;
+
+  void clear();
+  bool empty() const { return ops.empty(); }
+  size_t memory_size() const;
+
+  int    add_gc(const dl_gc &gc);
+  dl_op &add_op(dl_op_type type, const dl_gc &gc, const double *x, const double *y, int n);
+
+  void circle  (const dl_gc &gc, double x, double y, double r);
+  void line    (const dl_gc &gc, double x1, double y1, double x2, double y2);
+  void polyline(const dl_gc &gc, int n, const double *x, const double *y);
+  void polygon (const dl_gc &gc, int n, const double *x, const double *y);
+  void path    (const dl_gc &gc, const double *x, const double *y, int npoly, const int *nper, bool winding);
+  void rect    (const dl_gc &gc, double x0, double y0, double x1, double y1);
+  void text    (const dl_gc &gc, double x, double y, const std::string &str, double rot, double hadj,
+                bool utf8);
+  void raster  (const dl_gc &gc, const unsigned int *raster, int w, int h,
+                double x, double y, double width, double height, double rot, bool interpolate);
+  void clip    (const dl_gc &gc, double x0, double x1, double y0, double y1);
+  void glyph   (const dl_gc &gc, int n, const int *glyphs, const double *x, const double *y,
+                const std::string &font_file, int font_index, double size, double rot);
+
+  // Append all ops from 'src'.  If 'm' is not NULL, it is an affine
+  // transform  (x' = m[0] x + m[2] y + m[4],  y' = m[1] x + m[3] y + m[5])
+  // applied to all coordinates (and line widths and text sizes are scaled
+  // to match).
+  void append(const dl_list &src, const double *m = 0);
+
+  // Append a single op from 'src' (untransformed). If 'gc' is not NULL it
+  // replaces the op's graphics context
+  void append_op(const dl_list &src, const dl_op &op, const dl_gc *gc = 0);
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A recorded page: its content, background fill and the device extents it
+// was drawn with.  'index' is only built when needed (see dl_page_index())
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct dl_page {
+  dl_list dl;
+  int     bg;
+  double  left, right, bottom, top;
+  rtree   index;
+
+  dl_page() : bg(0), left(0), right(0), bottom(0), top(0) {}
+};
+
+struct dl_recording {
+  std::vector<dl_page> pages;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Flatten all the geometry in a list into a set of sub-paths (as for
+// device_Path).  Circles and rects are converted to polygons.  Text, rasters
+// and clipping are ignored.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_to_subpaths(const dl_list &dl, std::vector<double> &xs, std::vector<double> &ys,
+                    std::vector<int> &nper);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Bounding box of an op in device coordinates, including half the line
+// width.  Text has no metrics here, so its box is estimated from the font
+// size and number of characters.  'ydown' is true if device y increases
+// down the page.
+//
+// @return false for ops with no extent (clipping)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool dl_op_bbox(const dl_list &dl, const dl_op &op, bool ydown, bbox &box);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Spatial index of the ops on a page (by op index).  Built on first use,
+// and rebuilt if ops have been added since
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+const rtree &dl_page_index(dl_page &page);
+
+#endif
@@ -0,0 +1,107 @@
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+shm_framebuffer::shm_framebuffer(const std::string &path, int width, int height) :
+  map(NULL), size(0) {
+
+#ifdef _WIN32
+  (void)path; (void)width; (void)height;
+  error = "shared memory framebuffers are not supported on Windows";
+#else
+  size_t stride = (size_t)width * 4;
+  size_t frame  = stride * height;
+  size = sizeof(framebuffer_header) + 2 * frame;
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    error = "could not open '" + path + "': " + strerror(errno);
+    return;
+  }
+  if (ftruncate(fd, (off_t)size) != 0) {
+    error = "could not resize '" + path + "': " + strerror(errno);
+    close(fd);
+    return;
+  }
+
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    error = "could not map '" + path + "': " + strerror(errno);
+    return;
+  }
+  map = (unsigned char *)p;
+
+  // The file is all zeros after ftruncate(): both buffers transparent
+  framebuffer_header *hdr = (framebuffer_header *)map;
+  memcpy(hdr->magic, "DVFB", 4);
+  hdr->version   = FRAMEBUFFER_VERSION;
+  hdr->width     = (uint32_t)width;
+  hdr->height    = (uint32_t)height;
+  hdr->stride    = (uint32_t)stride;
+  hdr->front     = 0;
+  hdr->frame     = 0;
+  hdr->offset[0] = sizeof(framebuffer_header);
+  hdr->offset[1] = sizeof(framebuffer_header) + frame;
+  hdr->page      = 0;
+  hdr->seq[0]    = 0;
+  hdr->seq[1]    = 0;
+#endif
+}
+
+
+shm_framebuffer::~shm_framebuffer() {
+#ifndef _WIN32
+  if (map != NULL) {
+    munmap(map, size);
+  }
+#endif
+}
+
+
+bool shm_framebuffer::publish(const rgba_image &img, int page) {
+  if (map == NULL) return false;
+
+  framebuffer_header *hdr = (framebuffer_header *)map;
+  uint32_t back = 1 - hdr->front;
+  unsigned char *pixels = map + hdr->offset[back];
+
+  // A viewer still reading the previous frame from this buffer sees an odd
+  // (or changed) 'seq' and knows to read again
+  volatile uint32_t *seq = &hdr->seq[back];
+  *seq = *seq + 1;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  int w = std::min((int)hdr->width , img.width);
+  int h = std::min((int)hdr->height, img.height);
+  for (int y = 0; y < h; y++) {
+    unsigned char *row = pixels + (size_t)y * hdr->stride;
+    memcpy(row, &img.pixels[(size_t)y * img.width], (size_t)w * 4);
+    memset(row + (size_t)w * 4, 0, hdr->stride - (size_t)w * 4);
+  }
+  if (h < (int)hdr->height) {
+    memset(pixels + (size_t)h * hdr->stride, 0, (size_t)(hdr->height - h) * hdr->stride);
+  }
+
+  // Pixels must be visible before 'seq' is even again, and before the viewer
+  // can see the new 'front'
+  std::atomic_thread_fence(std::memory_order_release);
+  *seq = *seq + 1;
+  std::atomic_thread_fence(std::memory_order_release);
+  hdr->front = back;
+  hdr->page  = page;
+  std::atomic_thread_fence(std::memory_order_release);
+  hdr->frame++;
+
+  return true;
+}
@@ -0,0 +1,69 @@
+#ifndef DEVOUT_FRAMEBUFFER_H
+#define DEVOUT_FRAMEBUFFER_H
+
+#include <stdint.h>
+#include <string>
+
+#include "rasterise.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Layout of the start of a framebuffer file.  All values are in the host's
+// byte order (the file is only for processes on the same machine).
+//
+// The file holds two frames of 'height' rows of 'stride' bytes at
+// 'offset[0]' and 'offset[1]'.  Each pixel is an R colour i.e. a u32 with
+// red in the low byte (so R, G, B, A bytes on little-endian hosts), not
+// premultiplied.  Rows run from the top of the page down.
+//
+// Each buffer has a sequence number 'seq[i]' which is odd while the buffer
+// is being drawn into (a seqlock).  Frames are published by making 'seq' of
+// the buffer which is not 'front' odd, drawing into it, making its 'seq'
+// even again, then setting 'front' to it and incrementing 'frame'.
+//
+// A viewer waits for 'frame' to change, then for buffer 'front':
+//   1. reads 'seq' (if it is odd, starts again)
+//   2. copies the pixels
+//   3. reads 'seq' again.  If it changed, the copy may be torn: start again
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define FRAMEBUFFER_VERSION 1
+
+struct framebuffer_header {
+  char     magic[4];    // "DVFB"
+  uint32_t version;     // FRAMEBUFFER_VERSION
+  uint32_t width;       // pixels
+  uint32_t height;      // pixels
+  uint32_t stride;      // bytes per row
+  uint32_t front;       // 0 or 1: buffer holding the latest frame
+  uint64_t frame;       // number of frames published (0 = none yet)
+  uint64_t offset[2];   // byte offset of each buffer from the start of the file
+  int32_t  page;        // page number of the latest frame
+  uint32_t seq[2];      // per buffer. Odd while the buffer is being drawn
+  uint32_t reserved;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Double-buffered RGBA framebuffer in a memory-mapped file (see
+// framebuffer()).  The size is fixed when it is created: images of another
+// size are cropped, or padded with transparent pixels.
+//
+// Not available on Windows ('error' is set on creation).
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class shm_framebuffer {
+public:
+  shm_framebuffer(const std::string &path, int width, int height);
+  ~shm_framebuffer();
+
+  // Copy 'img' into the back buffer and make it the front.  Returns false
+  // if there is no mapping
+  bool publish(const rgba_image &img, int page);
+
+  std::string error;
+
+private:
+  unsigned char *map;
+  size_t         size;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include <Rcpp.h>
+#include <cstring>
+
+#include "geometry-cache.h"
+#include "page-hash.h"
+
+
+int geometry_cache::lookup(int kind, int n, const double *x, const double *y,
+                           int npoly, const int *nper, bool *first) {
+  hash128 h;
+  h.word((uint64_t)kind);
+  h.word((uint64_t)n);
+  if (kind == GEOMETRY_PATH) {
+    h.word((uint64_t)npoly);
+    for (int i = 0; i < npoly; i++) {
+      h.word((uint64_t)nper[i]);
+    }
+  }
+
+  // Ids never leave the process, so the doubles can go in as they are
+  // rather than packed byte by byte as 'hash128::bytes()' does
+  uint64_t w;
+  for (int i = 0; i < n; i++) {
+    std::memcpy(&w, x + i, sizeof(w));
+    h.word(w);
+    std::memcpy(&w, y + i, sizeof(w));
+    h.word(w);
+  }
+
+  key k;
+  h.finish(k.a, k.b);
+
+  has_pending = false;
+
+  std::unordered_map<key, int, key_hash>::const_iterator it = ids.find(k);
+  if (it != ids.end()) {
+    *first = false;
+    return it->second;
+  }
+
+  *first = true;
+  if (ids.size() >= max_size) {
+    return NA_INTEGER;
+  }
+
+  pending     = k;
+  has_pending = true;
+  return (int)ids.size() + 1;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Keep the geometry from the last 'lookup()' (if it was new)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void geometry_cache::commit() {
+  if (!has_pending) return;
+
+  int id = (int)ids.size() + 1;
+  ids[pending] = id;
+  has_pending  = false;
+}
@@ -0,0 +1,59 @@
+#ifndef DEVOUT_GEOMETRY_CACHE_H
+#define DEVOUT_GEOMETRY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Per-device table of the vertex arrays passed to polyline/polygon/path.
+//
+// Maps and small multiples draw the same outlines on every page and panel.
+// Each geometry is keyed by a 128-bit hash of its kind and its vertices
+// (exactly, as sent by the graphics engine) and given a stable integer id
+// (1, 2, ...).  Only the hashes are kept, so the table is small whatever
+// the size of the geometries.
+//
+// The table holds at most 'max_size' geometries.  After that, new
+// geometries get id NA.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define GEOMETRY_POLYLINE 1
+#define GEOMETRY_POLYGON  2
+#define GEOMETRY_PATH     3
+
+class geometry_cache {
+public:
+  explicit geometry_cache(size_t max_size = 100000) :
+    max_size(max_size), has_pending(false) {}
+
+  // Id of the geometry, or NA_INTEGER if the table is full.  'first' is set
+  // if it hasn't been seen before.  'n' is the total number of vertices.
+  // 'npoly'/'nper' are only used for paths.
+  //
+  // A new geometry isn't added until 'commit()' is called, once it has
+  // been delivered.  If it never is (e.g. the callback failed), it is sent
+  // in full, with the same id, the next time it is drawn.
+  int lookup(int kind, int n, const double *x, const double *y,
+             int npoly, const int *nper, bool *first);
+  void commit();
+
+  void   clear() { ids.clear(); has_pending = false; }
+  size_t size() const { return ids.size(); }
+
+private:
+  struct key {
+    uint64_t a, b;
+    bool operator==(const key &other) const { return a == other.a && b == other.b; }
+  };
+  struct key_hash {
+    size_t operator()(const key &k) const { return (size_t)k.a; }
+  };
+
+  std::unordered_map<key, int, key_hash> ids;
+  size_t                                 max_size;
+  key                                    pending;
+  bool                                   has_pending;
+};
+
+#endif
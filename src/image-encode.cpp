@@ -0,0 +1,136 @@
+#include "image-encode.h"
+
+#include <zlib.h>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// CRC-32 (as used by PNG chunks) and Adler-32 (zlib stream checksum).
+// Start with crc = 0 and adler = 1
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+unsigned int crc32_update(unsigned int crc, const unsigned char *buf, size_t len) {
+  return (unsigned int)crc32(crc, buf, (uInt)len);
+}
+
+unsigned int adler32_update(unsigned int adler, const unsigned char *buf, size_t len) {
+  return (unsigned int)adler32(adler, buf, (uInt)len);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Big-endian helper
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void put_u32be(std::string &out, unsigned int v) {
+  out += (char)((v >> 24) & 255);
+  out += (char)((v >> 16) & 255);
+  out += (char)((v >>  8) & 255);
+  out += (char)( v        & 255);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Append a PNG chunk: length, type, data, CRC of type + data
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void png_chunk(std::string &out, const char *type, const std::string &data) {
+  put_u32be(out, (unsigned int)data.size());
+  size_t crc_start = out.size();
+  out.append(type, 4);
+  out += data;
+  put_u32be(out, crc32_update(0, (const unsigned char *)out.data() + crc_start,
+                              out.size() - crc_start));
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Filtered PNG scanlines (filter type 0 then R, G, B, A for each pixel) for
+// a sub-rectangle of an image
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string png_scanlines(const rgba_image &img, int x, int y, int w, int h) {
+  size_t stride = (size_t)w * 4 + 1;
+  std::string raw(stride * h, '\0');
+  for (int row = 0; row < h; row++) {
+    char *dst = &raw[row * stride + 1];
+    const unsigned int *src = &img.pixels[(size_t)(y + row) * img.width + x];
+    for (int col = 0; col < w; col++) {
+      unsigned int c = src[col];
+      *dst++ = (char)( c        & 255);
+      *dst++ = (char)((c >>  8) & 255);
+      *dst++ = (char)((c >> 16) & 255);
+      *dst++ = (char)((c >> 24) & 255);
+    }
+  }
+  return raw;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// zlib stream of stored (uncompressed) deflate blocks, max 65535 bytes each
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string zlib_stored(const std::string &raw) {
+  std::string out;
+  out.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+  out += (char)0x78;
+  out += (char)0x01;
+
+  size_t pos = 0;
+  do {
+    size_t len = raw.size() - pos;
+    if (len > 65535) len = 65535;
+    bool last = (pos + len == raw.size());
+    out += (char)(last ? 1 : 0);
+    out += (char)( len       & 255);
+    out += (char)((len >> 8) & 255);
+    out += (char)( ~len       & 255);
+    out += (char)((~len >> 8) & 255);
+    out.append(raw, pos, len);
+    pos += len;
+  } while (pos < raw.size());
+
+  put_u32be(out, adler32_update(1, (const unsigned char *)raw.data(), raw.size()));
+  return out;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// zlib stream of compressed data.  Falls back to stored blocks if zlib
+// fails (it can only run out of memory)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string zlib_deflate(const std::string &raw) {
+  uLongf len = compressBound((uLong)raw.size());
+  std::string out(len, '\0');
+  int status = compress2((Bytef *)&out[0], &len, (const Bytef *)raw.data(),
+                         (uLong)raw.size(), Z_DEFAULT_COMPRESSION);
+  if (status != Z_OK) {
+    return zlib_stored(raw);
+  }
+  out.resize(len);
+  return out;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// PNG IHDR chunk data for an 8-bit RGBA image
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string png_ihdr(int width, int height) {
+  std::string ihdr;
+  put_u32be(ihdr, (unsigned int)width);
+  put_u32be(ihdr, (unsigned int)height);
+  ihdr += (char)8;  // bit depth
+  ihdr += (char)6;  // colour type: RGBA
+  ihdr += (char)0;  // compression
+  ihdr += (char)0;  // filter
+  ihdr += (char)0;  // interlace
+  return ihdr;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Encode an image as an 8-bit RGBA PNG
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string png_encode(const rgba_image &img) {
+  std::string out(PNG_SIGNATURE, 8);
+  png_chunk(out, "IHDR", png_ihdr(img.width, img.height));
+  png_chunk(out, "IDAT", zlib_deflate(png_scanlines(img, 0, 0, img.width, img.height)));
+  png_chunk(out, "IEND", std::string());
+
+  return out;
+}
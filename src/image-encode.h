@@ -0,0 +1,39 @@
+#ifndef DEVOUT_IMAGE_ENCODE_H
+#define DEVOUT_IMAGE_ENCODE_H
+
+#include <string>
+
+#include "rasterise.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Encode an image as an 8-bit RGBA PNG.
+//
+// Rows are unfiltered (filter type 0) and compressed with zlib's default
+// level.  Plots are mostly runs of flat colour, which deflate handles well
+// without per-row filter selection.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string png_encode(const rgba_image &img);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Building blocks for PNG (and APNG) files
+//  - png_scanlines - filtered RGBA rows for a sub-rectangle of an image
+//  - zlib_deflate  - compress data as a zlib stream
+//  - zlib_stored   - wrap data in a zlib stream of stored deflate blocks
+//  - png_ihdr      - IHDR chunk data for an 8-bit RGBA image
+//  - png_chunk     - append a chunk (length, type, data, CRC) to 'out'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define PNG_SIGNATURE "\x89PNG\r\n\x1a\n"
+
+std::string  png_scanlines(const rgba_image &img, int x, int y, int w, int h);
+std::string  zlib_deflate(const std::string &raw);
+std::string  zlib_stored(const std::string &raw);
+std::string  png_ihdr(int width, int height);
+void         png_chunk(std::string &out, const char *type, const std::string &data);
+void         put_u32be(std::string &out, unsigned int v);
+
+unsigned int crc32_update(unsigned int crc, const unsigned char *buf, size_t len);
+unsigned int adler32_update(unsigned int adler, const unsigned char *buf, size_t len);
+
+#endif
@@ -0,0 +1,175 @@
+#include "lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+static bool visible(int col) {
+  return !R_TRANSPARENT(col);
+}
+
+
+static bool stroked(const pGEcontext gc) {
+  return visible(gc->col) && gc->lty != LTY_BLANK;
+}
+
+
+// Width of a stroke in device units along x
+static double stroke_width(const pGEcontext gc, pDevDesc dd) {
+  return stroked(gc) ? gc->lwd / 96.0 / dd->ipr[0] : 0;
+}
+
+
+static lod_result keep() {
+  lod_result res = {LOD_KEEP, 0, 0, 0, 0, 0, 0};
+  return res;
+}
+
+
+static lod_result drop() {
+  lod_result res = {LOD_DROP, 0, 0, 0, 0, 0, 0};
+  return res;
+}
+
+
+void lod_stage::pixel_size(pDevDesc dd, double *px, double *py) const {
+  *px = ppi > 0 ? 1.0 / (ppi * dd->ipr[0]) : 1.0;
+  *py = ppi > 0 ? 1.0 / (ppi * dd->ipr[1]) : 1.0;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The pixel under (x, y).  Dropped if the current run already set it to
+// the same opaque colour
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+lod_result lod_stage::pixel(double x, double y, int col, double px, double py) {
+  if (serial != last_pixel + 1) {
+    pixels.clear();
+  }
+  last_pixel = serial;
+
+  double ix = std::floor(x / px);
+  double iy = std::floor(y / py);
+
+  lod_result res = {LOD_PIXEL, ix * px, iy * py, (ix + 1) * px, (iy + 1) * py, col, 0};
+
+  if (std::fabs(ix) > 1e9 || std::fabs(iy) > 1e9) {
+    return res;
+  }
+
+  uint64_t key = ((uint64_t)(uint32_t)(int32_t)ix << 32) | (uint32_t)(int32_t)iy;
+  if (R_OPAQUE(col)) {
+    std::unordered_map<uint64_t, int>::iterator it = pixels.find(key);
+    if (it != pixels.end() && it->second == col) {
+      return drop();
+    }
+    pixels[key] = col;
+  } else {
+    // Translucent pixels build up, so what this one looks like is unknown
+    pixels.erase(key);
+  }
+
+  return res;
+}
+
+
+lod_result lod_stage::line_of(double x0, double y0, double x1, double y1, int col,
+                              double px, pDevDesc dd) const {
+  lod_result res = {LOD_LINE, x0, y0, x1, y1, col, px * dd->ipr[0] * 96.0};
+  return res;
+}
+
+
+lod_result lod_stage::circle(double x, double y, double r, const pGEcontext gc, pDevDesc dd) {
+#if R_GE_definitions > 12
+  if (!Rf_isNull(gc->patternFill)) return keep();
+#endif
+
+  double px, py;
+  pixel_size(dd, &px, &py);
+
+  double size = 2 * r + stroke_width(gc, dd);
+  if (size >= px || size >= py) return keep();
+
+  int col = stroked(gc) ? gc->col : gc->fill;
+  if (!visible(col)) return drop();
+
+  return pixel(x, y, col, px, py);
+}
+
+
+lod_result lod_stage::rect(double x0, double y0, double x1, double y1, const pGEcontext gc,
+                           pDevDesc dd) {
+#if R_GE_definitions > 12
+  if (!Rf_isNull(gc->patternFill)) return keep();
+#endif
+
+  double px, py;
+  pixel_size(dd, &px, &py);
+
+  double sw     = stroke_width(gc, dd);
+  bool   thin_x = std::fabs(x1 - x0) + sw < px;
+  bool   thin_y = std::fabs(y1 - y0) + sw < py;
+  if (!thin_x && !thin_y) return keep();
+
+  int col = stroked(gc) ? gc->col : gc->fill;
+  if (!visible(col)) return drop();
+
+  double cx = (x0 + x1) / 2, cy = (y0 + y1) / 2;
+  if (thin_x && thin_y) {
+    return pixel(cx, cy, col, px, py);
+  }
+  if (thin_x) {
+    return line_of(cx, std::min(y0, y1), cx, std::max(y0, y1), col, px, dd);
+  }
+  return line_of(std::min(x0, x1), cy, std::max(x0, x1), cy, col, px, dd);
+}
+
+
+lod_result lod_stage::line(double x1, double y1, double x2, double y2, const pGEcontext gc,
+                           pDevDesc dd) {
+  double px, py;
+  pixel_size(dd, &px, &py);
+
+  double size = std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1)) +
+    stroke_width(gc, dd);
+  if (size >= std::min(px, py)) return keep();
+
+  if (!stroked(gc)) return drop();
+
+  return pixel((x1 + x2) / 2, (y1 + y2) / 2, gc->col, px, py);
+}
+
+
+lod_result lod_stage::text(double x, double y, const char *str, double rot, double hadj,
+                           const pGEcontext gc, pDevDesc dd) {
+  double px, py;
+  pixel_size(dd, &px, &py);
+
+  double height = gc->cex * gc->ps / 72.0;   // inches
+  if (height / dd->ipr[1] >= LOD_TEXT_PIXELS * py) return keep();
+
+  int nchar = 0;
+  for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+    if ((*p & 0xc0) != 0x80) nchar++;
+  }
+  if (height / dd->ipr[1] < py || nchar == 0 || !visible(gc->col)) return drop();
+
+  // Along the text, and 'up' from its baseline, in device coordinates
+  double ysign = dd->bottom > dd->top ? -1 : 1;
+  double theta = rot * M_PI / 180;
+  double dx =  std::cos(theta), dy = ysign * std::sin(theta);
+  double ux = -std::sin(theta), uy = ysign * std::cos(theta);
+
+  // Roughly half an em per character, drawn through the lowercase letters
+  double w    = 0.5 * height * nchar / dd->ipr[0];
+  double lift = 0.25 * height / dd->ipr[1];
+
+  double x0 = x - hadj * w * dx + lift * ux;
+  double y0 = y - hadj * w * dy + lift * uy;
+  return line_of(x0, y0, x0 + w * dx, y0 + w * dy, gc->col, px, dd);
+}
@@ -0,0 +1,79 @@
+#ifndef DEVOUT_LOD_H
+#define DEVOUT_LOD_H
+
+#include <Rcpp.h>
+#include <R_ext/GraphicsEngine.h>
+#include <cstdint>
+#include <unordered_map>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// What the level-of-detail stage does with a primitive
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define LOD_KEEP  0  // draw as is
+#define LOD_DROP  1  // not drawn
+#define LOD_PIXEL 2  // a rect (x0, y0) - (x1, y1) filled with 'col', no border
+#define LOD_LINE  3  // a line (x0, y0) - (x1, y1) of colour 'col', 'lwd' wide
+
+struct lod_result {
+  int    action;
+  double x0, y0, x1, y1;
+  int    col;
+  double lwd;   // in R's lwd units (1/96 inch)
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Level-of-detail substitution for primitives too small to see.
+//
+// Pixels are 1 / (ppi * dd->ipr) device units on each axis i.e. with
+// 'ppi' = 0, one pixel per raster of the device.  'dd->ipr' is read on
+// every call, so it may be changed by the callback at any time.
+//
+//   - circles which fit (with their border) in a pixel, rects which are
+//     under a pixel in both directions and lines shorter than a pixel
+//     become one pixel, snapped to the pixel grid, in the border colour
+//     (or fill, if there is no border)
+//   - rects under a pixel in one direction become a one pixel line
+//   - text under a pixel high is dropped.  Text under 'LOD_TEXT_PIXELS'
+//     high becomes a line of about its width ('greeked')
+//
+// Primitives filled with a pattern are always kept.  A run of opaque
+// pixels is drawn only once per pixel and colour, so the thousands of
+// points of a dense scatter plot which land on the same few pixels are
+// sent once each.  The run is broken by anything else being drawn (see
+// 'touch()').
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define LOD_TEXT_PIXELS 4
+
+class lod_stage {
+public:
+  explicit lod_stage(double ppi) : ppi(ppi), serial(0), last_pixel(0) {}
+
+  lod_result circle(double x, double y, double r, const pGEcontext gc, pDevDesc dd);
+  lod_result rect  (double x0, double y0, double x1, double y1, const pGEcontext gc,
+                    pDevDesc dd);
+  lod_result line  (double x1, double y1, double x2, double y2, const pGEcontext gc,
+                    pDevDesc dd);
+  lod_result text  (double x, double y, const char *str, double rot, double hadj,
+                    const pGEcontext gc, pDevDesc dd);
+
+  // Called for every device call which draws (or changes what later
+  // drawing looks like), before any of the above
+  void touch() { serial++; }
+
+private:
+  void       pixel_size(pDevDesc dd, double *px, double *py) const;
+  lod_result pixel(double x, double y, int col, double px, double py);
+  lod_result line_of(double x0, double y0, double x1, double y1, int col, double px,
+                     pDevDesc dd) const;
+
+  double   ppi;
+  uint64_t serial;
+  uint64_t last_pixel;
+
+  // Colour last drawn on each pixel in the current run
+  std::unordered_map<uint64_t, int> pixels;
+};
+
+#endif
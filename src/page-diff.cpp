@@ -0,0 +1,188 @@
+#include "page-diff.h"
+#include "page-hash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Largest difference in coordinates and lengths between two ops with the
+// same number of coordinates
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static double op_delta(const dl_list &la, const dl_op &a, const dl_list &lb, const dl_op &b) {
+  if (a.n != b.n) return NAN;
+
+  double delta = 0;
+  for (int i = 0; i < a.n; i++) {
+    delta = std::max(delta, std::fabs(la.xs[a.start + i] - lb.xs[b.start + i]));
+    delta = std::max(delta, std::fabs(la.ys[a.start + i] - lb.ys[b.start + i]));
+  }
+  if (a.type == DL_CIRCLE || a.type == DL_RASTER) {
+    delta = std::max(delta, std::fabs(a.a - b.a));
+  }
+  if (a.type == DL_RASTER) {
+    delta = std::max(delta, std::fabs(a.b - b.b));
+  }
+
+  return delta;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// How far apart two ops are: 'op_delta()' if they have the same number of
+// coordinates, otherwise the distance between their first coordinates
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static double op_distance(const dl_list &la, const dl_op &a, const dl_list &lb, const dl_op &b) {
+  if (a.n == b.n) return op_delta(la, a, lb, b);
+  if (a.n == 0 || b.n == 0) return INFINITY;
+
+  return std::max(std::fabs(la.xs[a.start] - lb.xs[b.start]),
+                  std::fabs(la.ys[a.start] - lb.ys[b.start]));
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Pair up unmatched ops of 'a' and 'b' which have the same key.  Each op of
+// 'a', in drawing order, takes the nearest (by 'dist(i, j)') unmatched op
+// of 'b' with the same key.  Calls 'paired(i, j)' for each pair.
+//
+// So this stays close to linear when many ops share a key (e.g. the points
+// of a scatter plot), an op only looks at the 'match_window' candidates
+// either side of its own rank among the ops of 'a' with that key.  It only
+// looks further if none of those are left
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static const int match_window = 256;
+
+template <typename D, typename P>
+static void match_by_key(const std::vector<uint64_t> &akeys, const std::vector<uint64_t> &bkeys,
+                         std::vector<int> &amatch, std::vector<int> &bmatch, D dist, P paired) {
+  std::unordered_map<uint64_t, std::vector<int> > by_key;
+  for (size_t j = 0; j < bkeys.size(); j++) {
+    if (bmatch[j] < 0) by_key[bkeys[j]].push_back((int)j);
+  }
+
+  std::unordered_map<uint64_t, int> rank;
+  for (size_t i = 0; i < akeys.size(); i++) {
+    if (amatch[i] >= 0) continue;
+    std::unordered_map<uint64_t, std::vector<int> >::iterator it = by_key.find(akeys[i]);
+    if (it == by_key.end()) continue;
+
+    const std::vector<int> &cand = it->second;
+    int n  = (int)cand.size();
+    int r  = std::min(rank[akeys[i]]++, n - 1);
+    int lo = std::max(0, r - match_window);
+    int hi = std::min(n, r + match_window + 1);
+
+    int    best   = -1;
+    double best_d = 0;
+    for (int pass = 0; pass < 2 && best < 0; pass++) {
+      if (pass == 1) {
+        lo = 0;
+        hi = n;
+      }
+      for (int k = lo; k < hi; k++) {
+        int j = cand[k];
+        if (bmatch[j] >= 0) continue;
+        double d = dist((int)i, j);
+        if (best < 0 || d < best_d) {
+          best   = j;
+          best_d = d;
+        }
+      }
+    }
+    if (best < 0) continue;
+
+    amatch[i]    = best;
+    bmatch[best] = (int)i;
+    paired((int)i, best);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Diff two pages
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_page_diff(const dl_page &pa, const dl_page &pb, double tolerance,
+                  std::vector<page_change> &changes) {
+  const dl_list &la = pa.dl, &lb = pb.dl;
+  size_t na = la.ops.size(), nb = lb.ops.size();
+  double quantum = std::max(tolerance, 1e-9);
+
+  // -1 = unmatched. Clipping is not compared, so counts as matched
+  std::vector<int> amatch(na, -1), bmatch(nb, -1);
+  for (size_t i = 0; i < na; i++) if (la.ops[i].type == DL_CLIP) amatch[i] = (int)i;
+  for (size_t j = 0; j < nb; j++) if (lb.ops[j].type == DL_CLIP) bmatch[j] = (int)j;
+
+  std::vector<page_change> found;
+  std::vector<uint64_t> akeys(na), bkeys(nb);
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // 1. identical
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  for (size_t i = 0; i < na; i++) akeys[i] = dl_op_hash(la, la.ops[i], quantum);
+  for (size_t j = 0; j < nb; j++) bkeys[j] = dl_op_hash(lb, lb.ops[j], quantum);
+  match_by_key(akeys, bkeys, amatch, bmatch, [](int, int) { return 0.0; }, [](int, int) {});
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // 2. same place, different gc or content
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  for (size_t i = 0; i < na; i++) if (amatch[i] < 0) akeys[i] = dl_op_position_hash(la, la.ops[i], quantum);
+  for (size_t j = 0; j < nb; j++) if (bmatch[j] < 0) bkeys[j] = dl_op_position_hash(lb, lb.ops[j], quantum);
+  match_by_key(akeys, bkeys, amatch, bmatch, [](int, int) { return 0.0; }, [&](int i, int j) {
+    const dl_op &a = la.ops[i], &b = lb.ops[j];
+    page_change ch = {PAGE_CHANGED, a.type, i, j, op_delta(la, a, lb, b),
+                      !(la.gcs[a.gc] == lb.gcs[b.gc])};
+    found.push_back(ch);
+  });
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // 3. moved
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  for (size_t i = 0; i < na; i++) if (amatch[i] < 0) akeys[i] = dl_op_shape_hash(la, la.ops[i]);
+  for (size_t j = 0; j < nb; j++) if (bmatch[j] < 0) bkeys[j] = dl_op_shape_hash(lb, lb.ops[j]);
+  auto distance = [&](int i, int j) { return op_distance(la, la.ops[i], lb, lb.ops[j]); };
+  match_by_key(akeys, bkeys, amatch, bmatch, distance, [&](int i, int j) {
+    double delta = op_delta(la, la.ops[i], lb, lb.ops[j]);
+    if (delta > tolerance) {
+      page_change ch = {PAGE_CHANGED, la.ops[i].type, i, j, delta, false};
+      found.push_back(ch);
+    }
+  });
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // 4. same type
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  for (size_t i = 0; i < na; i++) akeys[i] = (uint64_t)la.ops[i].type;
+  for (size_t j = 0; j < nb; j++) bkeys[j] = (uint64_t)lb.ops[j].type;
+  match_by_key(akeys, bkeys, amatch, bmatch, distance, [&](int i, int j) {
+    const dl_op &a = la.ops[i], &b = lb.ops[j];
+    page_change ch = {PAGE_CHANGED, a.type, i, j, op_delta(la, a, lb, b),
+                      !(la.gcs[a.gc] == lb.gcs[b.gc])};
+    found.push_back(ch);
+  });
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Left over
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  for (size_t i = 0; i < na; i++) {
+    if (amatch[i] < 0) {
+      page_change ch = {PAGE_REMOVED, la.ops[i].type, (int)i, -1, NAN, false};
+      found.push_back(ch);
+    }
+  }
+  for (size_t j = 0; j < nb; j++) {
+    if (bmatch[j] < 0) {
+      page_change ch = {PAGE_INSERTED, lb.ops[j].type, -1, (int)j, NAN, false};
+      found.push_back(ch);
+    }
+  }
+
+  std::stable_sort(found.begin(), found.end(), [](const page_change &x, const page_change &y) {
+    bool xa = x.a >= 0, ya = y.a >= 0;
+    if (xa != ya) return xa;
+    return xa ? x.a < y.a : x.b < y.b;
+  });
+
+  changes.insert(changes.end(), found.begin(), found.end());
+}
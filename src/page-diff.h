@@ -0,0 +1,54 @@
+#ifndef DEVOUT_PAGE_DIFF_H
+#define DEVOUT_PAGE_DIFF_H
+
+#include <vector>
+
+#include "display-list.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// One difference between two pages
+//   - a, b  : 0-based op index in each page (-1 if the op is only in the
+//             other page)
+//   - delta : largest coordinate (or length) difference. NAN if the ops
+//             have a different number of coordinates
+//   - gc    : graphics contexts differ
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+enum page_change_type {
+  PAGE_REMOVED  = 0,
+  PAGE_INSERTED = 1,
+  PAGE_CHANGED  = 2
+};
+
+struct page_change {
+  page_change_type change;
+  dl_op_type       type;
+  int              a, b;
+  double           delta;
+  bool             gc;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Structural diff of two pages.
+//
+// Ops are matched in four passes, each using hash tables so the whole
+// diff is close to linear in the number of ops:
+//   1. identical ops: same per-op hash (see 'dl_op_hash()') with
+//      coordinates rounded to 'tolerance'
+//   2. same type and coordinates, but a different gc or content (e.g. a
+//      point which was recoloured)
+//   3. same type, parameters, content and gc, but coordinates moved.
+//      Only reported if a coordinate moved by more than 'tolerance'
+//   4. same type only (e.g. moved and recoloured)
+// Within a pass, each op of 'a' (in drawing order) is paired with the
+// nearest candidate in 'b'.
+// Whatever is left over was removed from 'a' or inserted in 'b'.
+//
+// Changes are returned in drawing order (of 'a', then 'b' for insertions).
+// Clipping ops are ignored.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_page_diff(const dl_page &a, const dl_page &b, double tolerance,
+                  std::vector<page_change> &changes);
+
+#endif
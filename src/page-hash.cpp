@@ -0,0 +1,265 @@
+#include "page-hash.h"
+
+#include <cmath>
+#include <cstdio>
+
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+static const uint64_t C1 = 0x87c37b91114253d5ULL;
+static const uint64_t C2 = 0x4cf5ad432745937fULL;
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// hash128.  The mixing steps are those of MurmurHash3 (x64, 128-bit) with
+// one word going into each lane
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void hash128::reset() {
+  h1    = 0x9368e53c2f6af274ULL;
+  h2    = 0x586dcd208f7cd3fdULL;
+  count = 0;
+}
+
+void hash128::word(uint64_t w) {
+  uint64_t k1 = w * C1;
+  k1  = rotl64(k1, 31);
+  k1 *= C2;
+  h1 ^= k1;
+  h1  = rotl64(h1, 27);
+  h1 += h2;
+  h1  = h1 * 5 + 0x52dce729;
+
+  uint64_t k2 = w * C2;
+  k2  = rotl64(k2, 33);
+  k2 *= C1;
+  h2 ^= k2;
+  h2  = rotl64(h2, 31);
+  h2 += h1;
+  h2  = h2 * 5 + 0x38495ab5;
+
+  count++;
+}
+
+void hash128::bytes(const char *data, size_t n) {
+  word((uint64_t)n);
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < n; i += 8) {
+    uint64_t w = 0;
+    for (size_t j = 0; j < 8 && i + j < n; j++) {
+      w |= (uint64_t)p[i + j] << (8 * j);
+    }
+    word(w);
+  }
+}
+
+void hash128::finish(uint64_t &a, uint64_t &b) const {
+  uint64_t x = h1 ^ count, y = h2 ^ count;
+  x += y;
+  y += x;
+  x  = fmix64(x);
+  y  = fmix64(y);
+  x += y;
+  y += x;
+  a  = x;
+  b  = y;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Round a value to a multiple of 'quantum' so that tiny floating point
+// differences don't change the hash
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static uint64_t quantise(double x, double quantum) {
+  if (std::isnan(x)) return 0x7ff8000000000000ULL;
+  if (std::isinf(x)) return x > 0 ? 0x7ff0000000000000ULL : 0xfff0000000000000ULL;
+
+  double q = x / quantum;
+  if (q >  9e18) q =  9e18;
+  if (q < -9e18) q = -9e18;
+  return (uint64_t)(int64_t)std::llround(q);
+}
+
+// Parameters other than coordinates (line width, rotation etc)
+static const double param_quantum = 1e-6;
+
+
+static void hash_gc(hash128 &h, const dl_gc &gc) {
+  h.word((uint32_t)gc.col);
+  h.word((uint32_t)gc.fill);
+  h.word(quantise(gc.gamma     , param_quantum));
+  h.word(quantise(gc.lwd       , param_quantum));
+  h.word((uint32_t)gc.lty);
+  h.word((uint64_t)gc.lend);
+  h.word((uint64_t)gc.ljoin);
+  h.word(quantise(gc.lmitre    , param_quantum));
+  h.word(quantise(gc.cex       , param_quantum));
+  h.word(quantise(gc.ps        , param_quantum));
+  h.word(quantise(gc.lineheight, param_quantum));
+  h.word((uint64_t)gc.fontface);
+  h.bytes(gc.fontfamily.data(), gc.fontfamily.size());
+
+  // Definitions by what they draw, not by handle: the same pattern has a
+  // different handle on each page, and a released handle can be reused
+  if (gc.pattern_hash != 0) {
+    h.word(gc.pattern_hash);
+  } else {
+    h.word((uint32_t)gc.pattern);
+  }
+  h.word(gc.clip_hash);
+  h.word(gc.mask_hash);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Hash of a single op.  If 'quantum' is 0, coordinates and lengths are
+// left out
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void hash_op(hash128 &h, const dl_list &dl, const dl_op &op, double quantum) {
+  h.word((uint64_t)op.type);
+  h.word((uint64_t)op.n);
+  if (quantum > 0) {
+    for (int i = 0; i < op.n; i++) {
+      h.word(quantise(dl.xs[op.start + i], quantum));
+      h.word(quantise(dl.ys[op.start + i], quantum));
+    }
+  }
+
+  // Circle radius and raster size are lengths in device units, the rest
+  // are angles/adjustments/sizes
+  bool a_is_length = op.type == DL_CIRCLE || op.type == DL_RASTER;
+  bool b_is_length = op.type == DL_RASTER;
+  if (!a_is_length) h.word(quantise(op.a, param_quantum));
+  else if (quantum > 0) h.word(quantise(op.a, quantum));
+  if (!b_is_length) h.word(quantise(op.b, param_quantum));
+  else if (quantum > 0) h.word(quantise(op.b, quantum));
+  h.word(quantise(op.c, param_quantum));
+  h.word((uint64_t)op.flag);
+
+  h.word((uint64_t)op.ni);
+  for (int i = 0; i < op.ni; i++) {
+    h.word((uint32_t)dl.ints[op.istart + i]);
+  }
+
+  if (op.str >= 0) {
+    if (op.type == DL_RASTER) {
+      const std::vector<unsigned int> &r = dl.rasters[op.str];
+      h.word((uint64_t)r.size());
+      for (size_t i = 0; i < r.size(); i += 2) {
+        uint64_t w = r[i];
+        if (i + 1 < r.size()) w |= (uint64_t)r[i + 1] << 32;
+        h.word(w);
+      }
+    } else {
+      h.bytes(dl.strings[op.str].data(), dl.strings[op.str].size());
+    }
+  }
+
+  hash_gc(h, dl.gcs[op.gc]);
+}
+
+
+uint64_t dl_op_hash(const dl_list &dl, const dl_op &op, double quantum, uint64_t *b) {
+  hash128 h;
+  hash_op(h, dl, op, quantum);
+
+  uint64_t a, bb;
+  h.finish(a, bb);
+  if (b != 0) *b = bb;
+  return a;
+}
+
+
+uint64_t dl_op_shape_hash(const dl_list &dl, const dl_op &op) {
+  hash128 h;
+  hash_op(h, dl, op, 0);
+
+  uint64_t a, b;
+  h.finish(a, b);
+  return a;
+}
+
+
+uint64_t dl_op_position_hash(const dl_list &dl, const dl_op &op, double quantum) {
+  hash128 h;
+  h.word((uint64_t)op.type);
+  h.word((uint64_t)op.n);
+  for (int i = 0; i < op.n; i++) {
+    h.word(quantise(dl.xs[op.start + i], quantum));
+    h.word(quantise(dl.ys[op.start + i], quantum));
+  }
+  if (op.type == DL_CIRCLE || op.type == DL_RASTER) h.word(quantise(op.a, quantum));
+  if (op.type == DL_RASTER)                         h.word(quantise(op.b, quantum));
+
+  uint64_t a, b;
+  h.finish(a, b);
+  return a;
+}
+
+
+uint64_t dl_content_hash(const dl_list *dl, size_t from, const std::vector<double> &params,
+                         double quantum) {
+  hash128 h;
+  h.word((uint64_t)params.size());
+  for (size_t i = 0; i < params.size(); i++) {
+    h.word(quantise(params[i], param_quantum));
+  }
+  if (dl != NULL) {
+    for (size_t i = from; i < dl->ops.size(); i++) {
+      hash_op(h, *dl, dl->ops[i], quantum);
+    }
+  }
+
+  uint64_t a, b;
+  h.finish(a, b);
+  return a == 0 ? 1 : a;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Page hash
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void page_hash::begin(const dl_page &page) {
+  state.reset();
+  state.word((uint32_t)page.bg);
+  state.word(quantise(page.left  , quantum));
+  state.word(quantise(page.right , quantum));
+  state.word(quantise(page.bottom, quantum));
+  state.word(quantise(page.top   , quantum));
+}
+
+void page_hash::add(const dl_list &dl, const dl_op &op) {
+  uint64_t b;
+  uint64_t a = dl_op_hash(dl, op, quantum, &b);
+  state.word(a);
+  state.word(b);
+}
+
+std::string page_hash::digest() const {
+  uint64_t a, b;
+  state.finish(a, b);
+
+  char buf[33];
+  snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long)a, (unsigned long long)b);
+  return buf;
+}
+
+
+std::string dl_page_hash(const dl_page &page, double quantum) {
+  page_hash h(quantum);
+  h.begin(page);
+  for (size_t i = 0; i < page.dl.ops.size(); i++) {
+    h.add(page.dl, page.dl.ops[i]);
+  }
+  return h.digest();
+}
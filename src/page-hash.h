@@ -0,0 +1,81 @@
+#ifndef DEVOUT_PAGE_HASH_H
+#define DEVOUT_PAGE_HASH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "display-list.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Streaming 128-bit hash.
+//
+// Input is fed as 64-bit words (strings are packed into words
+// little-endian, whatever the platform) so the result is the same on every
+// machine.  Not cryptographic.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct hash128 {
+  uint64_t h1, h2;
+  uint64_t count;
+
+  hash128() { reset(); }
+
+  void reset();
+  void word(uint64_t w);
+  void bytes(const char *data, size_t n);
+  void finish(uint64_t &a, uint64_t &b) const;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Hash of a single op: its type, coordinates (rounded to multiples of
+// 'quantum' device units), other parameters, text or raster content and
+// graphics context.  'b' may be NULL if only 64 bits are needed
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+uint64_t dl_op_hash(const dl_list &dl, const dl_op &op, double quantum, uint64_t *b = 0);
+
+// As above, but leaving out the coordinates and lengths (circle radius,
+// raster size) i.e. two ops with the same shape hash differ only in where
+// they are drawn
+uint64_t dl_op_shape_hash(const dl_list &dl, const dl_op &op);
+
+// Only the type, coordinates and lengths i.e. two ops with the same
+// position hash are drawn in the same place, but may differ in gc or
+// content
+uint64_t dl_op_position_hash(const dl_list &dl, const dl_op &op, double quantum);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Hash of what a definition (pattern, clipping path or mask) draws: the ops
+// in 'dl' from 'from' on, plus any 'params' which aren't drawn (gradient
+// stops, tile size etc).  'dl' may be NULL.  Never 0, so that 0 can mean
+// "no definition" in 'dl_gc'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+uint64_t dl_content_hash(const dl_list *dl, size_t from, const std::vector<double> &params,
+                         double quantum = 0.01);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Hash of a whole page, built up one op at a time as it is drawn.
+//
+// The page hash covers the background, the device extents and the hash of
+// each op in order, so 'begin()' + 'add()' for every op gives the same
+// result as 'dl_page_hash()' on the finished page.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class page_hash {
+public:
+  explicit page_hash(double quantum = 0.01) : quantum(quantum) {}
+
+  void        begin(const dl_page &page);
+  void        add(const dl_list &dl, const dl_op &op);
+  std::string digest() const;   // 32 hex characters
+
+private:
+  double  quantum;
+  hash128 state;
+};
+
+std::string dl_page_hash(const dl_page &page, double quantum = 0.01);
+
+#endif
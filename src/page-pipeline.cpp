@@ -0,0 +1,170 @@
+#include "page-pipeline.h"
+
+#include <exception>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Start the workers
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+page_pipeline::page_pipeline(int threads, int queue_depth, encode_fn encode, emit_fn emit)
+  : encode(encode), emit(emit), queue_depth(queue_depth < 1 ? 1 : queue_depth),
+    next_seq(0), next_emit(0), in_flight(0), stopping(false) {
+  for (int i = 0; i < threads; i++) {
+    workers.push_back(std::thread(&page_pipeline::worker, this));
+  }
+}
+
+
+page_pipeline::~page_pipeline() {
+  finish();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Queue a page, waiting for space if the pipeline is full
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void page_pipeline::submit(int page_number, dl_page &page) {
+  job j;
+  j.page_number = page_number;
+  std::swap(j.page, page);
+
+  if (workers.empty()) {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      j.seq = next_seq++;
+      in_flight++;
+    }
+    process(j);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lk(mtx);
+  cv_space.wait(lk, [this] { return in_flight < queue_depth; });
+  j.seq = next_seq++;
+  in_flight++;
+  queue.push_back(job());
+  std::swap(queue.back(), j);
+  lk.unlock();
+  cv_work.notify_one();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Wait for everything to be written, then stop the workers
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void page_pipeline::finish() {
+  {
+    std::unique_lock<std::mutex> lk(mtx);
+    if (!workers.empty()) {
+      cv_space.wait(lk, [this] { return in_flight == 0; });
+    }
+    stopping = true;
+  }
+  cv_work.notify_all();
+
+  for (size_t i = 0; i < workers.size(); i++) {
+    if (workers[i].joinable()) workers[i].join();
+  }
+  workers.clear();
+}
+
+
+std::string page_pipeline::take_errors() {
+  std::lock_guard<std::mutex> lk(mtx);
+  std::string res;
+  res.swap(errors);
+  return res;
+}
+
+
+void page_pipeline::add_error(const std::string &msg) {
+  std::lock_guard<std::mutex> lk(mtx);
+  if (!errors.empty()) errors += "; ";
+  errors += msg;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Worker thread: take pages off the queue until told to stop
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void page_pipeline::worker() {
+  for (;;) {
+    job j;
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      cv_work.wait(lk, [this] { return stopping || !queue.empty(); });
+      if (queue.empty()) return;
+      std::swap(j, queue.front());
+      queue.pop_front();
+    }
+    process(j);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Encode one page, then emit whatever is next in order
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void page_pipeline::process(job &j) {
+  result res;
+  res.page_number = j.page_number;
+  res.ok          = true;
+
+  try {
+    res.bytes = encode(j.page);
+  } catch (std::exception &ex) {
+    res.ok = false;
+    add_error("page " + std::to_string(j.page_number) + ": " + ex.what());
+  }
+
+  // The display list isn't needed any more
+  j.page = dl_page();
+
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    std::swap(done[j.seq], res);
+  }
+
+  emit_ready();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Emit encoded pages in submission order.  A page is inserted into 'done'
+// before its thread gets here, so whichever thread holds 'emit_mtx' will
+// find it.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void page_pipeline::emit_ready() {
+  std::lock_guard<std::mutex> elk(emit_mtx);
+
+  for (;;) {
+    result res;
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      std::map<long, result>::iterator it = done.find(next_emit);
+      if (it == done.end()) break;
+      std::swap(res, it->second);
+      done.erase(it);
+    }
+
+    if (res.ok) {
+      std::string err;
+      bool ok = false;
+      try {
+        ok = emit(res.page_number, res.bytes, err);
+      } catch (std::exception &ex) {
+        err = ex.what();
+      }
+      if (!ok) {
+        add_error("page " + std::to_string(res.page_number) + ": " + err);
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      next_emit++;
+      in_flight--;
+    }
+    cv_space.notify_all();
+  }
+}
@@ -0,0 +1,86 @@
+#ifndef DEVOUT_PAGE_PIPELINE_H
+#define DEVOUT_PAGE_PIPELINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "display-list.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Render finished pages on a pool of worker threads while R carries on
+// drawing the next page.
+//
+// Each submitted page goes through two stages:
+//   - 'encode' (e.g. rasterise + PNG encode) runs on any worker, many
+//     pages at once
+//   - 'emit' (e.g. write to a page_sink) runs for one page at a time, in
+//     the order the pages were submitted
+//
+// 'submit()' blocks while 'queue_depth' pages are already in the pipeline,
+// so a fast plotting loop can't run ahead and pile up unbounded memory.
+// With 0 threads, pages are encoded and emitted on the calling thread.
+//
+// Neither stage may call the R API.  Errors are collected and can be
+// picked up on the main thread with 'take_errors()'.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class page_pipeline {
+public:
+  typedef std::function<std::string(const dl_page &)>            encode_fn;
+  typedef std::function<bool(int, const std::string &, std::string &)> emit_fn;
+
+  page_pipeline(int threads, int queue_depth, encode_fn encode, emit_fn emit);
+  ~page_pipeline();
+
+  // Hand over a finished page. 'page' is swapped out and left empty
+  void submit(int page_number, dl_page &page);
+
+  // Wait for all submitted pages to be emitted and stop the workers
+  void finish();
+
+  // Return (and clear) any errors so far. Empty string if none
+  std::string take_errors();
+
+private:
+  struct job {
+    long    seq;
+    int     page_number;
+    dl_page page;
+  };
+
+  struct result {
+    int         page_number;
+    std::string bytes;
+    bool        ok;
+  };
+
+  void worker();
+  void process(job &j);
+  void emit_ready();
+  void add_error(const std::string &msg);
+
+  encode_fn encode;
+  emit_fn   emit;
+  int       queue_depth;
+
+  std::vector<std::thread> workers;
+  std::mutex               mtx;       // guards everything below
+  std::mutex               emit_mtx;  // only one thread emits at a time
+  std::condition_variable  cv_work;
+  std::condition_variable  cv_space;
+  std::deque<job>          queue;
+  std::map<long, result>   done;
+  long                     next_seq;
+  long                     next_emit;
+  int                      in_flight;
+  bool                     stopping;
+  std::string              errors;
+};
+
+#endif
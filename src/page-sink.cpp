@@ -0,0 +1,113 @@
+#include "page-sink.h"
+
+#include <cerrno>
+#include <cstring>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Expand the page number into a filename pattern
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string page_filename(const std::string &pattern, int page) {
+  std::string out;
+  size_t i = 0;
+
+  while (i < pattern.size()) {
+    if (pattern[i] != '%') {
+      out += pattern[i++];
+      continue;
+    }
+
+    if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+      out += '%';
+      i += 2;
+      continue;
+    }
+
+    // '%' [0] [width] 'd'
+    size_t j = i + 1;
+    bool zero = (j < pattern.size() && pattern[j] == '0');
+    if (zero) j++;
+    int width = 0;
+    while (j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9' && width < 100) {
+      width = width * 10 + (pattern[j] - '0');
+      j++;
+    }
+
+    if (j < pattern.size() && pattern[j] == 'd') {
+      char buf[128];
+      snprintf(buf, sizeof(buf), zero ? "%0*d" : "%*d", width, page);
+      out += buf;
+      i = j + 1;
+    } else {
+      out += pattern[i++];
+    }
+  }
+
+  return out;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// One file per page
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool file_page_sink::write_page(int page, const char *data, size_t len) {
+  std::string filename = page_filename(pattern, page);
+
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (fp == NULL) {
+    error = "could not open '" + filename + "': " + strerror(errno);
+    return false;
+  }
+
+  bool ok = (len == 0) || (fwrite(data, 1, len, fp) == len);
+  if (fclose(fp) != 0) ok = false;
+
+  if (!ok) {
+    error = "could not write '" + filename + "'";
+  }
+  return ok;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// All pages appended to one file
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool stream_page_sink::write_page(int page, const char *data, size_t len) {
+  if (fp == NULL) {
+    fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+      error = "could not open '" + path + "': " + strerror(errno);
+      return false;
+    }
+  }
+
+  bool ok = (len == 0) || (fwrite(data, 1, len, fp) == len);
+  if (fflush(fp) != 0) ok = false;
+
+  if (!ok) {
+    error = "could not write page " + std::to_string(page) + " to '" + path + "'";
+  }
+  return ok;
+}
+
+
+void stream_page_sink::close() {
+  if (fp != NULL) {
+    fclose(fp);
+    fp = NULL;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Create a sink by name
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+page_sink *page_sink_create(const std::string &type, const std::string &path) {
+  if (type == "file") {
+    return new file_page_sink(path);
+  }
+  if (type == "append") {
+    return new stream_page_sink(path);
+  }
+  return NULL;
+}
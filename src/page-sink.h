@@ -0,0 +1,76 @@
+#ifndef DEVOUT_PAGE_SINK_H
+#define DEVOUT_PAGE_SINK_H
+
+#include <cstdio>
+#include <string>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Destination for the finished content of each page when a device is
+// streaming (see page_stream()).
+//
+// A sink only ever sees the bytes of one page at a time.  Nothing is kept
+// once 'write_page()' returns, so memory use is independent of the number
+// of pages.  Sinks are plain C++ (no R API) and report problems via
+// their return value and 'error'.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class page_sink {
+public:
+  virtual ~page_sink() {}
+
+  // Write the content of 'page' (1-based). Return false on failure
+  virtual bool write_page(int page, const char *data, size_t len) = 0;
+
+  // Called once after the last page has been written
+  virtual void close() {}
+
+  std::string error;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Write each page to its own file.  'pattern' contains a single integer
+// conversion (e.g. "plot-%03d.txt") which is replaced by the page number
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class file_page_sink : public page_sink {
+public:
+  explicit file_page_sink(const std::string &pattern) : pattern(pattern) {}
+  bool write_page(int page, const char *data, size_t len);
+
+private:
+  std::string pattern;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Append every page to a single file, which is opened (and truncated) when
+// the first page is written and flushed after every page
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class stream_page_sink : public page_sink {
+public:
+  explicit stream_page_sink(const std::string &path) : path(path), fp(NULL) {}
+  ~stream_page_sink() { close(); }
+  bool write_page(int page, const char *data, size_t len);
+  void close();
+
+private:
+  std::string  path;
+  FILE        *fp;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Expand the page number into a filename pattern.  Only "%d" with an
+// optional zero flag and width (e.g. "%03d") and "%%" are recognised. Any
+// other '%' is copied as is.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string page_filename(const std::string &pattern, int page);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Create a sink by name: "file" (one file per page) or "append".
+// Returns NULL for an unknown type.  Caller owns the result.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+page_sink *page_sink_create(const std::string &type, const std::string &path);
+
+#endif
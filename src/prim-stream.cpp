@@ -0,0 +1,295 @@
+#include "prim-stream.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+prim_stream::prim_stream(int fd, bool own_fd, size_t bufsize) :
+  fd(fd), own_fd(own_fd), bufsize(bufsize), msg_start(0), have_gc(false) {
+
+  buf.reserve(bufsize);
+  buf.append("DVPS", 4);
+  u32(PRIM_STREAM_VERSION);
+}
+
+
+prim_stream::~prim_stream() {
+  close();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Little-endian values, whatever the host
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void prim_stream::u8(unsigned int v) {
+  buf += (char)(v & 0xff);
+}
+
+void prim_stream::u32(uint32_t v) {
+  char b[4] = {(char)(v & 0xff), (char)((v >> 8) & 0xff),
+               (char)((v >> 16) & 0xff), (char)((v >> 24) & 0xff)};
+  buf.append(b, 4);
+}
+
+void prim_stream::f64(double v) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  u32((uint32_t)(bits & 0xffffffff));
+  u32((uint32_t)(bits >> 32));
+}
+
+void prim_stream::str(const std::string &s) {
+  u32((uint32_t)s.size());
+  buf += s;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Messages are built in place at the end of the buffer.  The length is
+// filled in at the end, and the buffer written out first if the message
+// has pushed it past 'bufsize'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void prim_stream::begin(int type) {
+  msg_start = buf.size();
+  u32(0);
+  u8(type);
+}
+
+void prim_stream::end() {
+  uint32_t len = (uint32_t)(buf.size() - msg_start - 4);
+  for (int i = 0; i < 4; i++) {
+    buf[msg_start + i] = (char)((len >> (8 * i)) & 0xff);
+  }
+  if (buf.size() >= bufsize) {
+    flush();
+  }
+}
+
+
+void prim_stream::gc(const dl_gc &g) {
+  if (have_gc && g == last_gc) return;
+
+  begin(PRIM_GC);
+  u32((uint32_t)g.col);
+  u32((uint32_t)g.fill);
+  f64(g.lwd);
+  i32(g.lty);
+  u8(g.lend);
+  u8(g.ljoin);
+  f64(g.lmitre);
+  f64(g.cex);
+  f64(g.ps);
+  f64(g.lineheight);
+  u8(g.fontface);
+  str(g.fontfamily);
+  end();
+
+  last_gc = g;
+  have_gc = true;
+}
+
+
+void prim_stream::begin_page(int page, const dl_page &pg) {
+  if (!error.empty()) return;
+  begin(PRIM_PAGE);
+  i32(page);
+  u32((uint32_t)pg.bg);
+  f64(pg.left);
+  f64(pg.right);
+  f64(pg.bottom);
+  f64(pg.top);
+  end();
+}
+
+
+void prim_stream::end_page(int page) {
+  if (!error.empty()) return;
+  begin(PRIM_END_PAGE);
+  i32(page);
+  end();
+  flush();
+}
+
+
+void prim_stream::op(const dl_list &dl, const dl_op &op) {
+  if (!error.empty()) return;
+
+  gc(dl.gcs[op.gc]);
+
+  const double *x = &dl.xs[0] + op.start;
+  const double *y = &dl.ys[0] + op.start;
+
+  begin(PRIM_OP_BASE + op.type);
+  switch (op.type) {
+  case DL_CIRCLE:
+    f64(x[0]); f64(y[0]); f64(op.a);
+    break;
+  case DL_LINE:
+  case DL_RECT:
+  case DL_CLIP:
+    f64(x[0]); f64(y[0]); f64(x[1]); f64(y[1]);
+    break;
+  case DL_POLYLINE:
+  case DL_POLYGON:
+    u32(op.n);
+    for (int i = 0; i < op.n; i++) f64(x[i]);
+    for (int i = 0; i < op.n; i++) f64(y[i]);
+    break;
+  case DL_PATH:
+    u32(op.ni);
+    for (int i = 0; i < op.ni; i++) u32(dl.ints[op.istart + i]);
+    u8(op.flag);
+    u32(op.n);
+    for (int i = 0; i < op.n; i++) f64(x[i]);
+    for (int i = 0; i < op.n; i++) f64(y[i]);
+    break;
+  case DL_TEXT:
+    f64(x[0]); f64(y[0]); f64(op.a); f64(op.b);
+    str(dl.strings[op.str]);
+    break;
+  case DL_RASTER: {
+    const std::vector<unsigned int> &px = dl.rasters[op.str];
+    u32(dl.ints[op.istart]);
+    u32(dl.ints[op.istart + 1]);
+    f64(x[0]); f64(y[0]); f64(op.a); f64(op.b); f64(op.c);
+    u8(op.flag);
+    for (size_t i = 0; i < px.size(); i++) u32(px[i]);
+    break;
+  }
+  case DL_GLYPH:
+    u32(op.n);
+    for (int i = 0; i < op.n; i++) u32(dl.ints[op.istart + i]);
+    for (int i = 0; i < op.n; i++) f64(x[i]);
+    for (int i = 0; i < op.n; i++) f64(y[i]);
+    f64(op.a); f64(op.b);
+    i32((int)op.c);
+    str(dl.strings[op.str]);
+    break;
+  default:
+    break;
+  }
+  end();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Write out the buffer.
+//
+// SIGPIPE is blocked while writing so a reader which has gone away gives
+// EPIPE here rather than a signal to R.  A SIGPIPE raised meanwhile is
+// taken off the pending set before unblocking.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool prim_stream::flush() {
+  if (!error.empty()) {
+    buf.clear();
+    return false;
+  }
+
+#ifndef _WIN32
+  sigset_t pipe_set, old_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+#endif
+
+  size_t pos = 0;
+  while (pos < buf.size()) {
+#ifdef _WIN32
+    int n = _write(fd, buf.data() + pos, (unsigned int)(buf.size() - pos));
+#else
+    ssize_t n = write(fd, buf.data() + pos, buf.size() - pos);
+#endif
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      error = std::string("write failed: ") + strerror(errno);
+      break;
+    }
+    pos += (size_t)n;
+  }
+
+#ifndef _WIN32
+  sigset_t pending;
+  sigpending(&pending);
+  if (sigismember(&pending, SIGPIPE)) {
+    int sig;
+    sigwait(&pipe_set, &sig);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+#endif
+
+  buf.clear();
+  return error.empty();
+}
+
+
+void prim_stream::close() {
+  if (fd < 0) return;
+
+  if (error.empty()) {
+    begin(PRIM_CLOSE);
+    end();
+    flush();
+  }
+
+  if (own_fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+  }
+  fd = -1;
+}
+
+
+int prim_stream_open_path(const std::string &path, std::string &error) {
+#ifdef _WIN32
+  int fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+  if (fd < 0) {
+    error = "could not open '" + path + "': " + strerror(errno);
+  }
+  return fd;
+}
+
+
+int prim_stream_connect_unix(const std::string &path, std::string &error) {
+#ifdef _WIN32
+  error = "Unix domain sockets are not supported on Windows";
+  return -1;
+#else
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    error = "socket path is too long: '" + path + "'";
+    return -1;
+  }
+  strcpy(addr.sun_path, path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    error = std::string("could not create socket: ") + strerror(errno);
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    error = "could not connect to '" + path + "': " + strerror(errno);
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+#endif
+}
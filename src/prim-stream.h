@@ -0,0 +1,114 @@
+#ifndef DEVOUT_PRIM_STREAM_H
+#define DEVOUT_PRIM_STREAM_H
+
+#include <stdint.h>
+#include <string>
+
+#include "display-list.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Live binary stream of drawn primitives (see primitive_stream()) for an
+// external renderer reading from a file, pipe or Unix domain socket.
+//
+// All values are little-endian.  The stream starts with an 8 byte header:
+//
+//     "DVPS"  u32 version (= PRIM_STREAM_VERSION)
+//
+// followed by messages, each
+//
+//     u32 length   number of bytes which follow (type + payload)
+//     u8  type
+//     ...payload
+//
+// 'str' is  u32 length + UTF-8 bytes.  Colours are R's packed ABGR (u32).
+// Coordinates are device units (1/72 inch), origin top left, y down.
+//
+//   type  message   payload
+//   ----  --------  ---------------------------------------------------------
+//     1   PAGE      i32 page, u32 bg, f64 left, right, bottom, top
+//     2   END_PAGE  i32 page
+//     3   GC        u32 col, u32 fill, f64 lwd, i32 lty, u8 lend, u8 ljoin,
+//                   f64 lmitre, f64 cex, f64 ps, f64 lineheight, u8 fontface,
+//                   str fontfamily.   Applies to all following primitives
+//     4   CLOSE     (none) the device was closed
+//    16   CIRCLE    f64 x, y, r
+//    17   LINE      f64 x1, y1, x2, y2
+//    18   POLYLINE  u32 n, f64 x[n], f64 y[n]
+//    19   POLYGON   u32 n, f64 x[n], f64 y[n]
+//    20   PATH      u32 npoly, u32 nper[npoly], u8 winding, u32 n, f64 x[n], f64 y[n]
+//    21   RECT      f64 x0, y0, x1, y1
+//    22   TEXT      f64 x, y, rot, hadj, str text
+//    23   RASTER    u32 w, h, f64 x, y (bottom left), width, height, rot,
+//                   u8 interpolate, u32 pixels[w * h] (row major, top row first)
+//    24   CLIP      f64 x0, y0, x1, y1
+//    25   GLYPH     u32 n, u32 id[n], f64 x[n], f64 y[n], f64 size, rot,
+//                   i32 font_index, str font_file
+//
+// Primitive types are 16 + dl_op_type.  Readers should skip messages with
+// a type they don't know (using 'length'), as new types may be added
+// without changing the version.
+//
+// Messages are collected in a buffer which is written out when the next
+// message won't fit, whenever 'flush()' is called (the device does this
+// each time the graphics engine finishes drawing) and at the end of each
+// page.  Writes block, so R waits for a slow reader once the buffer is
+// full, and memory use is bounded by the buffer size.
+//
+// After a failed write (e.g. the reader went away) 'error' is set and
+// nothing more is written.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define PRIM_STREAM_VERSION 1
+
+enum prim_message_type {
+  PRIM_PAGE     = 1,
+  PRIM_END_PAGE = 2,
+  PRIM_GC       = 3,
+  PRIM_CLOSE    = 4,
+  PRIM_OP_BASE  = 16
+};
+
+class prim_stream {
+public:
+  // 'fd' is written to (and closed at the end if 'own_fd').  'bufsize' is
+  // the most bytes held before writing
+  prim_stream(int fd, bool own_fd, size_t bufsize);
+  ~prim_stream();
+
+  void begin_page(int page, const dl_page &pg);
+  void end_page(int page);
+  void op(const dl_list &dl, const dl_op &op);
+  bool flush();
+  void close();
+
+  std::string error;
+
+private:
+  void begin(int type);
+  void end();
+  void u8 (unsigned int v);
+  void u32(uint32_t v);
+  void i32(int v) { u32((uint32_t)v); }
+  void f64(double v);
+  void str(const std::string &s);
+  void gc (const dl_gc &g);
+
+  int          fd;
+  bool         own_fd;
+  size_t       bufsize;
+  std::string  buf;
+  size_t       msg_start;  // offset of the current message in 'buf'
+  bool         have_gc;
+  dl_gc        last_gc;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Open a file (or FIFO) for writing, or connect to a Unix domain socket.
+//
+// @return file descriptor, or -1 with 'error' set
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int prim_stream_open_path(const std::string &path, std::string &error);
+int prim_stream_connect_unix(const std::string &path, std::string &error);
+
+#endif
@@ -0,0 +1,342 @@
+#include "rasterise.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Drawing state while rasterising one page
+//  - sx, sy, ox, oy - device coords to pixel coords: px = x * sx + ox
+//  - lwd_scale      - 'lwd' (1/96 inch) to pixels
+//  - cx0..cy1       - current clip rectangle in pixels (inclusive)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct raster_state {
+  rgba_image *img;
+  double      sx, sy, ox, oy;
+  double      lwd_scale;
+  int         cx0, cx1, cy0, cy1;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Composite 'src' over 'dst' (non-premultiplied R colours)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static inline void blend(unsigned int &dst, unsigned int src) {
+  unsigned int sa = src >> 24;
+  if (sa == 0) return;
+  if (sa == 255) {
+    dst = src;
+    return;
+  }
+
+  unsigned int da = dst >> 24;
+  unsigned int oa = sa + (da * (255 - sa) + 127) / 255;
+  if (oa == 0) {
+    dst = 0;
+    return;
+  }
+
+  unsigned int out = oa << 24;
+  for (int shift = 0; shift < 24; shift += 8) {
+    unsigned int s = (src >> shift) & 255;
+    unsigned int d = (dst >> shift) & 255;
+    // weighted by alpha so a transparent background doesn't darken the colour
+    unsigned int c = (s * sa * 255 + d * da * (255 - sa) + (oa * 255) / 2) / (oa * 255);
+    out |= (c > 255 ? 255 : c) << shift;
+  }
+  dst = out;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Scanline fill of a set of closed sub-paths (in pixel coordinates).
+// Pixels are filled if their centre is inside.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct crossing {
+  double x;
+  int    dir;
+  bool operator<(const crossing &other) const { return x < other.x; }
+};
+
+static void fill_subpaths(raster_state &rs, const std::vector<double> &xs,
+                          const std::vector<double> &ys, const std::vector<int> &nper,
+                          bool winding, unsigned int col) {
+  if ((col >> 24) == 0 || xs.empty()) return;
+
+  double ymin = ys[0], ymax = ys[0];
+  for (size_t i = 1; i < ys.size(); i++) {
+    ymin = std::min(ymin, ys[i]);
+    ymax = std::max(ymax, ys[i]);
+  }
+
+  int row0 = std::max(rs.cy0, (int)std::ceil(ymin - 0.5));
+  int row1 = std::min(rs.cy1, (int)std::floor(ymax - 0.5));
+
+  std::vector<crossing> xing;
+  for (int row = row0; row <= row1; row++) {
+    double yc = row + 0.5;
+    xing.clear();
+
+    int start = 0;
+    for (size_t p = 0; p < nper.size(); p++) {
+      int n = nper[p];
+      for (int i = 0; i < n; i++) {
+        int j = (i + 1 == n) ? 0 : i + 1;
+        double y0 = ys[start + i], y1 = ys[start + j];
+        if ((y0 <= yc && y1 > yc) || (y1 <= yc && y0 > yc)) {
+          double t = (yc - y0) / (y1 - y0);
+          crossing c;
+          c.x   = xs[start + i] + t * (xs[start + j] - xs[start + i]);
+          c.dir = (y1 > y0) ? 1 : -1;
+          xing.push_back(c);
+        }
+      }
+      start += n;
+    }
+
+    if (xing.size() < 2) continue;
+    std::sort(xing.begin(), xing.end());
+
+    unsigned int *line = &rs.img->pixels[(size_t)row * rs.img->width];
+    int wind = 0;
+    for (size_t k = 0; k + 1 < xing.size(); k++) {
+      wind += winding ? xing[k].dir : 1;
+      bool inside = winding ? (wind != 0) : (wind & 1);
+      if (!inside) continue;
+
+      int col0 = std::max(rs.cx0, (int)std::ceil(xing[k    ].x - 0.5));
+      int col1 = std::min(rs.cx1, (int)std::ceil(xing[k + 1].x - 0.5) - 1);
+      for (int c = col0; c <= col1; c++) {
+        blend(line[c], col);
+      }
+    }
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Add a convex polygon to a set of sub-paths, always with positive
+// orientation so that the non-zero union of many of them has no holes
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void add_convex(std::vector<double> &xs, std::vector<double> &ys, std::vector<int> &nper,
+                       const double *x, const double *y, int n) {
+  double area = 0;
+  for (int i = 0; i < n; i++) {
+    int j = (i + 1) % n;
+    area += x[i] * y[j] - x[j] * y[i];
+  }
+  for (int i = 0; i < n; i++) {
+    int k = (area >= 0) ? i : n - 1 - i;
+    xs.push_back(x[k]);
+    ys.push_back(y[k]);
+  }
+  nper.push_back(n);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Stroke a polyline (pixel coordinates) as the union of one quad per segment,
+// plus an octagon at each joint for wide lines
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void stroke_polyline(raster_state &rs, const double *x, const double *y, int n,
+                            bool closed, double lwd, unsigned int col) {
+  if ((col >> 24) == 0 || n < 2) return;
+
+  double hw = std::max(1.0, lwd * rs.lwd_scale) / 2;
+
+  std::vector<double> xs, ys;
+  std::vector<int>    nper;
+
+  int nseg = closed ? n : n - 1;
+  for (int i = 0; i < nseg; i++) {
+    int j = (i + 1) % n;
+    double dx = x[j] - x[i], dy = y[j] - y[i];
+    double len = std::sqrt(dx * dx + dy * dy);
+    if (len == 0) continue;
+    double nx = -dy / len * hw, ny = dx / len * hw;
+
+    double qx[4] = {x[i] + nx, x[j] + nx, x[j] - nx, x[i] - nx};
+    double qy[4] = {y[i] + ny, y[j] + ny, y[j] - ny, y[i] - ny};
+    add_convex(xs, ys, nper, qx, qy, 4);
+
+    if (hw >= 1.5 && (closed || j != n - 1)) {
+      double ox[8], oy[8];
+      for (int k = 0; k < 8; k++) {
+        ox[k] = x[j] + hw * std::cos(k * M_PI / 4);
+        oy[k] = y[j] + hw * std::sin(k * M_PI / 4);
+      }
+      add_convex(xs, ys, nper, ox, oy, 8);
+    }
+  }
+
+  fill_subpaths(rs, xs, ys, nper, true, col);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Fill and stroke sub-paths given in device coordinates
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void draw_shape(raster_state &rs, const double *x, const double *y,
+                       const std::vector<int> &nper, bool winding, const dl_gc &gc) {
+  std::vector<double> px, py;
+  int total = 0;
+  for (size_t i = 0; i < nper.size(); i++) total += nper[i];
+  for (int i = 0; i < total; i++) {
+    px.push_back(x[i] * rs.sx + rs.ox);
+    py.push_back(y[i] * rs.sy + rs.oy);
+  }
+
+  fill_subpaths(rs, px, py, nper, winding, (unsigned int)gc.fill);
+
+  int start = 0;
+  for (size_t i = 0; i < nper.size(); i++) {
+    stroke_polyline(rs, px.data() + start, py.data() + start, nper[i], true, gc.lwd,
+                    (unsigned int)gc.col);
+    start += nper[i];
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Nearest-neighbour raster image.  (x, y) is the bottom-left corner and the
+// image is rotated 'rot' degrees about it
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void draw_raster(raster_state &rs, const std::vector<unsigned int> &raster, int w, int h,
+                        double x, double y, double width, double height, double rot) {
+  if (w <= 0 || h <= 0) return;
+
+  double th = rot * M_PI / 180;
+  double ct = std::cos(th), st = std::sin(th);
+
+  // Corner and the image axes in pixel space
+  double p0x = x * rs.sx + rs.ox, p0y = y * rs.sy + rs.oy;
+  double exx = width  *  ct * rs.sx, exy = width  * st * rs.sy;
+  double eyx = height * -st * rs.sx, eyy = height * ct * rs.sy;
+
+  double det = exx * eyy - exy * eyx;
+  if (det == 0) return;
+
+  double cx[4] = {p0x, p0x + exx, p0x + exx + eyx, p0x + eyx};
+  double cy[4] = {p0y, p0y + exy, p0y + exy + eyy, p0y + eyy};
+  int col0 = std::max(rs.cx0, (int)std::floor(*std::min_element(cx, cx + 4)));
+  int col1 = std::min(rs.cx1, (int)std::ceil (*std::max_element(cx, cx + 4)));
+  int row0 = std::max(rs.cy0, (int)std::floor(*std::min_element(cy, cy + 4)));
+  int row1 = std::min(rs.cy1, (int)std::ceil (*std::max_element(cy, cy + 4)));
+
+  for (int row = row0; row <= row1; row++) {
+    unsigned int *line = &rs.img->pixels[(size_t)row * rs.img->width];
+    for (int c = col0; c <= col1; c++) {
+      double dx = c + 0.5 - p0x, dy = row + 0.5 - p0y;
+      double u = ( eyy * dx - eyx * dy) / det;
+      double v = (-exy * dx + exx * dy) / det;
+      if (u < 0 || u >= 1 || v < 0 || v >= 1) continue;
+      int sc = (int)(u * w);
+      int sr = h - 1 - (int)(v * h);
+      blend(line[c], raster[(size_t)sr * w + sc]);
+    }
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Rasterise a recorded page
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_rasterise(const dl_page &page, double res, rgba_image &img) {
+  dl_rasterise(page, res, res, img);
+}
+
+void dl_rasterise(const dl_page &page, double xres, double yres, rgba_image &img) {
+
+  double dw = page.right  - page.left;
+  double dh = page.bottom - page.top;
+
+  img.width  = std::max(1, (int)std::floor(std::fabs(dw) * xres / 72 + 0.5));
+  img.height = std::max(1, (int)std::floor(std::fabs(dh) * yres / 72 + 0.5));
+  img.pixels.assign((size_t)img.width * img.height, 0);
+
+  unsigned int bg = (unsigned int)page.bg;
+  if ((bg >> 24) != 0) {
+    for (size_t i = 0; i < img.pixels.size(); i++) blend(img.pixels[i], bg);
+  }
+
+  raster_state rs;
+  rs.img       = &img;
+  rs.sx        = (dw == 0) ? 0 : img.width  / dw;
+  rs.sy        = (dh == 0) ? 0 : img.height / dh;
+  rs.ox        = -page.left * rs.sx;
+  rs.oy        = -page.top  * rs.sy;
+  rs.lwd_scale = std::min(xres, yres) / 96;
+  rs.cx0 = 0; rs.cx1 = img.width  - 1;
+  rs.cy0 = 0; rs.cy1 = img.height - 1;
+
+  const dl_list &dl = page.dl;
+  std::vector<int> nper(1);
+
+  for (size_t i = 0; i < dl.ops.size(); i++) {
+    const dl_op &op = dl.ops[i];
+    const dl_gc &gc = dl.gcs[op.gc];
+    const double *x = dl.xs.data() + op.start;
+    const double *y = dl.ys.data() + op.start;
+
+    switch (op.type) {
+    case DL_CIRCLE: {
+      double r  = op.a * std::fabs(rs.sx);
+      int    nc = std::max(16, std::min(256, (int)(r * 2)));
+      std::vector<double> cx(nc), cy(nc);
+      for (int k = 0; k < nc; k++) {
+        cx[k] = x[0] + op.a * std::cos(2 * M_PI * k / nc);
+        cy[k] = y[0] + op.a * std::sin(2 * M_PI * k / nc);
+      }
+      nper[0] = nc;
+      draw_shape(rs, cx.data(), cy.data(), nper, false, gc);
+      break;
+    }
+    case DL_LINE:
+    case DL_POLYLINE: {
+      std::vector<double> px(op.n), py(op.n);
+      for (int k = 0; k < op.n; k++) {
+        px[k] = x[k] * rs.sx + rs.ox;
+        py[k] = y[k] * rs.sy + rs.oy;
+      }
+      stroke_polyline(rs, px.data(), py.data(), op.n, false, gc.lwd, (unsigned int)gc.col);
+      break;
+    }
+    case DL_POLYGON:
+      nper[0] = op.n;
+      draw_shape(rs, x, y, nper, false, gc);
+      break;
+    case DL_PATH: {
+      std::vector<int> pnper(dl.ints.begin() + op.istart, dl.ints.begin() + op.istart + op.ni);
+      draw_shape(rs, x, y, pnper, op.flag != 0, gc);
+      break;
+    }
+    case DL_RECT: {
+      double rx[4] = {x[0], x[1], x[1], x[0]};
+      double ry[4] = {y[0], y[0], y[1], y[1]};
+      nper[0] = 4;
+      draw_shape(rs, rx, ry, nper, false, gc);
+      break;
+    }
+    case DL_RASTER:
+      draw_raster(rs, dl.rasters[op.str], dl.ints[op.istart], dl.ints[op.istart + 1],
+                  x[0], y[0], op.a, op.b, op.c);
+      break;
+    case DL_CLIP: {
+      double px0 = x[0] * rs.sx + rs.ox, px1 = x[1] * rs.sx + rs.ox;
+      double py0 = y[0] * rs.sy + rs.oy, py1 = y[1] * rs.sy + rs.oy;
+      rs.cx0 = std::max(0             , (int)std::ceil (std::min(px0, px1) - 0.5));
+      rs.cx1 = std::min(img.width  - 1, (int)std::floor(std::max(px0, px1) - 0.5));
+      rs.cy0 = std::max(0             , (int)std::ceil (std::min(py0, py1) - 0.5));
+      rs.cy1 = std::min(img.height - 1, (int)std::floor(std::max(py0, py1) - 0.5));
+      break;
+    }
+    default:
+      // DL_TEXT, DL_GLYPH: no font rendering
+      break;
+    }
+  }
+}
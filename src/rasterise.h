@@ -0,0 +1,42 @@
+#ifndef DEVOUT_RASTERISE_H
+#define DEVOUT_RASTERISE_H
+
+#include <vector>
+
+#include "display-list.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// RGBA image.  Each pixel is an R packed colour (R in the low byte, alpha in
+// the high byte) and rows run from the top of the page down.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct rgba_image {
+  int                       width;
+  int                       height;
+  std::vector<unsigned int> pixels;
+
+  rgba_image() : width(0), height(0) {}
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Rasterise a recorded page at 'res' pixels per inch (72 = 1 pixel per
+// device unit).
+//
+// This is a small, dependency-free scanline rasteriser (no anti-aliasing)
+// meant for native output of pages without a round trip to R:
+//   - circles, rects, polygons and paths are filled (even-odd or non-zero)
+//     and stroked
+//   - lines are solid (line type is ignored) with the stroke width from 'lwd'
+//   - rasters are drawn with nearest-neighbour sampling (with rotation)
+//   - clipping rectangles are honoured
+//   - text and glyphs are not drawn. Pattern fills use the plain fill colour
+//
+// 'xres' and 'yres' may differ for devices whose pixels are not square.
+//
+// Uses no R API so may be called from any thread.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_rasterise(const dl_page &page, double res, rgba_image &img);
+void dl_rasterise(const dl_page &page, double xres, double yres, rgba_image &img);
+
+#endif
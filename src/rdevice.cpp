@@ -1,5 +1,23 @@
 #include <Rcpp.h>
 #include <R_ext/GraphicsEngine.h>
+#include <map>
+
+#include "display-list.h"
+#include "page-sink.h"
+#include "page-pipeline.h"
+#include "rasterise.h"
+#include "image-encode.h"
+#include "animation.h"
+#include "call-log.h"
+#include "page-hash.h"
+#include "page-diff.h"
+#include "backend.h"
+#include "prim-stream.h"
+#include "framebuffer.h"
+#include "return-check.h"
+#include "string-intern.h"
+#include "geometry-cache.h"
+#include "lod.h"
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -18,6 +36,20 @@ Rcpp::IntegerVector col_to_rgba(int col) {
   return rgb;
 }
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Extract the integer handle from a pattern/clip path/mask reference
+// created by this device.
+//
+// @return handle or NA_INTEGER if 'ref' is NULL
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int definition_handle(SEXP ref) {
+  if (Rf_isNull(ref) || TYPEOF(ref) != INTSXP || Rf_length(ref) != 1) {
+    return NA_INTEGER;
+  }
+  return INTEGER(ref)[0];
+}
+
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // A structure containing graphical parameters
 //
@@ -44,7 +76,7 @@ Rcpp::IntegerVector col_to_rgba(int col) {
 //
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 Rcpp::List gc_to_list(const pGEcontext gc) {
-  return Rcpp::List::create(
+  Rcpp::List gc_list = Rcpp::List::create(
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
     // Colours NOTE:  Alpha transparency included in col & fill
     //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -70,6 +102,16 @@ Rcpp::List gc_to_list(const pGEcontext gc) {
     Rcpp::Named("fontface")   = gc->fontface,     // [int] Font face (plain, italic, bold, ...)
     Rcpp::Named("fontfamily") = gc->fontfamily    // [chr 201] Font family
   );
+
+#if R_GE_definitions > 12
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Pattern/gradient fill. This is the integer handle given to the
+  // callback in 'setPattern', or NA if there is no pattern fill
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  gc_list["patternFill"] = definition_handle(gc->patternFill);  // [int] pattern handle
+#endif
+
+  return gc_list;
 }
 
 
@@ -203,1266 +245,3350 @@ void list_to_dd(Rcpp::List dd_list, pDevDesc dd) {
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Struct of information about the graphics device
-//  - rdata  - list of information for R e.g. actual plotting canvas
+// Affine transform applied to coordinates before they are passed to R
+//
+// A device may declare this by returning a 'transform' list from its 'open'
+// callback e.g. ascii() uses list(scale = 1/72, type = 'integer') so that
+// all coordinates arrive as integer character cells.
 //
-// 2020-04-19 This struct used to contain multiple data structures to keep
-//            track of. After recent refactoring, there's just one list of
-//            R information being retained.  So this struct can be
-//            removed once I've decided I don't need it for possible future
-//            expansion ideas.
+//   x' = x * scale[0] + offset[0]
+//   y' = y * scale[1] + offset[1]     (y is first flipped if flip_y = TRUE)
+//
+// Lengths (e.g. circle radius, raster width/height) are only scaled, and are
+// always passed as doubles so that small radii don't round to zero.
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-struct cdata_struct {
-  SEXP rdata;
+struct coord_transform {
+  bool   active;      // FALSE = pass device coordinates through untouched
+  double scale[2];    // [dbl] per-axis scale e.g. c(1/72, 1/72/font_aspect)
+  double offset[2];   // [dbl] per-axis offset added after scaling
+  bool   flip_y;      // [lgl] flip y within the device extents before scaling
+  bool   as_integer;  // [lgl] round to nearest and pass integer vectors to R
 };
 
-//--------------------------------------------------------------------------
-// Rcpp calls the R function "devout::rcallback()". Grab a reference to it
-// here and use it in the `rdevice_*` calls
-//--------------------------------------------------------------------------
-Rcpp::Environment pkg = Rcpp::Environment::namespace_env("devout");
-Rcpp::Function rcallback = pkg["rcallback"];
+enum transform_axis { AXIS_X = 0, AXIS_Y = 1 };
+
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Parse return values from R back into the device description and current cdata
+// Parse an R list of transform settings
+//
+// Unknown/invalid settings are warned about and ignored
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void handle_return_values_from_R(Rcpp::List res, pDevDesc dd) {
+void list_to_transform(Rcpp::List tf_list, coord_transform *tf) {
 
-  // If a 'dd' was returned, then parse it back into the device description
-  if (res.containsElementNamed("dd")) {
-    if (TYPEOF(res["dd"]) == VECSXP) {
-      list_to_dd(res["dd"], dd);
+  if (tf_list.containsElementNamed("scale")) {
+    Rcpp::NumericVector scale = Rcpp::as<Rcpp::NumericVector>(tf_list["scale"]);
+    if (scale.size() == 1 || scale.size() == 2) {
+      tf->scale[0] = scale[0];
+      tf->scale[1] = scale[scale.size() - 1];
     } else {
-      Rcpp::warning("Returned 'dd' from R is not a list. Ignoring");
+      Rcpp::warning("transform: 'scale' must be 1 or 2 numeric values. Ignoring");
+    }
+  }
+
+  if (tf_list.containsElementNamed("offset")) {
+    Rcpp::NumericVector offset = Rcpp::as<Rcpp::NumericVector>(tf_list["offset"]);
+    if (offset.size() == 1 || offset.size() == 2) {
+      tf->offset[0] = offset[0];
+      tf->offset[1] = offset[offset.size() - 1];
+    } else {
+      Rcpp::warning("transform: 'offset' must be 1 or 2 numeric values. Ignoring");
+    }
+  }
+
+  if (tf_list.containsElementNamed("flip_y")) tf->flip_y = Rcpp::as<bool>(tf_list["flip_y"]);
+
+  if (tf_list.containsElementNamed("type")) {
+    std::string type = Rcpp::as<std::string>(tf_list["type"]);
+    if (type == "integer") {
+      tf->as_integer = true;
+    } else if (type == "double") {
+      tf->as_integer = false;
+    } else {
+      Rcpp::warning("transform: 'type' must be 'integer' or 'double'. Ignoring");
     }
   }
+
+  tf->active = true;
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// device_Activate is called when a device becomes the
-// active device.  For example, it can be used to change the
-// title of a window to indicate the active status of
-// the device to the user.  Not all device types will
-// do anything.
-// The only parameter is a device driver structure.
+// Newer graphics features the callback can draw, as reported by
+// dev.capabilities()
 //
-// As from R 2.14.0 this can be omitted or set to NULL.
+// The device passes every pattern, clipping path, mask etc to the callback,
+// but whether anything is drawn is up to the callback.  So nothing is
+// claimed unless the callback declares it by returning a 'capabilities'
+// list from its 'open' callback e.g.
+//   list(patterns = c('linear', 'radial'), clippingPaths = TRUE)
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_activate(pDevDesc dd) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+struct device_caps {
+  std::vector<std::string> patterns;        // [chr] 'linear', 'radial', 'tiling'
+  bool                     clipping_paths;  // [lgl]
+  std::vector<std::string> masks;           // [chr] 'alpha', 'luminance'
+  std::vector<std::string> compositing;     // [chr] operators as for 'defineGroup'. "all" = every one
+  bool                     transformations; // [lgl] groups drawn with a transform
+  bool                     paths;           // [lgl] stroke/fill/fillStroke
+  bool                     glyphs;          // [lgl]
+};
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "activate",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Parse an R list of capabilities.  'compositing = TRUE' means every
+// operator
+//
+// Unknown/invalid settings are warned about and ignored
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void list_to_caps(Rcpp::List caps_list, device_caps *caps) {
+
+  if (caps_list.containsElementNamed("patterns")) {
+    caps->patterns = Rcpp::as<std::vector<std::string> >(caps_list["patterns"]);
+    for (size_t i = 0; i < caps->patterns.size(); i++) {
+      const std::string &p = caps->patterns[i];
+      if (p != "linear" && p != "radial" && p != "tiling") {
+        Rcpp::warning("capabilities: unknown pattern '" + p + "'. Ignoring");
+      }
+    }
+  }
 
-      Rcpp::Named("args") = Rcpp::List()
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_activate: " + ex_str);
+  if (caps_list.containsElementNamed("masks")) {
+    caps->masks = Rcpp::as<std::vector<std::string> >(caps_list["masks"]);
+    for (size_t i = 0; i < caps->masks.size(); i++) {
+      const std::string &m = caps->masks[i];
+      if (m != "alpha" && m != "luminance") {
+        Rcpp::warning("capabilities: unknown mask '" + m + "'. Ignoring");
+      }
+    }
   }
 
+  if (caps_list.containsElementNamed("compositing")) {
+    SEXP ops = caps_list["compositing"];
+    if (TYPEOF(ops) == LGLSXP) {
+      caps->compositing.clear();
+      if (Rcpp::as<bool>(ops)) caps->compositing.push_back("all");
+    } else {
+      caps->compositing = Rcpp::as<std::vector<std::string> >(ops);
+    }
+  }
+
+  if (caps_list.containsElementNamed("clippingPaths"  )) caps->clipping_paths  = Rcpp::as<bool>(caps_list["clippingPaths"  ]);
+  if (caps_list.containsElementNamed("transformations")) caps->transformations = Rcpp::as<bool>(caps_list["transformations"]);
+  if (caps_list.containsElementNamed("paths"          )) caps->paths           = Rcpp::as<bool>(caps_list["paths"          ]);
+  if (caps_list.containsElementNamed("glyphs"         )) caps->glyphs          = Rcpp::as<bool>(caps_list["glyphs"         ]);
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// device_Cap should return an integer matrix (R colors)
-// representing the current contents of the device display.
-//
-// The result is expected to be ROW FIRST.
+// Transform 'n' coordinates along the given axis into an R vector
 //
-// This will only make sense for raster devices and can
-// probably only be implemented for screen devices.
-//
-// added 2010-06-27
+// @param is_length if TRUE, values are lengths (e.g. radius) and are only scaled
 //
-// As from R 2.13.2 this can be left unimplemented as NULL.
-// For earlier versions of R it should return R_NilValue.
-//
-// @return optional integer matrix of colours. Otherwise returns a dummy 5x5 matrix
+// @return numeric vector (or integer vector if 'tf->as_integer')
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-SEXP rdevice_cap(pDevDesc dd) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+SEXP transform_coords(const coord_transform *tf, const double *v, int n,
+                      transform_axis axis, pDevDesc dd, bool is_length = false) {
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "cap",
+  if (!tf->active) {
+    return Rcpp::NumericVector(v, v + n);
+  }
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  double scale  = tf->scale[axis];
+  double offset = is_length ? 0 : tf->offset[axis];
+  bool   flip   = tf->flip_y && axis == AXIS_Y && !is_length;
+  double extent = dd->top + dd->bottom;
 
-      Rcpp::Named("args") = Rcpp::List()
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_cap: " + ex_str);
+  if (tf->as_integer && !is_length) {
+    Rcpp::IntegerVector res(n);
+    for (int i = 0; i < n; i++) {
+      double val = (flip ? extent - v[i] : v[i]) * scale + offset;
+      res[i] = R_FINITE(val) ? (int)std::floor(val + 0.5) : NA_INTEGER;
+    }
+    return res;
   }
 
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("contents")) {
-    return res["contents"];
-  } else {
-    Rcpp::IntegerMatrix contents(5, 5);
-    return contents;
+  Rcpp::NumericVector res(n);
+  for (int i = 0; i < n; i++) {
+    res[i] = (flip ? extent - v[i] : v[i]) * scale + offset;
   }
+  return res;
 }
 
 
-
-
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw a single circle
-
-// device_Circle should have the side-effect that a
-// circle is drawn, centred at the given location, with
-// the given radius.
-// (If the device has non-square pixels, 'radius' should
-// be interpreted in the units of the x direction.)
-// The border of the circle should be
-// drawn in the given "col", and the circle should be
-// filled with the given "fill" colour.
-// If "col" is NA_INTEGER then no border should be drawn
-// If "fill" is NA_INTEGER then the circle should not
-// be filled.
+// Reference counted cache of graphical definitions (patterns, clip paths, masks)
 //
-// graphics parameters that should be honoured (if possible):
-//   col, fill, gamma, lty, lwd
+// Each unique definition is sent to the callback exactly once and given an
+// integer handle.  Subsequent uses of an identical definition re-use the
+// handle (bumping the reference count) and primitives refer to it by handle
+// e.g. gc$patternFill.  When the count drops to zero, the callback is told to
+// 'release' the handle.
 //
-// @param x,y coords of centre
-// @param r radius
+// 'key' is a byte string uniquely identifying the definition contents.
+// 'fn' is any R function which is part of the definition. It is preserved
+// while cached so that its address (part of the key) can't be reused.
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_circle(double x, double y, double r, const pGEcontext gc, pDevDesc dd) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+struct cached_definition {
+  std::string key;
+  int         refcount;
+  SEXP        fn;
+  uint64_t    content;   // what it draws (see dl_content_hash()). 0 if unknown
+};
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "circle",
+struct definition_cache {
+  std::map<std::string, int>       handles;  // key -> handle
+  std::map<int, cached_definition> defs;     // handle -> definition
+  int next_handle;
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  definition_cache() : next_handle(1) {}
+};
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("x") = x,
-        Rcpp::Named("y") = y,
-        Rcpp::Named("r") = r
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_circle: " + ex_str);
-  }
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Append the raw bytes of a value to a definition key
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template <typename T>
+void key_append(std::string &key, T value) {
+  key.append((const char *)&value, sizeof(T));
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Set clipping box
-//
-// device_Clip is given the left, right, bottom, and
-// top of a rectangle (in DEVICE coordinates).
-// It should have the side-effect that subsequent output
-// is clipped to the given rectangle.
-// NOTE that R's graphics engine already clips to the
-// extent of the device.
-// NOTE also that this will probably only be called if
-// the flag canClip is true.
+// Find or create the handle for a definition
 //
-// @param x0,y0,x1,y1 limits of clipping
+// @param is_new set to TRUE if this definition has not been seen before and
+//        must be sent to the callback
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_clip(double x0, double x1, double y0, double y1, pDevDesc dd) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+int definition_acquire(definition_cache *cache, const std::string &key, SEXP fn, bool *is_new) {
+  std::map<std::string, int>::iterator it = cache->handles.find(key);
+  if (it != cache->handles.end()) {
+    cache->defs[it->second].refcount++;
+    *is_new = false;
+    return it->second;
+  }
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "clip",
+  int handle = cache->next_handle++;
+  if (!Rf_isNull(fn)) R_PreserveObject(fn);
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  cached_definition def;
+  def.key      = key;
+  def.refcount = 1;
+  def.fn       = fn;
+  def.content  = 0;
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("x0") = x0,
-        Rcpp::Named("y0") = y0,
-        Rcpp::Named("x1") = x1,
-        Rcpp::Named("y1") = y1
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_clip: " + ex_str);
-  }
+  cache->handles[key] = handle;
+  cache->defs[handle] = def;
+  *is_new = true;
 
+  return handle;
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Called when 'dev.off()' is called
+// Drop a reference to a definition.
 //
-// device_Close is called when the device is killed.
-// This function is responsible for destroying any
-// device-specific resources that were created in
-// device_Open and for FREEing the device-specific
-// parameters structure.
+// @param handle handle to release, or NA_INTEGER to release everything
+// @param released handles which are no longer referenced and should be
+//        released by the callback
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_close(pDevDesc dd) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+void definition_release(definition_cache *cache, int handle, std::vector<int> *released) {
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "close",
+  std::vector<int> to_remove;
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  if (handle == NA_INTEGER) {
+    for (std::map<int, cached_definition>::iterator it = cache->defs.begin(); it != cache->defs.end(); ++it) {
+      to_remove.push_back(it->first);
+    }
+  } else {
+    std::map<int, cached_definition>::iterator it = cache->defs.find(handle);
+    if (it == cache->defs.end()) return;
+    if (--(it->second.refcount) <= 0) {
+      to_remove.push_back(handle);
+    }
+  }
 
-      Rcpp::Named("args") = Rcpp::List()
-    );
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_close: " + ex_str);
+  for (size_t i = 0; i < to_remove.size(); i++) {
+    cached_definition &def = cache->defs[to_remove[i]];
+    if (!Rf_isNull(def.fn)) R_ReleaseObject(def.fn);
+    cache->handles.erase(def.key);
+    cache->defs.erase(to_remove[i]);
+    if (released != NULL) released->push_back(to_remove[i]);
   }
+}
 
 
-  // Release the SEXP object to be garbage collected.
-  R_ReleaseObject(cdata->rdata);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Snapshot a graphics context for the native display list
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+dl_gc gc_to_dl(const pGEcontext gc) {
+  dl_gc dgc = dl_gc();
 
-  // free the memory we had assigned for the cdata
-  delete(cdata);
+  if (gc == NULL) {
+    dgc.pattern = NA_INTEGER;
+    return dgc;
+  }
+
+  dgc.col        = gc->col;
+  dgc.fill       = gc->fill;
+  dgc.gamma      = gc->gamma;
+  dgc.lwd        = gc->lwd;
+  dgc.lty        = gc->lty;
+  dgc.lend       = (int)gc->lend;
+  dgc.ljoin      = (int)gc->ljoin;
+  dgc.lmitre     = gc->lmitre;
+  dgc.cex        = gc->cex;
+  dgc.ps         = gc->ps;
+  dgc.lineheight = gc->lineheight;
+  dgc.fontface   = gc->fontface;
+  dgc.fontfamily = gc->fontfamily;
+  dgc.pattern    = NA_INTEGER;
+#if R_GE_definitions > 12
+  dgc.pattern    = definition_handle(gc->patternFill);
+#endif
+
+  return dgc;
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// device_Deactivate is called when a device becomes
-// inactive.
-// This allows the device to undo anything it did in
-// dev_Activate.
-// Not all device types will do anything.
-//
-// As from R 2.14.0 this can be omitted or set to NULL.
+// Struct of information about the graphics device
+//  - rdata       - list of information for R e.g. actual plotting canvas
+//  - transform   - coordinate transform declared by the device at 'open'
+//  - patterns    - cache of pattern/gradient definitions
+//  - clip_paths  - cache of clipping path definitions
+//  - masks       - cache of mask definitions
+//  - groups      - cache of group definitions
+//  - group_lists - native record of the content of each group (by handle)
+//  - group_stack - stack of handles of groups currently being defined
+//  - capture     - if not NULL, primitives are captured here (and not sent
+//                  to R) e.g. while building a path for stroke()/fill()
+//  - pages       - if not NULL, every page is recorded here (see recording())
+//  - pages_ref   - the R external pointer which owns 'pages'
+//  - sink        - if not NULL, each finished page is fetched from the
+//                  callback with 'flushPage' and written here
+//  - page        - number of pages started so far
+//  - pipeline    - if not NULL, pages are rendered natively (no 'flushPage'
+//                  call) on worker threads and written to 'sink'
+//  - stream_page - native record of the current page for 'pipeline'
+//  - log         - if not NULL, every device call is logged here (see
+//                  call_log())
+//  - no_callback - there is no R callback. Calls are only recorded and/or
+//                  logged natively
+//  - lazy        - 'state$gc' and 'state$dd' are only built if the callback
+//                  reads them (see 'callback_state()')
+//  - strings     - strings passed to text/strWidth callbacks (see
+//                  'string_intern')
+//  - string_ids  - also pass the id of each string to the callback as
+//                  'str_id'
+//  - geometries  - if not NULL, polyline/polygon/path vertices are given ids
+//                  and only sent to the callback the first time (see
+//                  'lookup_geometry()')
+//  - lod         - if not NULL, primitives too small to see are replaced by
+//                  cheaper ones, or dropped, before the backend or callback
+//                  gets them (see 'lod_stage')
+//  - hasher      - if not NULL, a content hash of each page is built up as
+//                  it is drawn (see 'consume_pending()')
+//  - prims       - if not NULL, each primitive is written to a binary stream
+//                  as it is drawn (see primitive_stream())
+//  - pending_page - ops waiting for 'hasher'/'prims' when the page isn't
+//                  otherwise recorded natively
+//  - consumed_ops - number of ops of the current page already passed to
+//                  'hasher'/'prims'
+//  - defining    - > 0 while the content of a definition is drawn. Ops
+//                  are kept in 'pending_page' until it is hashed
+//  - clip_hash   - content hash of the clipping path in force. 0 if none
+//  - mask_hash   - content hash of the mask in force. 0 if none
+//  - fb          - if not NULL, each page is rendered natively into a shared
+//                  memory framebuffer when it is finished or flushed
+//  - fb_res      - resolution for 'fb' (pixels per inch)
+//  - fb_page     - native record of the current page for 'fb' when it isn't
+//                  otherwise recorded
+//  - hold_level  - dev.hold() level. 'fb' is updated when this drops to 0
+//  - backend     - if not NULL, a native backend (see inst/include/devout.h)
+//                  which handles the calls it has a function for instead of R
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_deactivate(pDevDesc dd) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
-
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "deactivate",
+struct cdata_struct {
+  SEXP rdata;
+  coord_transform transform;
+  device_caps     caps;
+
+  definition_cache patterns;
+  definition_cache clip_paths;
+  definition_cache masks;
+  definition_cache groups;
+
+  std::map<int, dl_list> group_lists;
+  std::vector<int>       group_stack;
+  dl_list               *capture;
+
+  dl_recording          *pages;
+  SEXP                   pages_ref;
+
+  page_sink             *sink;
+  int                    page;
+  page_pipeline         *pipeline;
+  dl_page                stream_page;
+
+  call_log              *log;
+  bool                   no_callback;
+  bool                   lazy;
+  string_intern         *strings;
+  bool                   string_ids;
+  geometry_cache        *geometries;
+  lod_stage             *lod;
+
+  page_hash             *hasher;
+  prim_stream           *prims;
+  dl_list                pending_page;
+  size_t                 consumed_ops;
+  int                    defining;
+  uint64_t               clip_hash;
+  uint64_t               mask_hash;
+
+  shm_framebuffer       *fb;
+  double                 fb_res;
+  dl_page                fb_page;
+  int                    hold_level;
+
+  devout_backend        *backend;
+};
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
 
-      Rcpp::Named("args") = Rcpp::List()
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_deactivate: " + ex_str);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The current page, if it is kept in full natively
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+dl_page *current_page(cdata_struct *cdata) {
+  if (cdata->pipeline != NULL) {
+    return &cdata->stream_page;
   }
-
+  if (cdata->pages != NULL && !cdata->pages->pages.empty()) {
+    return &cdata->pages->pages.back();
+  }
+  if (cdata->fb != NULL) {
+    return &cdata->fb_page;
+  }
+  return NULL;
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// eventHelper(dd, 1) is called by do_getGraphicsEvent before looking for a
-// graphics event.  It will then call R_ProcessEvents() and eventHelper(dd, 2)
-// until this or another device returns sets a non-null result value in eventEnv,
-// at which time eventHelper(dd, 0) will be called.
-//
-// Can be left unimplemented as NULL
+// The native record of the current page (ignoring groups and captures)
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_eventHelper(pDevDesc dd, int code) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+dl_list *page_target(cdata_struct *cdata) {
+  dl_page *page = current_page(cdata);
+  if (page != NULL) {
+    return &page->dl;
+  }
+  if (cdata->hasher != NULL || cdata->prims != NULL) {
+    return &cdata->pending_page;
+  }
+  return NULL;
+}
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "eventHelper",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Pass ops drawn on the page since the last call to the page hash and the
+// primitive stream.
+//
+// This runs at the start of every primitive (from 'native_target()') so the
+// hash and stream are built up as the page is drawn.  If the page is only
+// kept for these, consumed ops are dropped straight away.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void consume_pending(cdata_struct *cdata) {
+  dl_list *dl = page_target(cdata);
+  if ((cdata->hasher == NULL && cdata->prims == NULL) || dl == NULL) return;
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("code") = code
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_eventHelper: " + ex_str);
+  for (size_t i = cdata->consumed_ops; i < dl->ops.size(); i++) {
+    if (cdata->hasher != NULL) cdata->hasher->add(*dl, dl->ops[i]);
+    if (cdata->prims  != NULL) cdata->prims->op(*dl, dl->ops[i]);
   }
+  cdata->consumed_ops = dl->ops.size();
 
+  if (dl == &cdata->pending_page && cdata->defining == 0) {
+    dl->clear();
+    cdata->consumed_ops = 0;
+  }
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// added in 2.14.0, only used by screen devices.
-//
-// Allows graphics devices to have multiple levels of suspension:
-// when this reaches zero output is flushed.
-//
-// Can be left unimplemented as NULL.
+// Where should a primitive be recorded natively?
 //
-// @return optional 'level' (integer). Be careful, I don't have any idea on
-// what this does!
+// @return display list to add the primitive to, or NULL if no native
+//         recording is active
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-int rdevice_holdflush(pDevDesc dd, int level) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+dl_list *native_target(cdata_struct *cdata) {
+  if (cdata->lod != NULL) {
+    cdata->lod->touch();
+  }
+  if (cdata->capture != NULL) {
+    return cdata->capture;
+  }
+  if (!cdata->group_stack.empty()) {
+    return &cdata->group_lists[cdata->group_stack.back()];
+  }
+  consume_pending(cdata);
+  return page_target(cdata);
+}
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "holdflush",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Snapshot a graphics context for a primitive recorded natively, with the
+// content hashes of the pattern, clipping path and mask it is drawn with
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+dl_gc native_gc(cdata_struct *cdata, const pGEcontext gc) {
+  dl_gc dgc = gc_to_dl(gc);
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("level") = level
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_holdflush: " + ex_str);
+  if (dgc.pattern != NA_INTEGER) {
+    std::map<int, cached_definition>::const_iterator it = cdata->patterns.defs.find(dgc.pattern);
+    if (it != cdata->patterns.defs.end()) dgc.pattern_hash = it->second.content;
   }
+  dgc.clip_hash = cdata->clip_hash;
+  dgc.mask_hash = cdata->mask_hash;
 
+  return dgc;
+}
 
 
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("level")) {
-    return Rcpp::as<int>(res["level"]);
-  } else {
-    return 0;
-  }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Finish the hash of the current page.
+//
+// @return hex digest, or "" if not hashing or no page has been started
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string finish_page_hash(cdata_struct *cdata) {
+  if (cdata->hasher == NULL || cdata->page == 0) return "";
+  consume_pending(cdata);
+  return cdata->hasher->digest();
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw a single line
-//
-// device_Line should have the side-effect that a single
-// line is drawn (from x1,y1 to x2,y2)
-//
-// R_GE_gcontext parameters that should be honoured (if possible):
-//   col, gamma, lty, lwd
-//
-// @param x1,y1,x2,y2 endpoint coordinates (double)
+// Send everything drawn so far to the primitive stream.  After a failed
+// write (e.g. the reader has gone away), warn and stop streaming
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_line(double x1, double y1, double x2, double y2,
-                  const pGEcontext gc, pDevDesc dd) {
+void flush_prims(cdata_struct *cdata) {
+  if (cdata->prims == NULL) return;
+  consume_pending(cdata);
+  cdata->prims->flush();
+
+  if (!cdata->prims->error.empty()) {
+    Rcpp::warning("rdevice: primitive stream " + cdata->prims->error + ". Stopping");
+    delete cdata->prims;
+    cdata->prims = NULL;
+  }
+}
 
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "line",
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// End the current page on the primitive stream
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void finish_page_prims(cdata_struct *cdata) {
+  if (cdata->prims == NULL || cdata->page == 0) return;
+  consume_pending(cdata);
+  cdata->prims->end_page(cdata->page);
+  flush_prims(cdata);
+}
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("x1") = x1,
-        Rcpp::Named("y1") = y1,
-        Rcpp::Named("x2") = x2,
-        Rcpp::Named("y2") = y2
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_line: " + ex_str);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Render the current page into the shared memory framebuffer and flip it
+// to the front
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void publish_frame(cdata_struct *cdata) {
+  if (cdata->fb == NULL || cdata->page == 0) return;
+  dl_page *page = current_page(cdata);
+  if (page == NULL) return;
+
+  rgba_image img;
+  dl_rasterise(*page, cdata->fb_res, img);
+  if (!cdata->fb->publish(img, cdata->page)) {
+    Rcpp::warning("rdevice: framebuffer " + cdata->fb->error + ". Stopping framebuffer output");
+    delete cdata->fb;
+    cdata->fb = NULL;
   }
-
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// device_Locator should return the location of the next
-// mouse click (in DEVICE coordinates)
-// Not all devices will do anything (e.g., postscript)
-//
-// As from R 2.14.0 this can be omitted or set to NULL.
-//
-// @return x,y location in device coordinates (double).
-//
+// Shorthand for transforming a single coordinate or length of the device
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-Rboolean rdevice_locator(double *x, double *y, pDevDesc dd) {
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+SEXP tf_x(cdata_struct *cdata, double x, pDevDesc dd) {
+  return transform_coords(&cdata->transform, &x, 1, AXIS_X, dd);
+}
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "locator",
+SEXP tf_y(cdata_struct *cdata, double y, pDevDesc dd) {
+  return transform_coords(&cdata->transform, &y, 1, AXIS_Y, dd);
+}
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+SEXP tf_len(cdata_struct *cdata, double len, transform_axis axis, pDevDesc dd) {
+  return transform_coords(&cdata->transform, &len, 1, axis, dd, true);
+}
 
-      Rcpp::Named("args") = Rcpp::List()
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_locator: " + ex_str);
+// Circle radius.  The engine gives it in x device units.  If the device
+// declared a transform and its x and y units differ in size (dd->ipr), the
+// circle is an ellipse once transformed, so both radii are sent: c(x, y)
+SEXP tf_radius(cdata_struct *cdata, double r, pDevDesc dd) {
+  if (!cdata->transform.active || dd->ipr[0] == dd->ipr[1]) {
+    return tf_len(cdata, r, AXIS_X, dd);
   }
 
+  double ry = r * dd->ipr[0] / dd->ipr[1];
+  return Rcpp::NumericVector::create(
+    r  * cdata->transform.scale[AXIS_X],
+    ry * cdata->transform.scale[AXIS_Y]
+  );
+}
 
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("x") && res.containsElementNamed("y")) {
-    *x = Rcpp::as<double>(res["x"]);
-    *y = Rcpp::as<double>(res["y"]);
-    return TRUE;
-  } else {
-    *x = 0;
-    *y = 0;
-    return FALSE;
+//--------------------------------------------------------------------------
+// Rcpp calls the R function "devout::rcallback()". Grab a reference to it
+// here and use it in the `rdevice_*` calls
+//--------------------------------------------------------------------------
+Rcpp::Environment pkg = Rcpp::Environment::namespace_env("devout");
+Rcpp::Function rcallback_fn = pkg["rcallback"];
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Keep each open device's 'rdata' in 'devout:::device_rdata' (under its
+// '.key') for debugging.  Done here rather than in 'rcallback()' so that
+// devices whose open/close go to a backend, or which have no callback,
+// are added and removed too
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void device_rdata_update(cdata_struct *cdata, bool add) {
+  Rcpp::Environment rdata(cdata->rdata);
+  if (!rdata.exists(".key")) return;
+
+  Rcpp::Environment device_rdata(pkg.get("device_rdata"));
+  std::string key = Rcpp::as<std::string>(rdata[".key"]);
+
+  if (add) {
+    device_rdata.assign(key, rdata);
+  } else if (device_rdata.exists(key)) {
+    device_rdata.remove(key);
   }
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Return information about the current font settings?
-//
-// device_MetricInfo should return height, depth, and
-// width information for the given character in DEVICE
-// units.
-// Note: in an 8-bit locale, c is 'char'.
-// In an mbcslocale, it is wchar_t, and at least some
-// of code assumes that is UCS-2 (Windows, true) or UCS-4.
-// This is used for formatting mathematical expressions
-// and for exact centering of text (see GText)
-// If the device cannot provide metric information then
-// it MUST return 0.0 for ascent, descent, and width.
-//
-// R_GE_gcontext parameters that should be honoured (if possible):
-//   font, cex, ps
+// Device calls in progress on devices with lazy state, innermost last.
 //
-// @param c single character. Could be unicode
-//
-// @return ascent, descent and width (double)
+// With 'rdevice(..., lazy = TRUE)' the state sent to R has a serial number
+// ('.lazy') instead of 'gc' and 'dd'.  'rcallback()' in R turns these into
+// active bindings which fetch them with 'lazy_state_()' the first time they
+// are read.  'gc' is only valid until the call returns, so the frame is
+// dropped when it does (see 'rcallback()' below).  Device calls can nest
+// e.g. a callback which draws on another device.
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_metricInfo(int c, const pGEcontext gc, double* ascent,
-                        double* descent, double* width, pDevDesc dd) {
+struct lazy_frame {
+  double     serial;
+  pDevDesc   dd;
+  pGEcontext gc;
+};
 
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+static std::vector<lazy_frame> lazy_frames;
+static double                  lazy_serial = 0;
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "metricInfo",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The 'state' argument for a device call
+//
+// @param gc graphics context. May be NULL if the call has none
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::List callback_state(cdata_struct *cdata, pDevDesc dd, const pGEcontext gc = NULL) {
+  // Nothing in R to read it
+  if (cdata->no_callback) {
+    return Rcpp::List();
+  }
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("c") = c
-      )
+  if (cdata->lazy) {
+    lazy_frame frame = {++lazy_serial, dd, gc};
+    lazy_frames.push_back(frame);
+    return Rcpp::List::create(
+      Rcpp::Named("rdata") = cdata->rdata,
+      Rcpp::Named(".lazy") = frame.serial
     );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_metricInfo: " + ex_str);
   }
 
+  if (gc == NULL) {
+    return Rcpp::List::create(
+      Rcpp::Named("rdata") = cdata->rdata,
+      Rcpp::Named("dd")    = dd_to_list(dd)
+    );
+  }
 
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that, otherwise use
-  // a dodgy default.
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("ascent")) {
-    *ascent = (Rcpp::as<double>(res["ascent"]));
-  } else {
-    *ascent  = 0.0 * 72;
+  return Rcpp::List::create(
+    Rcpp::Named("rdata") = cdata->rdata,
+    Rcpp::Named("gc")    = gc_to_list(gc),
+    Rcpp::Named("dd")    = dd_to_list(dd)
+  );
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Does anything read this device call?  With no R callback the only reader
+// is the call log, so if that isn't logging the call there is no need to
+// build its args at all
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool wants_call(cdata_struct *cdata, const char *device_call) {
+  return !cdata->no_callback ||
+    (cdata->log != NULL && !cdata->log->skipped(device_call));
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Drop the lazy frame which 'callback_state()' pushed for a device call when
+// the call returns (or R errors out of it).  'pushed' is false if it didn't
+// push one (no lazy state, or no R callback to read it), so the frames of
+// any enclosing calls are left alone
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct lazy_scope {
+  size_t mark;
+
+  lazy_scope(bool pushed) : mark(lazy_frames.size()) {
+    if (pushed && mark > 0) mark--;
+  }
+  ~lazy_scope() {
+    if (lazy_frames.size() > mark) lazy_frames.resize(mark);
   }
+};
 
-  if (res.containsElementNamed("descent")) {
-    *descent = (Rcpp::as<double>(res["descent"]));
-  } else {
-    *descent  = 0.0 * 72;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Build 'state$gc' or 'state$dd' for a device call with lazy state
+//'
+//' @param serial the '.lazy' serial number of the call
+//' @param field 'gc' or 'dd'
+//'
+//' @return list. NULL for 'gc' if the call has no graphics context
+//'
+// [[Rcpp::export]]
+SEXP lazy_state_(double serial, std::string field) {
+  for (size_t i = lazy_frames.size(); i-- > 0; ) {
+    const lazy_frame &frame = lazy_frames[i];
+    if (frame.serial != serial) continue;
+
+    if (field == "dd") {
+      return dd_to_list(frame.dd);
+    }
+    if (field == "gc") {
+      return frame.gc == NULL ? R_NilValue : (SEXP)gc_to_list(frame.gc);
+    }
+    Rcpp::stop("lazy_state_(): unknown field '%s'", field);
   }
 
-  if (res.containsElementNamed("width")) {
-    *width = (Rcpp::as<double>(res["width"]));
-  } else {
-    *width  = 0.0 * 72;
+  Rcpp::stop("state$%s is only available during the device call", field);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Every device call goes through here on its way to R, so it can be logged
+// natively first (and, with no R callback, not sent to R at all).
+//
+// What comes back is checked against the schema of return values (see
+// return-check.h) before anything is copied into the device.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template <typename C, typename S, typename A>
+Rcpp::List rcallback(cdata_struct *cdata,
+                     const Rcpp::traits::named_object<C> &device_call,
+                     const Rcpp::traits::named_object<S> &state,
+                     const Rcpp::traits::named_object<A> &args) {
+  lazy_scope scope(cdata->lazy && !cdata->no_callback);
+
+  if (cdata->log != NULL) {
+    cdata->log->log(device_call.object, args.object);
   }
+  if (cdata->no_callback) {
+    return Rcpp::List();
+  }
+
+  Rcpp::List res = rcallback_fn(device_call, state, args);
 
+  Rcpp::List sent = state.object;
+  SEXP sent_dd = sent.containsElementNamed("dd") ? (SEXP)sent["dd"] : R_NilValue;
+  return check_return(device_call.object, res, sent_dd);
 }
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Parse return values from R back into the device description and current cdata
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void handle_return_values_from_R(Rcpp::List res, pDevDesc dd) {
 
+  // If a 'dd' was returned, then parse it back into the device description
+  if (res.containsElementNamed("dd")) {
+    if (TYPEOF(res["dd"]) == VECSXP) {
+      list_to_dd(res["dd"], dd);
+    } else {
+      Rcpp::warning("Returned 'dd' from R is not a list. Ignoring");
+    }
+  }
+}
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// device_Mode is called whenever the graphics engine
-// starts drawing (mode=1) or stops drawing (mode=0)
-// GMode (in graphics.c) also says that
-// mode = 2 (graphical input on) exists.
-// The device is not required to do anything
+// Call into R for a device call which doesn't need its own handling of
+// return values e.g. the pattern/group definition calls.
 //
-// static void X11_Mode(int mode, pDevDesc dd);
+// @param gc graphics context. May be NULL if the call has none
 //
-// As from R 2.14.0 this can be omitted or set to NULL.
+// @return the list returned from R (empty on error)
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_mode(int mode, pDevDesc dd) {
-
+Rcpp::List rdevice_callback(const char *device_call, Rcpp::List args, pDevDesc dd,
+                            const pGEcontext gc = NULL) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "mode",
-
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  if (!wants_call(cdata, device_call)) return res;
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("mode") = mode
-      )
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = device_call,
+      Rcpp::Named("state")       = callback_state(cdata, dd, gc),
+      Rcpp::Named("args")        = args
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_mode: " + ex_str);
+    Rcpp::warning("rdevice_" + std::string(device_call) + ": " + ex_str);
   }
 
+  return res;
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Does the device have a device-specific way to confirm a
-// new frame (for e.g. par(ask=TRUE))?
-// This should be NULL if it does not.
-// If it does, it returns TRUE if the device handled this, and
-// FALSE if it wants the engine to do so.
-//
-// There is an example in the windows() device.
-//
-// Can be left unimplemented as NULL.
+// When streaming, ask the callback for the finished content of the current
+// page and hand it to the sink.
 //
-// @return Option: logical value. Defaults to FALSE if no return value supplied.
+// The callback returns 'contents' from 'flushPage' as either a character
+// vector (written one element per line) or a raw vector (written as is).
+// After this, the callback is free to discard everything it holds for the
+// page.
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-Rboolean rdevice_newFrameConfirm(pDevDesc dd) {
-
+void rdevice_flushPage(pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "newFrameConfirm",
+  if (cdata->sink == NULL || cdata->page == 0) {
+    return;
+  }
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  //--------------------------------------------------------------------------
+  // Native output: hand the page to the workers and carry on
+  //--------------------------------------------------------------------------
+  if (cdata->pipeline != NULL) {
+    if (cdata->pages != NULL && !cdata->pages->pages.empty()) {
+      cdata->pages->pages.back().dl = cdata->stream_page.dl;
+    }
+    cdata->pipeline->submit(cdata->page, cdata->stream_page);
 
-      Rcpp::Named("args") = Rcpp::List()
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_newFrameConfirm: " + ex_str);
+    std::string err = cdata->pipeline->take_errors();
+    if (!err.empty()) {
+      Rcpp::warning("rdevice_flushPage: " + err);
+    }
+    return;
   }
 
+  Rcpp::List res = rdevice_callback("flushPage", Rcpp::List::create(
+    Rcpp::Named("page") = cdata->page
+  ), dd);
 
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that, otherwise use
-  // a dodgy default.
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("is_device_specific")) {
-    return (Rboolean) (Rcpp::as<int>(res["is_device_specific"]));
+  if (!res.containsElementNamed("contents")) {
+    return;
+  }
+
+  SEXP contents = res["contents"];
+  std::string bytes;
+  if (TYPEOF(contents) == RAWSXP) {
+    bytes.assign((const char *)RAW(contents), XLENGTH(contents));
+  } else if (TYPEOF(contents) == STRSXP) {
+    for (R_xlen_t i = 0; i < XLENGTH(contents); i++) {
+      SEXP el = STRING_ELT(contents, i);
+      if (el != NA_STRING) {
+        bytes += CHAR(el);
+      }
+      bytes += '\n';
+    }
   } else {
-    return (Rboolean) 0;
+    Rcpp::warning("rdevice_flushPage: 'contents' must be a character or raw vector");
+    return;
   }
 
+  if (!cdata->sink->write_page(cdata->page, bytes.data(), bytes.size())) {
+    Rcpp::warning("rdevice_flushPage: " + cdata->sink->error);
+  }
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Start a new page
+// device_Activate is called when a device becomes the
+// active device.  For example, it can be used to change the
+// title of a window to indicate the active status of
+// the device to the user.  Not all device types will
+// do anything.
+// The only parameter is a device driver structure.
 //
-// device_NewPage is called whenever a new plot requires
-// a new page.
-// A new page might mean just clearing the
-// device (e.g., X11) or moving to a new page
-// (e.g., postscript)
+// As from R 2.14.0 this can be omitted or set to NULL.
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_newPage(const pGEcontext gc, pDevDesc dd) {
-
+void rdevice_activate(pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  if (cdata->backend != NULL && cdata->backend->activate != NULL) {
+    cdata->backend->activate(dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "activate")) return;
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "newPage",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "activate",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd),
 
       Rcpp::Named("args") = Rcpp::List()
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("newPage: " + ex_str);
+    Rcpp::warning("rdevice_activate: " + ex_str);
   }
 
 }
 
 
-
-
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// device_onExit is called by GEonExit when the user has aborted
-// some operation, and so an R_ProcessEvents call may not return normally.
-// It need not be set to any value; if null, it will not be called.
+// device_Cap should return an integer matrix (R colors)
+// representing the current contents of the device display.
+//
+// The result is expected to be ROW FIRST.
+//
+// This will only make sense for raster devices and can
+// probably only be implemented for screen devices.
+//
+// added 2010-06-27
+//
+// As from R 2.13.2 this can be left unimplemented as NULL.
+// For earlier versions of R it should return R_NilValue.
+//
+// @return optional integer matrix of colours. Otherwise returns a dummy 5x5 matrix
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_onExit(pDevDesc dd) {
-
+SEXP rdevice_cap(pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  if (cdata->backend != NULL && cdata->backend->cap != NULL) {
+    return cdata->backend->cap(dd, cdata->backend->user);
+  }
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "onExit",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "cap",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd),
 
       Rcpp::Named("args") = Rcpp::List()
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("onExit: " + ex_str);
+    Rcpp::warning("rdevice_cap: " + ex_str);
   }
 
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // If user has supplied a return value, then use that
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  if (res.containsElementNamed("contents")) {
+    return res["contents"];
+  } else {
+    Rcpp::IntegerMatrix contents(5, 5);
+    return contents;
+  }
 }
 
 
+
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw a path.
-//
-// device_Path should draw one or more sets of points
-// as a single path
-//
-// 'x' and 'y' give the points
-//
-// 'npoly' gives the number of polygons in the path
-// MUST be at least 1
-//
-// 'nper' gives the number of points in each polygon
-// each value MUST be at least 2
-//
-// 'winding' says whether to fill using the nonzero
-// winding rule or the even-odd rule
-//
-// Added 2010-06-27
-//
-// As from R 2.13.2 this can be left unimplemented as NULL.
-//
-// @param x,y vectors of coordiates - enough to cover all the polygons each
-//            with its respective nper
-// @param npoly Number of polygons = number of elements in "nper"
-// @param nper Number of elements in each particular polygon
-// @param winding winding order. whehter to fill or not fill.  currently unused in ascii()
-//        According to svglite::svg_path():
-//             0 = false = evenodd
-//             1 = true  = nonzero
+// Hand a line to the backend or R callback once it has been recorded
+// natively.  Also used for what the LOD stage draws instead of a primitive
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_path(double *x, double *y, int npoly, int *nper,
-                  Rboolean winding, const pGEcontext gc, pDevDesc dd) {
+void send_line(cdata_struct *cdata, double x1, double y1, double x2, double y2,
+               const pGEcontext gc, pDevDesc dd) {
 
-  int total_coords = 0;
-  for (int i = 0; i < npoly; i++) {
-    total_coords += nper[i];
+  Rcpp::List res;
+
+  if (cdata->backend != NULL && cdata->backend->line != NULL) {
+    cdata->backend->line(x1, y1, x2, y2, gc, dd, cdata->backend->user);
+    return;
   }
 
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+  if (!wants_call(cdata, "line")) return;
 
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "path",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "line",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
 
       Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("x")       = std::vector<double>(x, x+total_coords),
-        Rcpp::Named("y")       = std::vector<double>(y, y+total_coords),
-        Rcpp::Named("npoly")   = npoly,
-        Rcpp::Named("nper")    = std::vector<int>(nper, nper+npoly),
-        Rcpp::Named("winding") = (bool)winding
+        Rcpp::Named("x1") = tf_x(cdata, x1, dd),
+        Rcpp::Named("y1") = tf_y(cdata, y1, dd),
+        Rcpp::Named("x2") = tf_x(cdata, x2, dd),
+        Rcpp::Named("y2") = tf_y(cdata, y2, dd)
       )
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_path: " + ex_str);
+    Rcpp::warning("rdevice_line: " + ex_str);
   }
 
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw a polygon
-//
-// device_Polygon should have the side-effect that a
-// polygon is drawn using the given x and y values
-// the polygon border should be drawn in the "col"
-// colour and filled with the "fill" colour.
-// If "col" is NA_INTEGER don't draw the border
-// If "fill" is NA_INTEGER don't fill the polygon
-// An example is ...
-//
-// static void X11_Polygon(int n, double *x, double *y,
-//                         const pGEcontext gc,
-//                         pDevDesc dd);
-//
-// R_GE_gcontext parameters that should be honoured (if possible):
-//   col, fill, gamma, lty, lwd
-//
-// @param n number of points in polygon
-// @param x,y n sets of coordinates
+// Hand a rect to the backend or R callback.  As 'send_line()'
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_polygon(int n, double *x, double *y, const pGEcontext gc, pDevDesc dd) {
+void send_rect(cdata_struct *cdata, double x0, double y0, double x1, double y1,
+               const pGEcontext gc, pDevDesc dd) {
 
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  if (cdata->backend != NULL && cdata->backend->rect != NULL) {
+    cdata->backend->rect(x0, y0, x1, y1, gc, dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "rect")) return;
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "polygon",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "rect",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
 
       Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("n") = n,
-        Rcpp::Named("x") = std::vector<double>(x, x+n),
-        Rcpp::Named("y") = std::vector<double>(y, y+n)
+        Rcpp::Named("x0") = tf_x(cdata, x0, dd),
+        Rcpp::Named("y0") = tf_y(cdata, y0, dd),
+        Rcpp::Named("x1") = tf_x(cdata, x1, dd),
+        Rcpp::Named("y1") = tf_y(cdata, y1, dd)
       )
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_polygon: " + ex_str);
+    Rcpp::warning("rdevice_rect: " + ex_str);
   }
 
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw a polyline
-//
-// device_Polyline should have the side-effect that a
-// series of line segments are drawn using the given x
-// and y values.
-// An example is ...
+// Draw what the LOD stage replaced a primitive with.  The replacement keeps
+// the primitive's gc, apart from its colours and line width.
 //
-// static void X11_Polyline(int n, double *x, double *y,
-//                          const pGEcontext gc,
-//                          pDevDesc dd);
-//
-// R_GE_gcontext parameters that should be honoured (if possible):
-//   col, gamma, lty, lwd
-//
-// @param n number of points in polyline
-// @param x,y n sets of coordinates
+// @return true if the primitive was replaced or dropped, false if it
+//         should be drawn as usual
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_polyline(int n, double *x, double *y, const pGEcontext gc, pDevDesc dd) {
-
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
-
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "polyline",
+bool lod_draw(cdata_struct *cdata, const lod_result &lod, const pGEcontext gc, pDevDesc dd) {
+  if (lod.action == LOD_KEEP) return false;
+  if (lod.action == LOD_DROP) return true;
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  R_GE_gcontext lgc = *gc;
+#if R_GE_definitions > 12
+  lgc.patternFill   = R_NilValue;
+#endif
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("n") = n,
-        Rcpp::Named("x") = std::vector<double>(x, x+n),
-        Rcpp::Named("y") = std::vector<double>(y, y+n)
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("polyline: " + ex_str);
+  if (lod.action == LOD_PIXEL) {
+    lgc.col  = R_TRANWHITE;
+    lgc.fill = lod.col;
+    send_rect(cdata, lod.x0, lod.y0, lod.x1, lod.y1, &lgc, dd);
+  } else {
+    lgc.col  = lod.col;
+    lgc.lwd  = lod.lwd;
+    lgc.lty  = LTY_SOLID;
+    send_line(cdata, lod.x0, lod.y0, lod.x1, lod.y1, &lgc, dd);
   }
 
+  return true;
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Add a raster (image)
-//
-// device_Raster should draw a raster image justified
-// at the given location,
-// size, and rotation (not all devices may be able to rotate?)
-//
-// 'raster' gives the image data BY ROW, with every four bytes
-// giving one R colour (ABGR).
-//
-// 'x and 'y' give the bottom-left corner.
+// Draw a single circle
+
+// device_Circle should have the side-effect that a
+// circle is drawn, centred at the given location, with
+// the given radius.
+// (If the device has non-square pixels, 'radius' should
+// be interpreted in the units of the x direction.)
+// The border of the circle should be
+// drawn in the given "col", and the circle should be
+// filled with the given "fill" colour.
+// If "col" is NA_INTEGER then no border should be drawn
+// If "fill" is NA_INTEGER then the circle should not
+// be filled.
 //
-// 'rot' is in degrees (as per device_Text), with positive
-// rotation anticlockwise from the positive x-axis.
+// graphics parameters that should be honoured (if possible):
+//   col, fill, gamma, lty, lwd
 //
-// As from R 2.13.2 this can be left unimplemented as NULL.
+// @param x,y coords of centre
+// @param r radius
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_raster(unsigned int *raster, int w, int h,
-                    double x, double y, double width, double height,
-                    double rot, Rboolean interpolate,
-                    const pGEcontext gc, pDevDesc dd) {
-
+void rdevice_circle(double x, double y, double r, const pGEcontext gc, pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->circle(native_gc(cdata, gc), x, y, r);
+    if (dl == cdata->capture) return;
+  }
+
+  if (cdata->lod != NULL && lod_draw(cdata, cdata->lod->circle(x, y, r, gc, dd), gc, dd)) {
+    return;
+  }
+
+  if (cdata->backend != NULL && cdata->backend->circle != NULL) {
+    cdata->backend->circle(x, y, r, gc, dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "circle")) return;
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "raster",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "circle",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
 
       Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("raster")      = std::vector<int>(raster, raster + w*h),
-        Rcpp::Named("w")           = w,
-        Rcpp::Named("h")           = h,
-        Rcpp::Named("x")           = x,
-        Rcpp::Named("y")           = y,
-        Rcpp::Named("width")       = width,
-        Rcpp::Named("height")      = height,
-        Rcpp::Named("rot")         = rot,
-        Rcpp::Named("interpolate") = (bool)interpolate
+        Rcpp::Named("x") = tf_x(cdata, x, dd),
+        Rcpp::Named("y") = tf_y(cdata, y, dd),
+        Rcpp::Named("r") = tf_radius(cdata, r, dd)
       )
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_raster: " + ex_str);
+    Rcpp::warning("rdevice_circle: " + ex_str);
   }
 
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw a single rectangle
+// Set clipping box
 //
-// device_Rect should have the side-effect that a
-// rectangle is drawn with the given locations for its
-// opposite corners.  The border of the rectangle
-// should be in the given "col" colour and the rectangle
-// should be filled with the given "fill" colour.
-// If "col" is NA_INTEGER then no border should be drawn
-// If "fill" is NA_INTEGER then the rectangle should not
-// be filled.
+// device_Clip is given the left, right, bottom, and
+// top of a rectangle (in DEVICE coordinates).
+// It should have the side-effect that subsequent output
+// is clipped to the given rectangle.
+// NOTE that R's graphics engine already clips to the
+// extent of the device.
+// NOTE also that this will probably only be called if
+// the flag canClip is true.
 //
-// @param x0,y0,x1,y1 limits of rectangle
+// @param x0,y0,x1,y1 limits of clipping
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_rect(double x0, double y0, double x1, double y1,
-                  const pGEcontext gc, pDevDesc dd) {
-
+void rdevice_clip(double x0, double x1, double y0, double y1, pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  // A clipping rectangle replaces any clipping path
+  cdata->clip_hash = 0;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->clip(native_gc(cdata, NULL), x0, x1, y0, y1);
+    if (dl == cdata->capture) return;
+  }
+
+  if (cdata->backend != NULL && cdata->backend->clip != NULL) {
+    cdata->backend->clip(x0, x1, y0, y1, dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "clip")) return;
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "rect",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "clip",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd),
 
       Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("x0") = x0,
-        Rcpp::Named("y0") = y0,
-        Rcpp::Named("x1") = x1,
-        Rcpp::Named("y1") = y1
+        Rcpp::Named("x0") = tf_x(cdata, x0, dd),
+        Rcpp::Named("y0") = tf_y(cdata, y0, dd),
+        Rcpp::Named("x1") = tf_x(cdata, x1, dd),
+        Rcpp::Named("y1") = tf_y(cdata, y1, dd)
       )
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_rect: " + ex_str);
+    Rcpp::warning("rdevice_clip: " + ex_str);
   }
 
 }
 
 
-
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Return information about the device size
+// Called when 'dev.off()' is called
 //
-// device_Size is called whenever the device is resized.
-// The function returns (left, right, bottom, and top) for the
-// new device size.
-// This is not usually called directly by the graphics
-// engine because the detection of device resizes
-// (e.g., a window resize) are usually detected by
-// device-specific code.
-//
-// As from R 2.13.2 this can be left unimplemented as NULL.
-//
-// @return left, right, bottom, top. numeric values representing the size of the device
+// device_Close is called when the device is killed.
+// This function is responsible for destroying any
+// device-specific resources that were created in
+// device_Open and for FREEing the device-specific
+// parameters structure.
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_size(double *left, double *right, double *bottom, double *top,
-                  pDevDesc dd) {
+void rdevice_close(pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  std::string hash = finish_page_hash(cdata);
+  finish_page_prims(cdata);
+  publish_frame(cdata);
+  rdevice_flushPage(dd);
+
+  Rcpp::List args;
+  if (!hash.empty()) {
+    args["hash"] = hash;
+  }
+
+  if (cdata->backend != NULL && cdata->backend->close != NULL) {
+    cdata->backend->close(dd, cdata->backend->user);
+  } else {
+    try {
+      res = rcallback(cdata,
+        Rcpp::Named("device_call") = "close",
+
+        Rcpp::Named("state") = callback_state(cdata, dd),
+
+        Rcpp::Named("args") = args
+      );
+    } catch(std::exception &ex) {
+      std::string ex_str = ex.what();
+      Rcpp::warning("rdevice_close: " + ex_str);
+    }
+  }
+
+  try {
+    device_rdata_update(cdata, false);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_close: " + ex_str);
+  }
+
+  // Release any functions held by cached definitions
+  definition_release(&cdata->patterns  , NA_INTEGER, NULL);
+  definition_release(&cdata->clip_paths, NA_INTEGER, NULL);
+  definition_release(&cdata->masks     , NA_INTEGER, NULL);
+  definition_release(&cdata->groups    , NA_INTEGER, NULL);
+
+  // Release the SEXP object to be garbage collected.
+  R_ReleaseObject(cdata->rdata);
+  if (cdata->pages != NULL) R_ReleaseObject(cdata->pages_ref);
+
+  // Wait for the workers to write out all pages before closing the sink
+  if (cdata->pipeline != NULL) {
+    cdata->pipeline->finish();
+    std::string err = cdata->pipeline->take_errors();
+    if (!err.empty()) {
+      Rcpp::warning("rdevice_close: " + err);
+    }
+    delete cdata->pipeline;
+  }
+
+  if (cdata->sink != NULL) {
+    cdata->sink->close();
+    delete cdata->sink;
+  }
+
+  delete cdata->log;
+  delete cdata->hasher;
+  delete cdata->prims;
+  delete cdata->fb;
+  delete cdata->strings;
+  delete cdata->geometries;
+  delete cdata->lod;
+  delete cdata->backend;
+
+  // free the memory we had assigned for the cdata
+  delete(cdata);
+}
 
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// device_Deactivate is called when a device becomes
+// inactive.
+// This allows the device to undo anything it did in
+// dev_Activate.
+// Not all device types will do anything.
+//
+// As from R 2.14.0 this can be omitted or set to NULL.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_deactivate(pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  if (cdata->backend != NULL && cdata->backend->deactivate != NULL) {
+    cdata->backend->deactivate(dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "deactivate")) return;
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "size",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "deactivate",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd),
 
       Rcpp::Named("args") = Rcpp::List()
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_size: " + ex_str);
+    Rcpp::warning("rdevice_deactivate: " + ex_str);
   }
 
+}
 
 
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that, otherwise use
-  // a dodgy default.
-  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("left")) {
-    *left = (Rcpp::as<double>(res["left"]));
-  } else {
-    *left   = dd->left;
-  }
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// eventHelper(dd, 1) is called by do_getGraphicsEvent before looking for a
+// graphics event.  It will then call R_ProcessEvents() and eventHelper(dd, 2)
+// until this or another device returns sets a non-null result value in eventEnv,
+// at which time eventHelper(dd, 0) will be called.
+//
+// Can be left unimplemented as NULL
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_eventHelper(pDevDesc dd, int code) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
 
-  if (res.containsElementNamed("right")) {
-    *right = (Rcpp::as<double>(res["right"]));
-  } else {
-    *right  = dd->right;
-  }
+  if (!wants_call(cdata, "eventHelper")) return;
 
-  if (res.containsElementNamed("bottom")) {
-    *bottom = (Rcpp::as<double>(res["bottom"]));
-  } else {
-    *bottom = dd->bottom;
-  }
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "eventHelper",
 
-  if (res.containsElementNamed("top")) {
-    *top = (Rcpp::as<double>(res["top"]));
-  } else {
-    *top    = dd->top;
+      Rcpp::Named("state") = callback_state(cdata, dd),
+
+      Rcpp::Named("args") = Rcpp::List::create(
+        Rcpp::Named("code") = code
+      )
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_eventHelper: " + ex_str);
   }
+
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Calculate and return the string width in the current state
-//
-// device_StrWidth should return the width of the given
-// string in DEVICE units.
+// added in 2.14.0, only used by screen devices.
 //
-// R_GE_gcontext parameters that should be honoured (if possible):
-//   font, cex, ps
+// Allows graphics devices to have multiple levels of suspension:
+// when this reaches zero output is flushed.
 //
-// @param str string
+// Can be left unimplemented as NULL.
 //
-// @return Optionally return 'width' the display width of the string in device units (numeric).
-//         If not returned then a default value is used i.e. (strlen(str) + 2) * 72
+// @return optional 'level' (integer). Be careful, I don't have any idea on
+// what this does!
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-double rdevice_strWidth(const char *str, const pGEcontext gc, pDevDesc dd) {
-
+int rdevice_holdflush(pDevDesc dd, int level) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  // 'level' is the change in hold level. Show the page once fully released
+  cdata->hold_level = std::max(0, cdata->hold_level + level);
+  if (level < 0 && cdata->hold_level == 0) {
+    publish_frame(cdata);
+  }
+
+  if (cdata->backend != NULL && cdata->backend->holdflush != NULL) {
+    return cdata->backend->holdflush(dd, level, cdata->backend->user);
+  }
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "strWidth",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "holdflush",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd),
 
       Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("str") = std::string(str)
+        Rcpp::Named("level") = level
       )
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_strWidth: " + ex_str);
+    Rcpp::warning("rdevice_holdflush: " + ex_str);
   }
 
+
+
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that, otherwise use
-  // a dodgy default.
+  // If user has supplied a return value, then use that
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("width")) {
-    return Rcpp::as<double>(res["width"]);
+  if (res.containsElementNamed("level")) {
+    return Rcpp::as<int>(res["level"]);
   } else {
-    return (strlen(str) + 2) * gc->cex * gc->ps;
+    return 0;
   }
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// str width in UTF8 directly (if 'hasTextUTF8' = TRUE)
+// Draw a single line
 //
-// Some devices can plot UTF-8 text directly without converting
-// to the native encoding, e.g. windows(), quartz() ....
+// device_Line should have the side-effect that a single
+// line is drawn (from x1,y1 to x2,y2)
 //
-// If this flag is true, all text *not in the symbol font* is sent
-// in UTF8 to the textUTF8/strWidthUTF8 entry points.
+// R_GE_gcontext parameters that should be honoured (if possible):
+//   col, gamma, lty, lwd
 //
-// If the flag is TRUE, the metricInfo entry point should
-// accept negative values for 'c' and treat them as indicating
-// Unicode points (as well as positive values in a MBCS locale).
+// @param x1,y1,x2,y2 endpoint coordinates (double)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_line(double x1, double y1, double x2, double y2,
+                  const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->line(native_gc(cdata, gc), x1, y1, x2, y2);
+    if (dl == cdata->capture) return;
+  }
+
+  if (cdata->lod != NULL && lod_draw(cdata, cdata->lod->line(x1, y1, x2, y2, gc, dd), gc, dd)) {
+    return;
+  }
+
+  send_line(cdata, x1, y1, x2, y2, gc, dd);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// device_Locator should return the location of the next
+// mouse click (in DEVICE coordinates)
+// Not all devices will do anything (e.g., postscript)
 //
-// @param str string
+// As from R 2.14.0 this can be omitted or set to NULL.
+//
+// @return x,y location in device coordinates (double).
 //
-// @return 'width' the display width of the string in device units (numeric)
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-double rdevice_strWidthUTF8(const char *str, const pGEcontext gc, pDevDesc dd) {
-
+Rboolean rdevice_locator(double *x, double *y, pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
   Rcpp::List res;
 
+  if (cdata->backend != NULL && cdata->backend->locator != NULL) {
+    return cdata->backend->locator(x, y, dd, cdata->backend->user);
+  }
+
   try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "strWidthUTF8",
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "locator",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+      Rcpp::Named("state") = callback_state(cdata, dd),
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("str") = std::string(str)
-      )
+      Rcpp::Named("args") = Rcpp::List()
     );
     handle_return_values_from_R(res, dd);
   } catch(std::exception &ex) {
     std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_strWidthUTF8: " + ex_str);
+    Rcpp::warning("rdevice_locator: " + ex_str);
   }
 
+
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  // If user has supplied a return value, then use that, otherwise use
-  // a dodgy default.
+  // If user has supplied a return value, then use that
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  if (res.containsElementNamed("width")) {
-    return Rcpp::as<double>(res["width"]);
+  if (res.containsElementNamed("x") && res.containsElementNamed("y")) {
+    *x = Rcpp::as<double>(res["x"]);
+    *y = Rcpp::as<double>(res["y"]);
+    return TRUE;
   } else {
-    return (strlen(str) + 2) * gc->cex * gc->ps;
+    *x = 0;
+    *y = 0;
+    return FALSE;
   }
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw text
+// Return information about the current font settings?
 //
-// device_Text should have the side-effect that the
-// given text is drawn at the given location.
-// The text should be rotated according to rot (degrees)
-
+// device_MetricInfo should return height, depth, and
+// width information for the given character in DEVICE
+// units.
+// Note: in an 8-bit locale, c is 'char'.
+// In an mbcslocale, it is wchar_t, and at least some
+// of code assumes that is UCS-2 (Windows, true) or UCS-4.
+// This is used for formatting mathematical expressions
+// and for exact centering of text (see GText)
+// If the device cannot provide metric information then
+// it MUST return 0.0 for ascent, descent, and width.
 //
 // R_GE_gcontext parameters that should be honoured (if possible):
-//   font, cex, ps, col, gamma
+//   font, cex, ps
 //
-// @param x,y location of text (double)
-// @param str string
-// @param rot text rotation (degrees)
-// @param hadj horizontal adjustment (double)
+// @param c single character. Could be unicode
+//
+// @return ascent, descent and width (double)
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_text(double x, double y, const char *str, double rot,
-                  double hadj, const pGEcontext gc, pDevDesc dd) {
+void rdevice_metricInfo(int c, const pGEcontext gc, double* ascent,
+                        double* descent, double* width, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  if (cdata->backend != NULL && cdata->backend->metricInfo != NULL) {
+    cdata->backend->metricInfo(c, gc, ascent, descent, width, dd, cdata->backend->user);
+    return;
+  }
+
+  if (wants_call(cdata, "metricInfo")) {
+    try {
+      res = rcallback(cdata,
+        Rcpp::Named("device_call") = "metricInfo",
+
+        Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+        Rcpp::Named("args") = Rcpp::List::create(
+          Rcpp::Named("c") = c
+        )
+      );
+      handle_return_values_from_R(res, dd);
+    } catch(std::exception &ex) {
+      std::string ex_str = ex.what();
+      Rcpp::warning("rdevice_metricInfo: " + ex_str);
+    }
+  }
+
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // If user has supplied a return value, then use that, otherwise use
+  // a dodgy default.
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  if (res.containsElementNamed("ascent")) {
+    *ascent = (Rcpp::as<double>(res["ascent"]));
+  } else {
+    *ascent  = 0.0 * 72;
+  }
+
+  if (res.containsElementNamed("descent")) {
+    *descent = (Rcpp::as<double>(res["descent"]));
+  } else {
+    *descent  = 0.0 * 72;
+  }
+
+  if (res.containsElementNamed("width")) {
+    *width = (Rcpp::as<double>(res["width"]));
+  } else {
+    *width  = 0.0 * 72;
+  }
+
+}
+
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// device_Mode is called whenever the graphics engine
+// starts drawing (mode=1) or stops drawing (mode=0)
+// GMode (in graphics.c) also says that
+// mode = 2 (graphical input on) exists.
+// The device is not required to do anything
+//
+// static void X11_Mode(int mode, pDevDesc dd);
+//
+// As from R 2.14.0 this can be omitted or set to NULL.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_mode(int mode, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  // The engine has finished drawing for now. Let a live reader catch up
+  if (mode == 0) {
+    flush_prims(cdata);
+    if (cdata->log != NULL) cdata->log->flush();
+  }
+
+  if (cdata->backend != NULL && cdata->backend->mode != NULL) {
+    cdata->backend->mode(mode, dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "mode")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "mode",
+
+      Rcpp::Named("state") = callback_state(cdata, dd),
+
+      Rcpp::Named("args") = Rcpp::List::create(
+        Rcpp::Named("mode") = mode
+      )
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_mode: " + ex_str);
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Does the device have a device-specific way to confirm a
+// new frame (for e.g. par(ask=TRUE))?
+// This should be NULL if it does not.
+// If it does, it returns TRUE if the device handled this, and
+// FALSE if it wants the engine to do so.
+//
+// There is an example in the windows() device.
+//
+// Can be left unimplemented as NULL.
+//
+// @return Option: logical value. Defaults to FALSE if no return value supplied.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rboolean rdevice_newFrameConfirm(pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "newFrameConfirm",
+
+      Rcpp::Named("state") = callback_state(cdata, dd),
+
+      Rcpp::Named("args") = Rcpp::List()
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_newFrameConfirm: " + ex_str);
+  }
+
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // If user has supplied a return value, then use that, otherwise use
+  // a dodgy default.
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  if (res.containsElementNamed("is_device_specific")) {
+    return (Rboolean) (Rcpp::as<int>(res["is_device_specific"]));
+  } else {
+    return (Rboolean) 0;
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Start a new page
+//
+// device_NewPage is called whenever a new plot requires
+// a new page.
+// A new page might mean just clearing the
+// device (e.g., X11) or moving to a new page
+// (e.g., postscript)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_newPage(const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  // When streaming, the previous page is finished: write it out before the
+  // callback starts on (and clears its state for) the new one
+  std::string hash = finish_page_hash(cdata);
+  finish_page_prims(cdata);
+  publish_frame(cdata);
+  rdevice_flushPage(dd);
+  cdata->page++;
+  cdata->clip_hash = 0;
+  cdata->mask_hash = 0;
+
+  if (cdata->lod != NULL) {
+    cdata->lod->touch();
+  }
+
+  if (cdata->log != NULL) {
+    cdata->log->flush();
+  }
+
+  if (cdata->fb != NULL) {
+    cdata->fb_page.dl.clear();
+    cdata->fb_page.bg     = gc->fill;
+    cdata->fb_page.left   = dd->left;
+    cdata->fb_page.right  = dd->right;
+    cdata->fb_page.bottom = dd->bottom;
+    cdata->fb_page.top    = dd->top;
+  }
+
+  if (cdata->pipeline != NULL) {
+    cdata->stream_page.bg     = gc->fill;
+    cdata->stream_page.left   = dd->left;
+    cdata->stream_page.right  = dd->right;
+    cdata->stream_page.bottom = dd->bottom;
+    cdata->stream_page.top    = dd->top;
+  }
+
+  if (cdata->pages != NULL) {
+    dl_page page;
+    page.bg     = gc->fill;
+    page.left   = dd->left;
+    page.right  = dd->right;
+    page.bottom = dd->bottom;
+    page.top    = dd->top;
+    cdata->pages->pages.push_back(page);
+  }
+
+  if (cdata->hasher != NULL || cdata->prims != NULL) {
+    dl_page page;
+    page.bg     = gc->fill;
+    page.left   = dd->left;
+    page.right  = dd->right;
+    page.bottom = dd->bottom;
+    page.top    = dd->top;
+    if (cdata->hasher != NULL) cdata->hasher->begin(page);
+    if (cdata->prims  != NULL) cdata->prims->begin_page(cdata->page, page);
+    cdata->pending_page.clear();
+    cdata->consumed_ops = 0;
+  }
+
+  // 'hash' is the hash of the page just finished
+  Rcpp::List args;
+  if (!hash.empty()) {
+    args["hash"] = hash;
+  }
+
+  if (cdata->backend != NULL && cdata->backend->newPage != NULL) {
+    cdata->backend->newPage(gc, dd, cdata->backend->user);
+    return;
+  }
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "newPage",
+
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+      Rcpp::Named("args") = args
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("newPage: " + ex_str);
+  }
+
+}
+
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// device_onExit is called by GEonExit when the user has aborted
+// some operation, and so an R_ProcessEvents call may not return normally.
+// It need not be set to any value; if null, it will not be called.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_onExit(pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  if (!wants_call(cdata, "onExit")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "onExit",
+
+      Rcpp::Named("state") = callback_state(cdata, dd),
+
+      Rcpp::Named("args") = Rcpp::List()
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("onExit: " + ex_str);
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// With rdevice(geometry_cache = TRUE), the id of a polyline/polygon/path's
+// vertices.  The backend (if it wants to know) is told before it is sent
+// the call itself.  'first' is set if the vertices haven't been seen
+// before.
+//
+// @return the id, or NA_INTEGER if there is no cache (or it is full)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int lookup_geometry(cdata_struct *cdata, int kind, int n, double *x, double *y,
+                    int npoly, int *nper, bool *first, pDevDesc dd) {
+  *first = true;
+  if (cdata->geometries == NULL) return NA_INTEGER;
+
+  int id = cdata->geometries->lookup(kind, n, x, y, npoly, nper, first);
+
+  if (cdata->backend != NULL && cdata->backend->geometry != NULL) {
+    cdata->backend->geometry(id, *first ? TRUE : FALSE, dd, cdata->backend->user);
+  }
+
+  return id;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The vertices from the last 'lookup_geometry()' have been delivered, so
+// later calls can refer to them by id alone
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void commit_geometry(cdata_struct *cdata) {
+  if (cdata->geometries != NULL) {
+    cdata->geometries->commit();
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Arguments for the polyline and polygon calls.  With the geometry cache,
+// 'geometry_id' is added and 'x' and 'y' are NULL for vertices the
+// callback has already been sent
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::List vertex_args(cdata_struct *cdata, int n, double *x, double *y,
+                       int id, bool first, pDevDesc dd) {
+  if (cdata->geometries == NULL) {
+    return Rcpp::List::create(
+      Rcpp::Named("n") = n,
+      Rcpp::Named("x") = transform_coords(&cdata->transform, x, n, AXIS_X, dd),
+      Rcpp::Named("y") = transform_coords(&cdata->transform, y, n, AXIS_Y, dd)
+    );
+  }
+
+  if (!first && id != NA_INTEGER) {
+    return Rcpp::List::create(
+      Rcpp::Named("n")           = n,
+      Rcpp::Named("x")           = R_NilValue,
+      Rcpp::Named("y")           = R_NilValue,
+      Rcpp::Named("geometry_id") = id
+    );
+  }
+
+  return Rcpp::List::create(
+    Rcpp::Named("n")           = n,
+    Rcpp::Named("x")           = transform_coords(&cdata->transform, x, n, AXIS_X, dd),
+    Rcpp::Named("y")           = transform_coords(&cdata->transform, y, n, AXIS_Y, dd),
+    Rcpp::Named("geometry_id") = id
+  );
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Arguments for the path call.  As 'vertex_args()'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::List path_args(cdata_struct *cdata, double *x, double *y, int n, int npoly, int *nper,
+                     Rboolean winding, int id, bool first, pDevDesc dd) {
+  if (cdata->geometries == NULL) {
+    return Rcpp::List::create(
+      Rcpp::Named("x")       = transform_coords(&cdata->transform, x, n, AXIS_X, dd),
+      Rcpp::Named("y")       = transform_coords(&cdata->transform, y, n, AXIS_Y, dd),
+      Rcpp::Named("npoly")   = npoly,
+      Rcpp::Named("nper")    = std::vector<int>(nper, nper+npoly),
+      Rcpp::Named("winding") = (bool)winding
+    );
+  }
+
+  if (!first && id != NA_INTEGER) {
+    return Rcpp::List::create(
+      Rcpp::Named("x")           = R_NilValue,
+      Rcpp::Named("y")           = R_NilValue,
+      Rcpp::Named("npoly")       = npoly,
+      Rcpp::Named("nper")        = std::vector<int>(nper, nper+npoly),
+      Rcpp::Named("winding")     = (bool)winding,
+      Rcpp::Named("geometry_id") = id
+    );
+  }
+
+  return Rcpp::List::create(
+    Rcpp::Named("x")           = transform_coords(&cdata->transform, x, n, AXIS_X, dd),
+    Rcpp::Named("y")           = transform_coords(&cdata->transform, y, n, AXIS_Y, dd),
+    Rcpp::Named("npoly")       = npoly,
+    Rcpp::Named("nper")        = std::vector<int>(nper, nper+npoly),
+    Rcpp::Named("winding")     = (bool)winding,
+    Rcpp::Named("geometry_id") = id
+  );
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw a path.
+//
+// device_Path should draw one or more sets of points
+// as a single path
+//
+// 'x' and 'y' give the points
+//
+// 'npoly' gives the number of polygons in the path
+// MUST be at least 1
+//
+// 'nper' gives the number of points in each polygon
+// each value MUST be at least 2
+//
+// 'winding' says whether to fill using the nonzero
+// winding rule or the even-odd rule
+//
+// Added 2010-06-27
+//
+// As from R 2.13.2 this can be left unimplemented as NULL.
+//
+// @param x,y vectors of coordiates - enough to cover all the polygons each
+//            with its respective nper
+// @param npoly Number of polygons = number of elements in "nper"
+// @param nper Number of elements in each particular polygon
+// @param winding winding order. whehter to fill or not fill.  currently unused in ascii()
+//        According to svglite::svg_path():
+//             0 = false = evenodd
+//             1 = true  = nonzero
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_path(double *x, double *y, int npoly, int *nper,
+                  Rboolean winding, const pGEcontext gc, pDevDesc dd) {
+
+  int total_coords = 0;
+  for (int i = 0; i < npoly; i++) {
+    total_coords += nper[i];
+  }
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->path(native_gc(cdata, gc), x, y, npoly, nper, winding);
+    if (dl == cdata->capture) return;
+  }
+
+  bool first;
+  int  geometry_id = lookup_geometry(cdata, GEOMETRY_PATH, total_coords, x, y, npoly, nper,
+                                     &first, dd);
+
+  if (cdata->backend != NULL && cdata->backend->path != NULL) {
+    cdata->backend->path(x, y, npoly, nper, winding, gc, dd, cdata->backend->user);
+    commit_geometry(cdata);
+    return;
+  }
+
+  if (!wants_call(cdata, "path")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "path",
+
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+      Rcpp::Named("args") = path_args(cdata, x, y, total_coords, npoly, nper, winding,
+                                      geometry_id, first, dd)
+    );
+    commit_geometry(cdata);
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_path: " + ex_str);
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw a polygon
+//
+// device_Polygon should have the side-effect that a
+// polygon is drawn using the given x and y values
+// the polygon border should be drawn in the "col"
+// colour and filled with the "fill" colour.
+// If "col" is NA_INTEGER don't draw the border
+// If "fill" is NA_INTEGER don't fill the polygon
+// An example is ...
+//
+// static void X11_Polygon(int n, double *x, double *y,
+//                         const pGEcontext gc,
+//                         pDevDesc dd);
+//
+// R_GE_gcontext parameters that should be honoured (if possible):
+//   col, fill, gamma, lty, lwd
+//
+// @param n number of points in polygon
+// @param x,y n sets of coordinates
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_polygon(int n, double *x, double *y, const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->polygon(native_gc(cdata, gc), n, x, y);
+    if (dl == cdata->capture) return;
+  }
+
+  bool first;
+  int  geometry_id = lookup_geometry(cdata, GEOMETRY_POLYGON, n, x, y, 0, NULL, &first, dd);
+
+  if (cdata->backend != NULL && cdata->backend->polygon != NULL) {
+    cdata->backend->polygon(n, x, y, gc, dd, cdata->backend->user);
+    commit_geometry(cdata);
+    return;
+  }
+
+  if (!wants_call(cdata, "polygon")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "polygon",
+
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+      Rcpp::Named("args") = vertex_args(cdata, n, x, y, geometry_id, first, dd)
+    );
+    commit_geometry(cdata);
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_polygon: " + ex_str);
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw a polyline
+//
+// device_Polyline should have the side-effect that a
+// series of line segments are drawn using the given x
+// and y values.
+// An example is ...
+//
+// static void X11_Polyline(int n, double *x, double *y,
+//                          const pGEcontext gc,
+//                          pDevDesc dd);
+//
+// R_GE_gcontext parameters that should be honoured (if possible):
+//   col, gamma, lty, lwd
+//
+// @param n number of points in polyline
+// @param x,y n sets of coordinates
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_polyline(int n, double *x, double *y, const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->polyline(native_gc(cdata, gc), n, x, y);
+    if (dl == cdata->capture) return;
+  }
+
+  bool first;
+  int  geometry_id = lookup_geometry(cdata, GEOMETRY_POLYLINE, n, x, y, 0, NULL, &first, dd);
+
+  if (cdata->backend != NULL && cdata->backend->polyline != NULL) {
+    cdata->backend->polyline(n, x, y, gc, dd, cdata->backend->user);
+    commit_geometry(cdata);
+    return;
+  }
+
+  if (!wants_call(cdata, "polyline")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "polyline",
+
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+      Rcpp::Named("args") = vertex_args(cdata, n, x, y, geometry_id, first, dd)
+    );
+    commit_geometry(cdata);
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("polyline: " + ex_str);
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Add a raster (image)
+//
+// device_Raster should draw a raster image justified
+// at the given location,
+// size, and rotation (not all devices may be able to rotate?)
+//
+// 'raster' gives the image data BY ROW, with every four bytes
+// giving one R colour (ABGR).
+//
+// 'x and 'y' give the bottom-left corner.
+//
+// 'rot' is in degrees (as per device_Text), with positive
+// rotation anticlockwise from the positive x-axis.
+//
+// As from R 2.13.2 this can be left unimplemented as NULL.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_raster(unsigned int *raster, int w, int h,
+                    double x, double y, double width, double height,
+                    double rot, Rboolean interpolate,
+                    const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->raster(native_gc(cdata, gc), raster, w, h, x, y, width, height, rot, interpolate);
+    if (dl == cdata->capture) return;
+  }
+
+  if (cdata->backend != NULL && cdata->backend->raster != NULL) {
+    cdata->backend->raster(raster, w, h, x, y, width, height, rot, interpolate, gc, dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "raster")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "raster",
+
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+      Rcpp::Named("args") = Rcpp::List::create(
+        Rcpp::Named("raster")      = std::vector<int>(raster, raster + w*h),
+        Rcpp::Named("w")           = w,
+        Rcpp::Named("h")           = h,
+        Rcpp::Named("x")           = tf_x(cdata, x, dd),
+        Rcpp::Named("y")           = tf_y(cdata, y, dd),
+        Rcpp::Named("width")       = tf_len(cdata, width , AXIS_X, dd),
+        Rcpp::Named("height")      = tf_len(cdata, height, AXIS_Y, dd),
+        Rcpp::Named("rot")         = rot,
+        Rcpp::Named("interpolate") = (bool)interpolate
+      )
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_raster: " + ex_str);
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw a single rectangle
+//
+// device_Rect should have the side-effect that a
+// rectangle is drawn with the given locations for its
+// opposite corners.  The border of the rectangle
+// should be in the given "col" colour and the rectangle
+// should be filled with the given "fill" colour.
+// If "col" is NA_INTEGER then no border should be drawn
+// If "fill" is NA_INTEGER then the rectangle should not
+// be filled.
+//
+// @param x0,y0,x1,y1 limits of rectangle
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_rect(double x0, double y0, double x1, double y1,
+                  const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->rect(native_gc(cdata, gc), x0, y0, x1, y1);
+    if (dl == cdata->capture) return;
+  }
+
+  if (cdata->lod != NULL && lod_draw(cdata, cdata->lod->rect(x0, y0, x1, y1, gc, dd), gc, dd)) {
+    return;
+  }
+
+  send_rect(cdata, x0, y0, x1, y1, gc, dd);
+}
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Return information about the device size
+//
+// device_Size is called whenever the device is resized.
+// The function returns (left, right, bottom, and top) for the
+// new device size.
+// This is not usually called directly by the graphics
+// engine because the detection of device resizes
+// (e.g., a window resize) are usually detected by
+// device-specific code.
+//
+// As from R 2.13.2 this can be left unimplemented as NULL.
+//
+// @return left, right, bottom, top. numeric values representing the size of the device
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_size(double *left, double *right, double *bottom, double *top,
+                  pDevDesc dd) {
+
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  if (cdata->backend != NULL && cdata->backend->size != NULL) {
+    cdata->backend->size(left, right, bottom, top, dd, cdata->backend->user);
+    return;
+  }
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "size",
+
+      Rcpp::Named("state") = callback_state(cdata, dd),
+
+      Rcpp::Named("args") = Rcpp::List()
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_size: " + ex_str);
+  }
+
+
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // If user has supplied a return value, then use that, otherwise use
+  // a dodgy default.
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  if (res.containsElementNamed("left")) {
+    *left = (Rcpp::as<double>(res["left"]));
+  } else {
+    *left   = dd->left;
+  }
+
+  if (res.containsElementNamed("right")) {
+    *right = (Rcpp::as<double>(res["right"]));
+  } else {
+    *right  = dd->right;
+  }
+
+  if (res.containsElementNamed("bottom")) {
+    *bottom = (Rcpp::as<double>(res["bottom"]));
+  } else {
+    *bottom = dd->bottom;
+  }
+
+  if (res.containsElementNamed("top")) {
+    *top = (Rcpp::as<double>(res["top"]));
+  } else {
+    *top    = dd->top;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Arguments for the strWidth and text calls.  'str' comes from the device's
+// string table, so a label which is drawn over and over is only made into
+// an R string once.  With rdevice(string_ids = TRUE) its id is added as
+// 'str_id'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::List str_args(cdata_struct *cdata, const char *str) {
+  int id;
+  Rcpp::List args = Rcpp::List::create(
+    Rcpp::Named("str") = cdata->strings->get(str, &id)
+  );
+
+  if (cdata->string_ids) {
+    args.push_back(id, "str_id");
+  }
+  return args;
+}
+
+
+Rcpp::List text_args(cdata_struct *cdata, double x, double y, const char *str,
+                     double rot, double hadj, pDevDesc dd) {
+  int id;
+  Rcpp::List args = Rcpp::List::create(
+    Rcpp::Named("x")    = tf_x(cdata, x, dd),
+    Rcpp::Named("y")    = tf_y(cdata, y, dd),
+    Rcpp::Named("str")  = cdata->strings->get(str, &id),
+    Rcpp::Named("rot")  = rot,
+    Rcpp::Named("hadj") = hadj
+  );
+
+  if (cdata->string_ids) {
+    args.push_back(id, "str_id");
+  }
+  return args;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Calculate and return the string width in the current state
+//
+// device_StrWidth should return the width of the given
+// string in DEVICE units.
+//
+// R_GE_gcontext parameters that should be honoured (if possible):
+//   font, cex, ps
+//
+// @param str string
+//
+// @return Optionally return 'width' the display width of the string in device units (numeric).
+//         If not returned then a default value is used i.e. (strlen(str) + 2) * 72
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+double rdevice_strWidth(const char *str, const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  if (cdata->backend != NULL && cdata->backend->strWidth != NULL) {
+    return cdata->backend->strWidth(str, gc, dd, cdata->backend->user);
+  }
+
+  if (wants_call(cdata, "strWidth")) {
+    try {
+      res = rcallback(cdata,
+        Rcpp::Named("device_call") = "strWidth",
+
+        Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+        Rcpp::Named("args") = str_args(cdata, str)
+      );
+      handle_return_values_from_R(res, dd);
+    } catch(std::exception &ex) {
+      std::string ex_str = ex.what();
+      Rcpp::warning("rdevice_strWidth: " + ex_str);
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // If user has supplied a return value, then use that, otherwise use
+  // a dodgy default.
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  if (res.containsElementNamed("width")) {
+    return Rcpp::as<double>(res["width"]);
+  } else {
+    return (strlen(str) + 2) * gc->cex * gc->ps;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// str width in UTF8 directly (if 'hasTextUTF8' = TRUE)
+//
+// Some devices can plot UTF-8 text directly without converting
+// to the native encoding, e.g. windows(), quartz() ....
+//
+// If this flag is true, all text *not in the symbol font* is sent
+// in UTF8 to the textUTF8/strWidthUTF8 entry points.
+//
+// If the flag is TRUE, the metricInfo entry point should
+// accept negative values for 'c' and treat them as indicating
+// Unicode points (as well as positive values in a MBCS locale).
+//
+// @param str string
+//
+// @return 'width' the display width of the string in device units (numeric)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+double rdevice_strWidthUTF8(const char *str, const pGEcontext gc, pDevDesc dd) {
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  if (cdata->backend != NULL && cdata->backend->strWidthUTF8 != NULL) {
+    return cdata->backend->strWidthUTF8(str, gc, dd, cdata->backend->user);
+  }
+
+  if (wants_call(cdata, "strWidthUTF8")) {
+    try {
+      res = rcallback(cdata,
+        Rcpp::Named("device_call") = "strWidthUTF8",
+
+        Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+        Rcpp::Named("args") = str_args(cdata, str)
+      );
+      handle_return_values_from_R(res, dd);
+    } catch(std::exception &ex) {
+      std::string ex_str = ex.what();
+      Rcpp::warning("rdevice_strWidthUTF8: " + ex_str);
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // If user has supplied a return value, then use that, otherwise use
+  // a dodgy default.
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  if (res.containsElementNamed("width")) {
+    return Rcpp::as<double>(res["width"]);
+  } else {
+    return (strlen(str) + 2) * gc->cex * gc->ps;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw text
+//
+// device_Text should have the side-effect that the
+// given text is drawn at the given location.
+// The text should be rotated according to rot (degrees)
+
+//
+// R_GE_gcontext parameters that should be honoured (if possible):
+//   font, cex, ps, col, gamma
+//
+// @param x,y location of text (double)
+// @param str string
+// @param rot text rotation (degrees)
+// @param hadj horizontal adjustment (double)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_text(double x, double y, const char *str, double rot,
+                  double hadj, const pGEcontext gc, pDevDesc dd) {
+
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->text(native_gc(cdata, gc), x, y, str, rot, hadj, false);
+    if (dl == cdata->capture) return;
+  }
+
+  if (cdata->lod != NULL &&
+      lod_draw(cdata, cdata->lod->text(x, y, str, rot, hadj, gc, dd), gc, dd)) {
+    return;
+  }
+
+  if (cdata->backend != NULL && cdata->backend->text != NULL) {
+    cdata->backend->text(x, y, str, rot, hadj, gc, dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "text")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "text",
+
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+      Rcpp::Named("args") = text_args(cdata, x, y, str, rot, hadj, dd)
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("text: " + ex_str);
+  }
+}
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw text in UTF8 directly (if 'hasTextUTF8' = TRUE)
+//
+// Some devices can plot UTF-8 text directly without converting
+// to the native encoding, e.g. windows(), quartz() ....
+//
+// If this flag is true, all text *not in the symbol font* is sent
+// in UTF8 to the textUTF8/strWidthUTF8 entry points.
+//
+// If the flag is TRUE, the metricInfo entry point should
+// accept negative values for 'c' and treat them as indicating
+// Unicode points (as well as positive values in a MBCS locale).
+//
+// R_GE_gcontext parameters that should be honoured (if possible):
+//   font, cex, ps, col, gamma
+//
+// @param x,y location of text (double)
+// @param str string
+// @param rot text rotation (degrees)
+// @param hadj horizontal adjustment (double)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rdevice_textUTF8(double x, double y, const char *str, double rot,
+                      double hadj, const pGEcontext gc, pDevDesc dd) {
+
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  Rcpp::List res;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl->text(native_gc(cdata, gc), x, y, str, rot, hadj, true);
+    if (dl == cdata->capture) return;
+  }
+
+  if (cdata->lod != NULL &&
+      lod_draw(cdata, cdata->lod->text(x, y, str, rot, hadj, gc, dd), gc, dd)) {
+    return;
+  }
+
+  if (cdata->backend != NULL && cdata->backend->textUTF8 != NULL) {
+    cdata->backend->textUTF8(x, y, str, rot, hadj, gc, dd, cdata->backend->user);
+    return;
+  }
+
+  if (!wants_call(cdata, "textUTF8")) return;
+
+  try {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "textUTF8",
+
+      Rcpp::Named("state") = callback_state(cdata, dd, gc),
+
+      Rcpp::Named("args") = text_args(cdata, x, y, str, rot, hadj, dd)
+    );
+    handle_return_values_from_R(res, dd);
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_textUTF8: " + ex_str);
+  }
+
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Arguments for a 'glyph' device call
+//
+// @param font list of font information (file, index, family, ...)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::List glyph_args(cdata_struct *cdata, int n, const int *glyphs, const double *x,
+                      const double *y, Rcpp::List font, double size, int colour,
+                      double rot, pDevDesc dd) {
+  return Rcpp::List::create(
+    Rcpp::Named("glyphs") = std::vector<int>(glyphs, glyphs + n),
+    Rcpp::Named("x")      = transform_coords(&cdata->transform, x, n, AXIS_X, dd),
+    Rcpp::Named("y")      = transform_coords(&cdata->transform, y, n, AXIS_Y, dd),
+    Rcpp::Named("font")   = font,
+    Rcpp::Named("size")   = size,
+    Rcpp::Named("colour") = col_to_rgba(colour),
+    Rcpp::Named("rot")    = rot
+  );
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Fill a graphics context from a native snapshot.
+//
+// The pattern fill (R >= 4.1) is allocated and must be protected by the caller
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_to_gc(const dl_gc &dgc, pGEcontext gc) {
+  gc->col        = dgc.col;
+  gc->fill       = dgc.fill;
+  gc->gamma      = dgc.gamma;
+  gc->lwd        = dgc.lwd;
+  gc->lty        = dgc.lty;
+  gc->lend       = (R_GE_lineend)dgc.lend;
+  gc->ljoin      = (R_GE_linejoin)dgc.ljoin;
+  gc->lmitre     = dgc.lmitre;
+  gc->cex        = dgc.cex;
+  gc->ps         = dgc.ps;
+  gc->lineheight = dgc.lineheight;
+  gc->fontface   = dgc.fontface;
+  strncpy(gc->fontfamily, dgc.fontfamily.c_str(), 200);
+  gc->fontfamily[200] = '\0';
+#if R_GE_definitions > 12
+  gc->patternFill = dgc.pattern == NA_INTEGER ? R_NilValue : Rf_ScalarInteger(dgc.pattern);
+#endif
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Replay a native display list through the device i.e. each op becomes a
+// normal device call to the R callback (and is recorded again if there is
+// a native recording active)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void dl_replay(const dl_list &dl, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  R_GE_gcontext gc;
+
+  for (size_t i = 0; i < dl.ops.size(); i++) {
+    const dl_op &op  = dl.ops[i];
+    const dl_gc &dgc = dl.gcs[op.gc];
+
+    dl_to_gc(dgc, &gc);
+#if R_GE_definitions > 12
+    PROTECT(gc.patternFill);
+#endif
+
+    std::vector<double> x(dl.xs.begin() + op.start, dl.xs.begin() + op.start + op.n);
+    std::vector<double> y(dl.ys.begin() + op.start, dl.ys.begin() + op.start + op.n);
+    std::vector<int>    ints(dl.ints.begin() + op.istart, dl.ints.begin() + op.istart + op.ni);
+
+    switch(op.type) {
+    case DL_CIRCLE:
+      rdevice_circle(x[0], y[0], op.a, &gc, dd);
+      break;
+    case DL_LINE:
+      rdevice_line(x[0], y[0], x[1], y[1], &gc, dd);
+      break;
+    case DL_POLYLINE:
+      rdevice_polyline(op.n, x.data(), y.data(), &gc, dd);
+      break;
+    case DL_POLYGON:
+      rdevice_polygon(op.n, x.data(), y.data(), &gc, dd);
+      break;
+    case DL_PATH:
+      rdevice_path(x.data(), y.data(), op.ni, ints.data(), (Rboolean)op.flag, &gc, dd);
+      break;
+    case DL_RECT:
+      rdevice_rect(x[0], y[0], x[1], y[1], &gc, dd);
+      break;
+    case DL_TEXT:
+      if (op.flag) {
+        rdevice_textUTF8(x[0], y[0], dl.strings[op.str].c_str(), op.a, op.b, &gc, dd);
+      } else {
+        rdevice_text    (x[0], y[0], dl.strings[op.str].c_str(), op.a, op.b, &gc, dd);
+      }
+      break;
+    case DL_RASTER: {
+      std::vector<unsigned int> raster(dl.rasters[op.str]);
+      rdevice_raster(raster.data(), ints[0], ints[1], x[0], y[0], op.a, op.b, op.c,
+                     (Rboolean)op.flag, &gc, dd);
+      break;
+    }
+    case DL_CLIP:
+      rdevice_clip(x[0], x[1], y[0], y[1], dd);
+      break;
+    case DL_GLYPH: {
+      dl_list *target = native_target(cdata);
+      if (target != NULL) {
+        target->append_op(dl, op);
+        if (target == cdata->capture) break;
+      }
+      Rcpp::List font = Rcpp::List::create(
+        Rcpp::Named("file")  = dl.strings[op.str],
+        Rcpp::Named("index") = (int)op.c
+      );
+      rdevice_callback("glyph", glyph_args(cdata, op.n, ints.data(), x.data(), y.data(), font,
+                                           op.a, dgc.col, op.b, dd), dd);
+      break;
+    }
+    default:
+      break;
+    }
+
+#if R_GE_definitions > 12
+    UNPROTECT(1);
+#endif
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Reference:
+// https://developer.r-project.org/Blog/public/2020/07/15/new-features-in-the-r-graphics-engine/index.html
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#if R_GE_definitions > 12
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Evaluate the R function which draws the content of a tiling pattern,
+// clipping path or mask.  All drawing is passed to the callback as normal
+// device calls.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void definition_draw(SEXP fn, const char *device_call) {
+  try {
+    Rcpp::Function draw(fn);
+    draw();
+  } catch(std::exception &ex) {
+    std::string ex_str = ex.what();
+    Rcpp::warning("rdevice_" + std::string(device_call) + ": " + ex_str);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// As definition_draw(), and hash what was drawn (with 'params') so that
+// primitives using the definition hash by its content, not its handle
+//
+// @return content hash (see dl_content_hash())
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+uint64_t definition_draw_hashed(cdata_struct *cdata, SEXP fn, const char *device_call,
+                                const std::vector<double> &params) {
+  dl_list *dl;
+  if (cdata->capture != NULL) {
+    dl = cdata->capture;
+  } else if (!cdata->group_stack.empty()) {
+    dl = &cdata->group_lists[cdata->group_stack.back()];
+  } else {
+    dl = page_target(cdata);
+  }
+  size_t from = dl == NULL ? 0 : dl->ops.size();
+
+  cdata->defining++;
+  definition_draw(fn, device_call);
+  cdata->defining--;
+
+  return dl_content_hash(dl, from, params);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Convert a pattern's 'extend' value to a string
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string extend_to_string(int extend) {
+  switch(extend) {
+  case R_GE_patternExtendPad    : return "pad";
+  case R_GE_patternExtendRepeat : return "repeat";
+  case R_GE_patternExtendReflect: return "reflect";
+  default                       : return "none";
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Gradient stops as a numeric vector, and colours as an N x 4 RGBA matrix
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void gradient_stops(int nstops, double *stops, unsigned int *cols,
+                    Rcpp::NumericVector &stops_out, Rcpp::IntegerMatrix &cols_out, std::string &key) {
+  stops_out = Rcpp::NumericVector(nstops);
+  cols_out  = Rcpp::IntegerMatrix(nstops, 4);
+
+  for (int i = 0; i < nstops; i++) {
+    stops_out[i]   = stops[i];
+    cols_out(i, 0) = R_RED  (cols[i]);
+    cols_out(i, 1) = R_GREEN(cols[i]);
+    cols_out(i, 2) = R_BLUE (cols[i]);
+    cols_out(i, 3) = R_ALPHA(cols[i]);
+    key_append(key, stops[i]);
+    key_append(key, cols[i]);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Define a pattern fill (linear gradient, radial gradient or tiling pattern)
+//
+// Identical definitions are only sent to the callback once, with an integer
+// 'handle'.  Primitives using the pattern will have gc$patternFill = handle.
+//
+// For tiling patterns, the pattern content is drawn (as ordinary device
+// calls) between 'setPattern' and 'endPattern'
+//
+// @return reference to the pattern (integer handle)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP rdevice_setPattern(SEXP pattern, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  int type = R_GE_patternType(pattern);
+  std::string key;
+  key_append(key, type);
+
+  // What the pattern looks like, for page hashes.  Unlike 'key' this
+  // doesn't depend on where the tile function happens to be in memory
+  std::vector<double> params(1, type);
+
+  SEXP fn = R_NilValue;
+  Rcpp::List args;
+  Rcpp::NumericVector stops;
+  Rcpp::IntegerMatrix colours;
+
+  if (type == R_GE_linearGradientPattern) {
+    int nstops = R_GE_linearGradientNumStops(pattern);
+    std::vector<double>       stop_vals(nstops);
+    std::vector<unsigned int> stop_cols(nstops);
+    for (int i = 0; i < nstops; i++) {
+      stop_vals[i] = R_GE_linearGradientStop  (pattern, i);
+      stop_cols[i] = R_GE_linearGradientColour(pattern, i);
+    }
+    gradient_stops(nstops, stop_vals.data(), stop_cols.data(), stops, colours, key);
+    params.insert(params.end(), stop_vals.begin(), stop_vals.end());
+    params.insert(params.end(), stop_cols.begin(), stop_cols.end());
+
+    double x1 = R_GE_linearGradientX1(pattern), y1 = R_GE_linearGradientY1(pattern);
+    double x2 = R_GE_linearGradientX2(pattern), y2 = R_GE_linearGradientY2(pattern);
+    int extend = R_GE_linearGradientExtend(pattern);
+    key_append(key, x1); key_append(key, y1);
+    key_append(key, x2); key_append(key, y2);
+    key_append(key, extend);
+    double p[] = {x1, y1, x2, y2, (double)extend};
+    params.insert(params.end(), p, p + 5);
+
+    args = Rcpp::List::create(
+      Rcpp::Named("type")    = "linear",
+      Rcpp::Named("x1")      = tf_x(cdata, x1, dd),
+      Rcpp::Named("y1")      = tf_y(cdata, y1, dd),
+      Rcpp::Named("x2")      = tf_x(cdata, x2, dd),
+      Rcpp::Named("y2")      = tf_y(cdata, y2, dd),
+      Rcpp::Named("stops")   = stops,
+      Rcpp::Named("colours") = colours,
+      Rcpp::Named("extend")  = extend_to_string(extend)
+    );
+
+  } else if (type == R_GE_radialGradientPattern) {
+    int nstops = R_GE_radialGradientNumStops(pattern);
+    std::vector<double>       stop_vals(nstops);
+    std::vector<unsigned int> stop_cols(nstops);
+    for (int i = 0; i < nstops; i++) {
+      stop_vals[i] = R_GE_radialGradientStop  (pattern, i);
+      stop_cols[i] = R_GE_radialGradientColour(pattern, i);
+    }
+    gradient_stops(nstops, stop_vals.data(), stop_cols.data(), stops, colours, key);
+    params.insert(params.end(), stop_vals.begin(), stop_vals.end());
+    params.insert(params.end(), stop_cols.begin(), stop_cols.end());
+
+    double cx1 = R_GE_radialGradientCX1(pattern), cy1 = R_GE_radialGradientCY1(pattern);
+    double cx2 = R_GE_radialGradientCX2(pattern), cy2 = R_GE_radialGradientCY2(pattern);
+    double r1  = R_GE_radialGradientR1 (pattern), r2  = R_GE_radialGradientR2 (pattern);
+    int extend = R_GE_radialGradientExtend(pattern);
+    key_append(key, cx1); key_append(key, cy1); key_append(key, r1);
+    key_append(key, cx2); key_append(key, cy2); key_append(key, r2);
+    key_append(key, extend);
+    double p[] = {cx1, cy1, r1, cx2, cy2, r2, (double)extend};
+    params.insert(params.end(), p, p + 7);
+
+    args = Rcpp::List::create(
+      Rcpp::Named("type")    = "radial",
+      Rcpp::Named("cx1")     = tf_x(cdata, cx1, dd),
+      Rcpp::Named("cy1")     = tf_y(cdata, cy1, dd),
+      Rcpp::Named("r1")      = tf_len(cdata, r1, AXIS_X, dd),
+      Rcpp::Named("cx2")     = tf_x(cdata, cx2, dd),
+      Rcpp::Named("cy2")     = tf_y(cdata, cy2, dd),
+      Rcpp::Named("r2")      = tf_len(cdata, r2, AXIS_X, dd),
+      Rcpp::Named("stops")   = stops,
+      Rcpp::Named("colours") = colours,
+      Rcpp::Named("extend")  = extend_to_string(extend)
+    );
+
+  } else if (type == R_GE_tilingPattern) {
+    fn = R_GE_tilingPatternFunction(pattern);
+    double x = R_GE_tilingPatternX(pattern), width  = R_GE_tilingPatternWidth (pattern);
+    double y = R_GE_tilingPatternY(pattern), height = R_GE_tilingPatternHeight(pattern);
+    int extend = R_GE_tilingPatternExtend(pattern);
+    key_append(key, (void *)fn);
+    key_append(key, x); key_append(key, y);
+    key_append(key, width); key_append(key, height);
+    key_append(key, extend);
+    double p[] = {x, y, width, height, (double)extend};
+    params.insert(params.end(), p, p + 5);
+
+    args = Rcpp::List::create(
+      Rcpp::Named("type")   = "tiling",
+      Rcpp::Named("x")      = tf_x(cdata, x, dd),
+      Rcpp::Named("y")      = tf_y(cdata, y, dd),
+      Rcpp::Named("width")  = tf_len(cdata, width , AXIS_X, dd),
+      Rcpp::Named("height") = tf_len(cdata, height, AXIS_Y, dd),
+      Rcpp::Named("extend") = extend_to_string(extend)
+    );
+
+  } else {
+    Rcpp::warning("rdevice_setPattern: Unknown pattern type. Ignoring");
+    return R_NilValue;
+  }
+
+  bool is_new;
+  int handle = definition_acquire(&cdata->patterns, key, fn, &is_new);
+
+  if (is_new) {
+    args["handle"] = handle;
+    rdevice_callback("setPattern", args, dd);
+
+    uint64_t content;
+    if (type == R_GE_tilingPattern) {
+      content = definition_draw_hashed(cdata, fn, "setPattern", params);
+      rdevice_callback("endPattern", Rcpp::List::create(Rcpp::Named("handle") = handle), dd);
+    } else {
+      content = dl_content_hash(NULL, 0, params);
+    }
+    cdata->patterns.defs[handle].content = content;
+  }
+
+  return Rf_ScalarInteger(handle);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Release a reference to a pattern.  'ref' = NULL means release all patterns
+//
+// The callback is only called with 'releasePattern' once no references
+// to the pattern remain.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void rdevice_releasePattern(SEXP ref, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  std::vector<int> released;
+  definition_release(&cdata->patterns, definition_handle(ref), &released);
+
+  for (size_t i = 0; i < released.size(); i++) {
+    rdevice_callback("releasePattern", Rcpp::List::create(Rcpp::Named("handle") = released[i]), dd);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Set the clipping path
+//
+// If 'ref' is not NULL, the engine is re-using a clipping path already
+// defined on this device.  Otherwise the path is looked up in the cache, and
+// only if it is new is its content drawn between 'setClipPath' and
+// 'endClipPath'
+//
+// @return reference to the clipping path (integer handle)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP rdevice_setClipPath(SEXP path, SEXP ref, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  if (cdata->lod != NULL) {
+    cdata->lod->touch();
+  }
+
+  bool is_new = false;
+  int handle  = definition_handle(ref);
+
+  if (handle == NA_INTEGER) {
+    std::string key;
+    key_append(key, (void *)path);
+    handle = definition_acquire(&cdata->clip_paths, key, path, &is_new);
+  }
+
+  std::string rule = "winding";
+#if R_GE_group > 14
+  if (R_GE_clipPathFillRule(path) == R_GE_evenOddRule) rule = "evenodd";
+#endif
+
+  rdevice_callback("setClipPath", Rcpp::List::create(
+    Rcpp::Named("handle") = handle,
+    Rcpp::Named("rule")   = rule,
+    Rcpp::Named("new")    = is_new
+  ), dd);
+
+  if (is_new) {
+    std::vector<double> params(1, rule == "winding");
+    cdata->clip_paths.defs[handle].content = definition_draw_hashed(cdata, path, "setClipPath", params);
+    rdevice_callback("endClipPath", Rcpp::List::create(Rcpp::Named("handle") = handle), dd);
+  }
+
+  // Everything drawn from now on is clipped by this path
+  std::map<int, cached_definition>::iterator it = cdata->clip_paths.defs.find(handle);
+  cdata->clip_hash = it == cdata->clip_paths.defs.end() ? 0 : it->second.content;
+
+  return Rf_ScalarInteger(handle);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Release a reference to a clipping path. 'ref' = NULL means release all
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void rdevice_releaseClipPath(SEXP ref, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  std::vector<int> released;
+  definition_release(&cdata->clip_paths, definition_handle(ref), &released);
+
+  for (size_t i = 0; i < released.size(); i++) {
+    rdevice_callback("releaseClipPath", Rcpp::List::create(Rcpp::Named("handle") = released[i]), dd);
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Set the mask
+//
+// 'path' = NULL means no mask (callback gets handle = NA).  Otherwise works
+// the same as clipping paths, with the mask content drawn between 'setMask'
+// and 'endMask'
+//
+// @return reference to the mask (integer handle)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP rdevice_setMask(SEXP path, SEXP ref, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  if (cdata->lod != NULL) {
+    cdata->lod->touch();
+  }
+
+  if (Rf_isNull(path)) {
+    cdata->mask_hash = 0;
+    rdevice_callback("setMask", Rcpp::List::create(
+      Rcpp::Named("handle") = NA_INTEGER,
+      Rcpp::Named("type")   = "alpha",
+      Rcpp::Named("new")    = false
+    ), dd);
+    return R_NilValue;
+  }
+
+  bool is_new = false;
+  int handle  = definition_handle(ref);
+
+  if (handle == NA_INTEGER) {
+    std::string key;
+    key_append(key, (void *)path);
+    handle = definition_acquire(&cdata->masks, key, path, &is_new);
+  }
+
+  std::string type = "alpha";
+#if R_GE_group > 14
+  if (R_GE_maskType(path) == R_GE_luminanceMask) type = "luminance";
+#endif
+
+  rdevice_callback("setMask", Rcpp::List::create(
+    Rcpp::Named("handle") = handle,
+    Rcpp::Named("type")   = type,
+    Rcpp::Named("new")    = is_new
+  ), dd);
+
+  if (is_new) {
+    std::vector<double> params(1, type == "alpha");
+    cdata->masks.defs[handle].content = definition_draw_hashed(cdata, path, "setMask", params);
+    rdevice_callback("endMask", Rcpp::List::create(Rcpp::Named("handle") = handle), dd);
+  }
+
+  std::map<int, cached_definition>::iterator it = cdata->masks.defs.find(handle);
+  cdata->mask_hash = it == cdata->masks.defs.end() ? 0 : it->second.content;
+
+  return Rf_ScalarInteger(handle);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Release a reference to a mask. 'ref' = NULL means release all
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void rdevice_releaseMask(SEXP ref, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  std::vector<int> released;
+  definition_release(&cdata->masks, definition_handle(ref), &released);
+
+  for (size_t i = 0; i < released.size(); i++) {
+    rdevice_callback("releaseMask", Rcpp::List::create(Rcpp::Named("handle") = released[i]), dd);
+  }
+}
+#endif //R_GE_definitions
+
+
+#if R_GE_group > 14
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Convert a compositing operator to a string (same names as grid::groupGrob())
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::string composite_to_string(int op) {
+  static const char *names[] = {
+    "clear", "source", "over", "in", "out", "atop", "dest", "dest.over",
+    "dest.in", "dest.out", "dest.atop", "xor", "add", "saturate", "multiply",
+    "screen", "overlay", "darken", "lighten", "color.dodge", "color.burn",
+    "hard.light", "soft.light", "difference", "exclusion"
+  };
+
+  if (op < R_GE_compositeClear || op > R_GE_compositeExclusion) {
+    return "over";
+  }
+  return names[op - R_GE_compositeClear];
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Express a transform in device coordinates as a 3x3 matrix in the
+// coordinates the R callback sees (i.e. after the device's own coordinate
+// transform has been applied)
+//
+// @param m affine transform (x' = m[0] x + m[2] y + m[4], y' = m[1] x + m[3] y + m[5])
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::NumericMatrix transform_matrix(const coord_transform *tf, const double *m, pDevDesc dd) {
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Device coordinate transform: x' = sx * x + ox,  y' = sy * y + oy
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  double sx = tf->scale[0], ox = tf->offset[0];
+  double sy = tf->scale[1], oy = tf->offset[1];
+  if (tf->flip_y) {
+    oy = sy * (dd->top + dd->bottom) + oy;
+    sy = -sy;
+  }
+
+  double n0 = m[0];
+  double n1 = sy * m[1] / sx;
+  double n2 = sx * m[2] / sy;
+  double n3 = m[3];
+  double n4 = sx * m[4] + ox - n0 * ox - n2 * oy;
+  double n5 = sy * m[5] + oy - n1 * ox - n3 * oy;
+
+  Rcpp::NumericMatrix res(3, 3);
+  res(0, 0) = n0; res(0, 1) = n2; res(0, 2) = n4;
+  res(1, 0) = n1; res(1, 1) = n3; res(1, 2) = n5;
+  res(2, 0) = 0 ; res(2, 1) = 0 ; res(2, 2) = 1 ;
+
+  return res;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Define a group
+//
+// The callback sees 'defineGroup', then the destination (if any) drawn as
+// ordinary device calls followed by 'groupSource', then the source, and
+// finally 'endGroup'.
+//
+// At the same time, everything drawn is recorded natively so that each
+// 'useGroup' can refer to the group by handle (rather than re-drawing it
+// through R), and the content can be replayed with the group's transform
+// applied in C++.
+//
+// @return reference to the group (integer handle)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP rdevice_defineGroup(SEXP source, int op, SEXP destination, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  // Every group definition is distinct, so its key is just its handle
+  std::string key;
+  key_append(key, cdata->groups.next_handle);
+
+  bool is_new;
+  int handle = definition_acquire(&cdata->groups, key, R_NilValue, &is_new);
+  cdata->group_lists[handle].clear();
+
+  rdevice_callback("defineGroup", Rcpp::List::create(
+    Rcpp::Named("handle")      = handle,
+    Rcpp::Named("op")          = composite_to_string(op),
+    Rcpp::Named("destination") = !Rf_isNull(destination)
+  ), dd);
+
+  cdata->group_stack.push_back(handle);
+  if (!Rf_isNull(destination)) {
+    definition_draw(destination, "defineGroup");
+    rdevice_callback("groupSource", Rcpp::List::create(Rcpp::Named("handle") = handle), dd);
+  }
+  definition_draw(source, "defineGroup");
+  cdata->group_stack.pop_back();
+
+  rdevice_callback("endGroup", Rcpp::List::create(Rcpp::Named("handle") = handle), dd);
+
+  return Rf_ScalarInteger(handle);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw a group
+//
+// The callback is given the group 'handle' and 'transform' (3x3 matrix or
+// NULL).  If the callback can't draw groups itself, it may return
+// 'replay = TRUE' and the natively recorded group content is transformed in
+// C++ and passed back to the callback as ordinary device calls.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void rdevice_useGroup(SEXP ref, SEXP trans, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  int handle = definition_handle(ref);
+  std::map<int, dl_list>::iterator it = cdata->group_lists.find(handle);
+  if (handle == NA_INTEGER || it == cdata->group_lists.end()) {
+    Rcpp::warning("rdevice_useGroup: Unknown group. Ignoring");
+    return;
+  }
+
+  double m[6] = {1, 0, 0, 1, 0, 0};
+  bool has_trans = !Rf_isNull(trans) && TYPEOF(trans) == REALSXP && Rf_length(trans) == 9;
+  if (has_trans) {
+    double *t = REAL(trans);
+    m[0] = t[0]; m[1] = t[1];
+    m[2] = t[3]; m[3] = t[4];
+    m[4] = t[6]; m[5] = t[7];
+  }
+
+  if (cdata->capture != NULL) {
+    cdata->capture->append(it->second, has_trans ? m : NULL);
+    return;
+  }
+
+  Rcpp::RObject trans_out = R_NilValue;
+  if (has_trans) {
+    trans_out = transform_matrix(&cdata->transform, m, dd);
+  }
+
+  Rcpp::List res = rdevice_callback("useGroup", Rcpp::List::create(
+    Rcpp::Named("handle")    = handle,
+    Rcpp::Named("transform") = trans_out
+  ), dd);
+
+  bool replay = false;
+  if (res.containsElementNamed("replay")) {
+    replay = Rcpp::as<bool>(res["replay"]);
+  }
+
+  if (replay) {
+    dl_list placed;
+    placed.append(it->second, has_trans ? m : NULL);
+    dl_replay(placed, dd);
+  } else {
+    dl_list *dl = native_target(cdata);
+    if (dl != NULL) dl->append(it->second, has_trans ? m : NULL);
+  }
+}
 
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Release a group. 'ref' = NULL means release all groups
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void rdevice_releaseGroup(SEXP ref, pDevDesc dd) {
   cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
-
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "text",
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
+  std::vector<int> released;
+  definition_release(&cdata->groups, definition_handle(ref), &released);
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("x")    = x,
-        Rcpp::Named("y")    = y,
-        Rcpp::Named("str")  = std::string(str),
-        Rcpp::Named("rot")  = rot,
-        Rcpp::Named("hadj") = hadj
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("text: " + ex_str);
+  for (size_t i = 0; i < released.size(); i++) {
+    cdata->group_lists.erase(released[i]);
+    rdevice_callback("releaseGroup", Rcpp::List::create(Rcpp::Named("handle") = released[i]), dd);
   }
 }
 
 
-
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Draw text in UTF8 directly (if 'hasTextUTF8' = TRUE)
-//
-// Some devices can plot UTF-8 text directly without converting
-// to the native encoding, e.g. windows(), quartz() ....
-//
-// If this flag is true, all text *not in the symbol font* is sent
-// in UTF8 to the textUTF8/strWidthUTF8 entry points.
-//
-// If the flag is TRUE, the metricInfo entry point should
-// accept negative values for 'c' and treat them as indicating
-// Unicode points (as well as positive values in a MBCS locale).
-//
-// R_GE_gcontext parameters that should be honoured (if possible):
-//   font, cex, ps, col, gamma
+// Stroke and/or fill a path
 //
-// @param x,y location of text (double)
-// @param str string
-// @param rot text rotation (degrees)
-// @param hadj horizontal adjustment (double)
+// The path function is evaluated with all its primitives captured natively
+// (nothing is sent to R), the geometry is flattened to sub-paths, and the
+// callback gets a single device call with 'x', 'y', 'npoly', 'nper' (as for
+// 'path') plus 'winding'
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void rdevice_textUTF8(double x, double y, const char *str, double rot,
-                      double hadj, const pGEcontext gc, pDevDesc dd) {
+void path_callback(const char *device_call, SEXP path, int rule, bool do_stroke, bool do_fill,
+                   const pGEcontext gc, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
 
+  dl_list  captured;
+  dl_list *previous = cdata->capture;
+  cdata->capture = &captured;
+  definition_draw(path, device_call);
+  cdata->capture = previous;
+
+  std::vector<double> xs, ys;
+  std::vector<int>    nper;
+  dl_to_subpaths(captured, xs, ys, nper);
+  if (nper.empty()) return;
+
+  bool winding = rule != R_GE_evenOddRule;
+
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl_gc dgc = native_gc(cdata, gc);
+    if (!do_stroke) dgc.col = R_TRANWHITE;
+    if (!do_fill) {
+      dgc.fill    = R_TRANWHITE;
+      dgc.pattern = NA_INTEGER;
+    }
+    dl->path(dgc, xs.data(), ys.data(), (int)nper.size(), nper.data(), winding);
+    if (dl == cdata->capture) return;
+  }
 
-  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
-  Rcpp::List res;
+  int total_coords = (int)xs.size();
 
-  try {
-    res = rcallback(
-      Rcpp::Named("device_call") = "textUTF8",
+  rdevice_callback(device_call, Rcpp::List::create(
+    Rcpp::Named("x")       = transform_coords(&cdata->transform, xs.data(), total_coords, AXIS_X, dd),
+    Rcpp::Named("y")       = transform_coords(&cdata->transform, ys.data(), total_coords, AXIS_Y, dd),
+    Rcpp::Named("npoly")   = (int)nper.size(),
+    Rcpp::Named("nper")    = nper,
+    Rcpp::Named("winding") = winding
+  ), dd, gc);
+}
 
-      Rcpp::Named("state") = Rcpp::List::create(
-        Rcpp::Named("rdata") = cdata->rdata,
-        Rcpp::Named("gc")    = gc_to_list(gc),
-        Rcpp::Named("dd")    = dd_to_list(dd)
-      ),
 
-      Rcpp::Named("args") = Rcpp::List::create(
-        Rcpp::Named("x")    = x,
-        Rcpp::Named("y")    = y,
-        Rcpp::Named("str")  = std::string(str),
-        Rcpp::Named("rot")  = rot,
-        Rcpp::Named("hadj") = hadj
-      )
-    );
-    handle_return_values_from_R(res, dd);
-  } catch(std::exception &ex) {
-    std::string ex_str = ex.what();
-    Rcpp::warning("rdevice_textUTF8: " + ex_str);
-  }
+static void rdevice_stroke(SEXP path, const pGEcontext gc, pDevDesc dd) {
+  path_callback("stroke", path, R_GE_nonZeroWindingRule, true, false, gc, dd);
+}
+
+static void rdevice_fill(SEXP path, int rule, const pGEcontext gc, pDevDesc dd) {
+  path_callback("fill", path, rule, false, true, gc, dd);
+}
 
+static void rdevice_fillStroke(SEXP path, int rule, const pGEcontext gc, pDevDesc dd) {
+  path_callback("fillStroke", path, rule, true, true, gc, dd);
 }
 
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Reference:
-// https://developer.r-project.org/Blog/public/2020/07/15/new-features-in-the-r-graphics-engine/index.html
+// Report which of the newer graphics features are supported
+// (see dev.capabilities())
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP rdevice_capabilities(SEXP capabilities) {
+  // Only ever asked of the current device
+  pGEDevDesc gdd = GEcurrentDevice();
+  const device_caps &caps = ((cdata_struct *)gdd->dev->deviceSpecific)->caps;
+
+  std::vector<int> patterns;
+  for (size_t i = 0; i < caps.patterns.size(); i++) {
+    if (caps.patterns[i] == "linear") patterns.push_back(R_GE_linearGradientPattern);
+    if (caps.patterns[i] == "radial") patterns.push_back(R_GE_radialGradientPattern);
+    if (caps.patterns[i] == "tiling") patterns.push_back(R_GE_tilingPattern);
+  }
 
-#if R_GE_definitions > 12
-static SEXP rdevice_setPattern(SEXP pattern, pDevDesc dd) {
-  return R_NilValue;
-}
+  std::vector<int> masks;
+  for (size_t i = 0; i < caps.masks.size(); i++) {
+    if (caps.masks[i] == "alpha"    ) masks.push_back(R_GE_alphaMask);
+    if (caps.masks[i] == "luminance") masks.push_back(R_GE_luminanceMask);
+  }
 
-static void rdevice_releasePattern(SEXP ref, pDevDesc dd) {}
+  std::vector<int> compositing;
+  for (int op = R_GE_compositeClear; op <= R_GE_compositeExclusion; op++) {
+    for (size_t i = 0; i < caps.compositing.size(); i++) {
+      if (caps.compositing[i] == "all" || caps.compositing[i] == composite_to_string(op)) {
+        compositing.push_back(op);
+        break;
+      }
+    }
+  }
 
-static SEXP rdevice_setClipPath(SEXP path, SEXP ref, pDevDesc dd) {
-  return R_NilValue;
+  // An empty set of patterns/masks/operators is reported as FALSE
+  SET_VECTOR_ELT(capabilities, R_GE_capability_patterns       , patterns.empty()    ? Rf_ScalarLogical(FALSE) : Rcpp::wrap(patterns));
+  SET_VECTOR_ELT(capabilities, R_GE_capability_clippingPaths  , Rf_ScalarInteger(caps.clipping_paths));
+  SET_VECTOR_ELT(capabilities, R_GE_capability_masks          , masks.empty()       ? Rf_ScalarLogical(FALSE) : Rcpp::wrap(masks));
+  SET_VECTOR_ELT(capabilities, R_GE_capability_compositing    , compositing.empty() ? Rf_ScalarLogical(FALSE) : Rcpp::wrap(compositing));
+  SET_VECTOR_ELT(capabilities, R_GE_capability_transformations, Rf_ScalarInteger(caps.transformations));
+  SET_VECTOR_ELT(capabilities, R_GE_capability_paths          , Rf_ScalarInteger(caps.paths));
+#if R_GE_glyphs > 15
+  SET_VECTOR_ELT(capabilities, R_GE_capability_glyphs         , Rf_ScalarInteger(caps.glyphs));
+#endif
+
+  return capabilities;
 }
+#endif // R_GE_group
 
-static void rdevice_releaseClipPath(SEXP ref, pDevDesc dd) {}
 
-static SEXP rdevice_setMask(SEXP path, SEXP ref, pDevDesc dd) {
-  return R_NilValue;
-}
+#if R_GE_glyphs > 15
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Draw glyphs (typeset text e.g. from the 'textshaping' package)
+//
+// @param glyphs glyph ids within the font
+// @param x,y location of each glyph
+// @param font font file, index, family, weight and style
+// @param size font size in points
+// @param colour glyph colour
+// @param rot rotation (degrees)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void rdevice_glyph(int n, int *glyphs, double *x, double *y, SEXP font,
+                          double size, int colour, double rot, pDevDesc dd) {
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
 
-static void rdevice_releaseMask(SEXP ref, pDevDesc dd) {}
-#endif //R_GE_definitions
+  dl_list *dl = native_target(cdata);
+  if (dl != NULL) {
+    dl_gc dgc = native_gc(cdata, NULL);
+    dgc.col = colour;
+    dl->glyph(dgc, n, glyphs, x, y, R_GE_glyphFontFile(font), R_GE_glyphFontIndex(font), size, rot);
+    if (dl == cdata->capture) return;
+  }
+
+  std::string style = "normal";
+  if (R_GE_glyphFontStyle(font) == R_GE_text_style_italic ) style = "italic";
+  if (R_GE_glyphFontStyle(font) == R_GE_text_style_oblique) style = "oblique";
+
+  Rcpp::List font_list = Rcpp::List::create(
+    Rcpp::Named("file")   = std::string(R_GE_glyphFontFile(font)),
+    Rcpp::Named("index")  = R_GE_glyphFontIndex(font),
+    Rcpp::Named("family") = std::string(R_GE_glyphFontFamily(font)),
+    Rcpp::Named("weight") = R_GE_glyphFontWeight(font),
+    Rcpp::Named("style")  = style
+  );
+
+  rdevice_callback("glyph", glyph_args(cdata, n, glyphs, x, y, font_list, size, colour, rot, dd), dd);
+}
+#endif // R_GE_glyphs
 
 
 
@@ -1489,8 +3615,8 @@ pDevDesc rdevice_open(SEXP rdata) {
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   // If the user doesn't specify, then use this width/height (in inches)
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-  int width  = 10;
-  int height =  8;
+  double width  = 10;
+  double height =  8;
 
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   // Interpret the rdata as a list and see if width, height and pointsize
@@ -1499,8 +3625,8 @@ pDevDesc rdevice_open(SEXP rdata) {
   Rcpp::Environment rcl = Rcpp::clone(rdata);
   R_PreserveObject(rcl);
 
-  if (rcl.exists("width"    )) width      = Rcpp::as<int>(rcl["width"]);
-  if (rcl.exists("height"   )) height     = Rcpp::as<int>(rcl["height"]);
+  if (rcl.exists("width"    )) width      = Rcpp::as<double>(rcl["width"]);
+  if (rcl.exists("height"   )) height     = Rcpp::as<double>(rcl["height"]);
   if (rcl.exists("pointsize")) pointsize  = Rcpp::as<double>(rcl["pointsize"]);
 
 
@@ -1637,6 +3763,29 @@ pDevDesc rdevice_open(SEXP rdata) {
   dd->releaseClipPath = rdevice_releaseClipPath;
   dd->setMask         = rdevice_setMask;
   dd->releaseMask     = rdevice_releaseMask;
+#endif // R_GE_definitions
+
+#if R_GE_group > 14
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // New features added in R4.2.0
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  dd->defineGroup     = rdevice_defineGroup;
+  dd->useGroup        = rdevice_useGroup;
+  dd->releaseGroup    = rdevice_releaseGroup;
+  dd->stroke          = rdevice_stroke;
+  dd->fill            = rdevice_fill;
+  dd->fillStroke      = rdevice_fillStroke;
+  dd->capabilities    = rdevice_capabilities;
+#endif // R_GE_group
+
+#if R_GE_glyphs > 15
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // New features added in R4.3.0
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  dd->glyph           = rdevice_glyph;
+#endif // R_GE_glyphs
+
+#if R_GE_definitions > 12
 
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   //  From src/include/R_ext
@@ -1658,6 +3807,10 @@ pDevDesc rdevice_open(SEXP rdata) {
   // *             - masks
   // *             Added deviceVersion
   // * Version 14: Added deviceClip
+  // * Version 15: For R 4.2.0
+  // *             Added groups, paths (stroke/fill) and capabilities
+  // * Version 16: For R 4.3.0
+  // *             Added glyphs
   //
   //
   // /* This should match R_GE_version,
@@ -1668,7 +3821,13 @@ pDevDesc rdevice_open(SEXP rdata) {
   //  */
   // int deviceVersion;
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#if R_GE_glyphs > 15
+  dd->deviceVersion = R_GE_glyphs;
+#elif R_GE_group > 14
+  dd->deviceVersion = R_GE_group;
+#else
   dd->deviceVersion = R_GE_definitions;
+#endif
 
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   // /* This can be used to OVERRIDE canClip so that graphics engine
@@ -1685,25 +3844,241 @@ pDevDesc rdevice_open(SEXP rdata) {
   cdata_struct *cdata = new cdata_struct;
   cdata->rdata = rcl;
 
+  cdata->transform.active     = false;
+  cdata->transform.scale[0]   = 1;
+  cdata->transform.scale[1]   = 1;
+  cdata->transform.offset[0]  = 0;
+  cdata->transform.offset[1]  = 0;
+  cdata->transform.flip_y     = false;
+  cdata->transform.as_integer = false;
+
+  cdata->caps.clipping_paths  = false;
+  cdata->caps.transformations = false;
+  cdata->caps.paths           = false;
+  cdata->caps.glyphs          = false;
+
+  cdata->capture = NULL;
+
+  //--------------------------------------------------------------------------
+  // Record all pages natively if the user supplied a 'recording()'
+  //--------------------------------------------------------------------------
+  cdata->pages     = NULL;
+  cdata->pages_ref = R_NilValue;
+  if (rcl.exists(".recording")) {
+    SEXP rec = rcl[".recording"];
+    if (TYPEOF(rec) == EXTPTRSXP && R_ExternalPtrAddr(rec) != NULL) {
+      R_PreserveObject(rec);
+      cdata->pages_ref = rec;
+      cdata->pages     = (dl_recording *)R_ExternalPtrAddr(rec);
+    } else {
+      Rcpp::warning("rdevice: 'recording' is not a valid recording. Ignoring");
+    }
+  }
+
+
+  //--------------------------------------------------------------------------
+  // Stream each finished page to a sink if the user supplied a 'page_stream()'
+  //--------------------------------------------------------------------------
+  cdata->sink     = NULL;
+  cdata->page     = 0;
+  cdata->pipeline = NULL;
+  if (rcl.exists(".stream")) {
+    Rcpp::List stream = rcl[".stream"];
+    std::string type   = Rcpp::as<std::string>(stream["type"]);
+    std::string path   = Rcpp::as<std::string>(stream["path"]);
+    std::string format = stream.containsElementNamed("format") ?
+      Rcpp::as<std::string>(stream["format"]) : "callback";
+    bool anim = (format == "gif" || format == "apng");
+
+    if (anim) {
+      cdata->sink = new anim_page_sink(path, format == "apng",
+                                       Rcpp::as<double>(stream["delay"]),
+                                       Rcpp::as<int>(stream["loop"]));
+    } else {
+      cdata->sink = page_sink_create(type, path);
+      if (cdata->sink == NULL) {
+        Rcpp::warning("rdevice: unknown page stream type '" + type + "'. Ignoring");
+      }
+    }
+
+    // Native formats are rendered from the display list on worker threads.
+    // Animation frames are only rasterised there. Differencing against the
+    // previous frame happens (in page order) as they are written.
+    if (cdata->sink != NULL && (format == "png" || anim)) {
+      double res         = Rcpp::as<double>(stream["res"]);
+      int    threads     = Rcpp::as<int>(stream["threads"]);
+      int    queue_depth = Rcpp::as<int>(stream["queue"]);
+      page_sink *sink    = cdata->sink;
+
+      cdata->pipeline = new page_pipeline(
+        threads, queue_depth,
+        [res, anim](const dl_page &page) {
+          rgba_image img;
+          dl_rasterise(page, res, img);
+          return anim ? frame_to_bytes(img) : png_encode(img);
+        },
+        [sink](int page, const std::string &bytes, std::string &err) {
+          bool ok = sink->write_page(page, bytes.data(), bytes.size());
+          if (!ok) err = sink->error;
+          return ok;
+        }
+      );
+    } else if (format != "callback") {
+      Rcpp::warning("rdevice: unknown page stream format '" + format + "'. Ignoring");
+    }
+  }
+
+
+  //--------------------------------------------------------------------------
+  // Log every device call natively if the user supplied a 'call_log()'
+  //--------------------------------------------------------------------------
+  cdata->log = NULL;
+  if (rcl.exists(".log")) {
+    Rcpp::List log = rcl[".log"];
+    cdata->log = new call_log(
+      Rcpp::as<std::string>(log["path"]),
+      Rcpp::as<std::string>(log["format"]) == "ndjson",
+      Rcpp::as<bool>(log["append"]),
+      Rcpp::as<std::vector<std::string> >(log["skip"])
+    );
+    if (!cdata->log->error.empty()) {
+      Rcpp::warning("rdevice: " + cdata->log->error);
+    }
+  }
+
+  // Without a callback function, calls are only recorded/logged natively
+  cdata->no_callback = Rf_isNull(rcl["rfunction"]);
+  cdata->lazy        = rcl.exists(".lazy");
+  cdata->strings     = new string_intern();
+  cdata->string_ids  = rcl.exists(".string_ids");
+  cdata->geometries  = rcl.exists(".geometry_cache") ? new geometry_cache() : NULL;
+  cdata->lod         = rcl.exists(".lod") ? new lod_stage(Rcpp::as<double>(rcl[".lod"])) : NULL;
+
+
+  //--------------------------------------------------------------------------
+  // Hash the content of each page (rounded to 'hash' device units)
+  //--------------------------------------------------------------------------
+  cdata->hasher       = NULL;
+  cdata->consumed_ops = 0;
+  cdata->defining     = 0;
+  cdata->clip_hash    = 0;
+  cdata->mask_hash    = 0;
+  if (rcl.exists(".hash")) {
+    cdata->hasher = new page_hash(Rcpp::as<double>(rcl[".hash"]));
+  }
+
+
+  //--------------------------------------------------------------------------
+  // Write primitives to a binary stream if the user supplied a
+  // 'primitive_stream()'
+  //--------------------------------------------------------------------------
+  cdata->prims = NULL;
+  if (rcl.exists(".prims")) {
+    Rcpp::List prims = rcl[".prims"];
+    std::string type = Rcpp::as<std::string>(prims["type"]);
+    std::string err;
+    int fd = -1;
+    if (type == "fd") {
+      fd = Rcpp::as<int>(prims["fd"]);
+    } else if (type == "unix") {
+      fd = prim_stream_connect_unix(Rcpp::as<std::string>(prims["path"]), err);
+    } else {
+      fd = prim_stream_open_path(Rcpp::as<std::string>(prims["path"]), err);
+    }
+
+    if (fd >= 0) {
+      cdata->prims = new prim_stream(fd, type != "fd", (size_t)Rcpp::as<double>(prims["buffer"]));
+    } else {
+      Rcpp::warning("rdevice: primitive stream " + err + ". Ignoring");
+    }
+  }
+
+
+  cdata->fb         = NULL;
+  cdata->hold_level = 0;
+
+
+  //--------------------------------------------------------------------------
+  // Hand device calls to a native backend registered by another package
+  //--------------------------------------------------------------------------
+  cdata->backend = NULL;
+  if (rcl.exists(".backend")) {
+    std::string name = Rcpp::as<std::string>(rcl[".backend"]);
+    cdata->backend = devout_find_backend(name);
+    if (cdata->backend == NULL) {
+      Rcpp::warning("rdevice: unknown backend '" + name + "'. Ignoring");
+    }
+  }
+
 
   dd->deviceSpecific = cdata;
+  device_rdata_update(cdata, true);
 
   //--------------------------------------------------------------------------
   // Give the user the opportunity to edit 'dd' before anything starts
   //--------------------------------------------------------------------------
-  Rcpp::List res = rcallback(
-    Rcpp::Named("device_call") = "open",
+  Rcpp::List res;
+  if (cdata->backend != NULL && cdata->backend->open != NULL) {
+    cdata->backend->open(dd, cdata->backend->user);
+  } else {
+    res = rcallback(cdata,
+      Rcpp::Named("device_call") = "open",
 
-    Rcpp::Named("state") = Rcpp::List::create(
-      Rcpp::Named("rdata")     = cdata->rdata,
-      Rcpp::Named("dd")        = dd_to_list(dd)
-    ),
+      Rcpp::Named("state") = callback_state(cdata, dd),
 
-    Rcpp::Named("args") = Rcpp::List()
-  );
+      Rcpp::Named("args") = Rcpp::List()
+    );
+  }
 
   handle_return_values_from_R(res, dd);
 
+  //--------------------------------------------------------------------------
+  // The device may declare a coordinate transform to be applied to all
+  // coordinates before they are passed back to R
+  //--------------------------------------------------------------------------
+  if (res.containsElementNamed("transform")) {
+    if (TYPEOF(res["transform"]) == VECSXP) {
+      list_to_transform(res["transform"], &cdata->transform);
+    } else {
+      Rcpp::warning("Returned 'transform' from R is not a list. Ignoring");
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  // ... and which of the newer graphics features it can draw. A backend
+  // may instead set 'dd->capabilities' to its own function in 'open'
+  //--------------------------------------------------------------------------
+  if (res.containsElementNamed("capabilities")) {
+    if (TYPEOF(res["capabilities"]) == VECSXP) {
+      list_to_caps(res["capabilities"], &cdata->caps);
+    } else {
+      Rcpp::warning("Returned 'capabilities' from R is not a list. Ignoring");
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  // Render into a shared memory framebuffer if the user supplied a
+  // 'framebuffer()'.  Sized after 'open' as the callback may change 'dd'
+  //--------------------------------------------------------------------------
+  if (rcl.exists(".framebuffer")) {
+    Rcpp::List fb = rcl[".framebuffer"];
+    cdata->fb_res = Rcpp::as<double>(fb["res"]);
+    dl_page page;
+    page.left   = dd->left;
+    page.right  = dd->right;
+    page.bottom = dd->bottom;
+    page.top    = dd->top;
+    rgba_image img;
+    dl_rasterise(page, cdata->fb_res, img);
+
+    cdata->fb = new shm_framebuffer(Rcpp::as<std::string>(fb["path"]), img.width, img.height);
+    if (!cdata->fb->error.empty()) {
+      Rcpp::warning("rdevice: framebuffer " + cdata->fb->error + ". Ignoring");
+      delete cdata->fb;
+      cdata->fb = NULL;
+    }
+  }
+
   return dd;
 }
 
@@ -1743,5 +4118,311 @@ bool rdevice_(SEXP rdata, std::string device_name) {
 }
 
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Reset an open rdevice so it can be reused for a new plot
+//'
+//' The current page is finished (streamed and hashed as for \code{close})
+//' and the callback is sent a \code{reset} call in which it should output
+//' and clear anything it holds.  Native page state, cached definitions and
+//' groups are cleared, and the engine's display list is emptied.  The
+//' callback, its \code{rdata}, the coordinate transform and any recording,
+//' stream or log stay in place.  Page numbers start again from 1.
+//'
+//' @param devnum device number, as from \code{dev.cur()}
+//'
+//' @return FALSE if the device is not an open rdevice
+//'
+// [[Rcpp::export]]
+bool rdevice_reset_(int devnum) {
+  if (devnum < 2 || devnum > R_MaxDevices) return false;
+
+  pGEDevDesc gdd = GEgetDevice(devnum - 1);
+  if (gdd == NULL || gdd->dev == NULL || gdd->dev->close != rdevice_close) {
+    return false;
+  }
+  pDevDesc dd = gdd->dev;
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+
+  std::string hash = finish_page_hash(cdata);
+  finish_page_prims(cdata);
+  publish_frame(cdata);
+  rdevice_flushPage(dd);
+
+  Rcpp::List args = Rcpp::List::create(Rcpp::Named("pages") = cdata->page);
+  if (!hash.empty()) {
+    args["hash"] = hash;
+  }
+
+  cdata->page = 0;
+  cdata->capture = NULL;
+  cdata->group_lists.clear();
+  cdata->group_stack.clear();
+  cdata->stream_page.dl.clear();
+  cdata->fb_page.dl.clear();
+  cdata->pending_page.clear();
+  cdata->consumed_ops = 0;
+  cdata->clip_hash = 0;
+  cdata->mask_hash = 0;
+  cdata->hold_level = 0;
+
+  // The callback may drop what it kept for the last plot, so vertices are
+  // sent again
+  if (cdata->geometries != NULL) {
+    cdata->geometries->clear();
+  }
+
+  // Handles keep counting up, so a stale handle can never match
+  definition_release(&cdata->patterns  , NA_INTEGER, NULL);
+  definition_release(&cdata->clip_paths, NA_INTEGER, NULL);
+  definition_release(&cdata->masks     , NA_INTEGER, NULL);
+  definition_release(&cdata->groups    , NA_INTEGER, NULL);
+
+  if (cdata->log != NULL) {
+    cdata->log->flush();
+  }
+
+  GEinitDisplayList(gdd);
+
+  rdevice_callback("reset", args, dd);
+
+  return true;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Create an empty native recording
+//'
+// [[Rcpp::export]]
+SEXP recording_() {
+  Rcpp::XPtr<dl_recording> rec(new dl_recording, true);
+  return rec;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Number of pages and ops, and approximate memory used by a recording
+//'
+//' @param rec recording
+//'
+// [[Rcpp::export]]
+Rcpp::List recording_info_(SEXP rec) {
+  Rcpp::XPtr<dl_recording> ptr(rec);
+
+  Rcpp::IntegerVector ops(ptr->pages.size());
+  double bytes = 0;
+  for (size_t i = 0; i < ptr->pages.size(); i++) {
+    ops[i] = (int)ptr->pages[i].dl.ops.size();
+    bytes += (double)ptr->pages[i].dl.memory_size();
+  }
+
+  return Rcpp::List::create(
+    Rcpp::Named("pages") = (int)ptr->pages.size(),
+    Rcpp::Named("ops")   = ops,
+    Rcpp::Named("bytes") = bytes
+  );
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Content hash of each page of a recording
+//'
+//' The same hash as a device reports for each page with
+//' \code{rdevice(..., hash = TRUE)}
+//'
+//' @param rec recording
+//' @param quantum coordinates are rounded to this many device units
+//'
+// [[Rcpp::export]]
+Rcpp::CharacterVector recording_hashes_(SEXP rec, double quantum) {
+  Rcpp::XPtr<dl_recording> ptr(rec);
+
+  Rcpp::CharacterVector res(ptr->pages.size());
+  for (size_t i = 0; i < ptr->pages.size(); i++) {
+    res[i] = dl_page_hash(ptr->pages[i], quantum);
+  }
+
+  return res;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Structural diff of two recordings, page by page
+//'
+//' Pages only present in one recording are compared against an empty page.
+//'
+//' @param rec_a,rec_b recordings
+//' @param tolerance coordinates which moved by no more than this many
+//'        device units are considered unchanged
+//'
+//' @return data.frame with one row per change: page, change ('removed',
+//'         'inserted' or 'changed'), type, a, b (1-based index of the
+//'         primitive on the page in each recording), delta (largest
+//'         coordinate difference), gc (graphics context changed)
+//'
+// [[Rcpp::export]]
+Rcpp::List recording_diff_(SEXP rec_a, SEXP rec_b, double tolerance) {
+  Rcpp::XPtr<dl_recording> pa(rec_a);
+  Rcpp::XPtr<dl_recording> pb(rec_b);
+
+  static const char *change_names[] = {"removed", "inserted", "changed"};
+
+  size_t npages = std::max(pa->pages.size(), pb->pages.size());
+  std::vector<page_change> changes;
+  std::vector<int>         change_page;
+  dl_page empty;
+
+  for (size_t p = 0; p < npages; p++) {
+    const dl_page &a = p < pa->pages.size() ? pa->pages[p] : empty;
+    const dl_page &b = p < pb->pages.size() ? pb->pages[p] : empty;
+    dl_page_diff(a, b, tolerance, changes);
+    change_page.resize(changes.size(), (int)p + 1);
+  }
+
+  int n = (int)changes.size();
+  Rcpp::IntegerVector   page(n), a(n), b(n);
+  Rcpp::CharacterVector change(n), type(n);
+  Rcpp::NumericVector   delta(n);
+  Rcpp::LogicalVector   gc(n);
+
+  for (int i = 0; i < n; i++) {
+    const page_change &ch = changes[i];
+    page  [i] = change_page[i];
+    change[i] = change_names[ch.change];
+    type  [i] = dl_op_names[ch.type];
+    a     [i] = ch.a < 0 ? NA_INTEGER : ch.a + 1;
+    b     [i] = ch.b < 0 ? NA_INTEGER : ch.b + 1;
+    delta [i] = std::isnan(ch.delta) ? NA_REAL : ch.delta;
+    gc    [i] = ch.gc;
+  }
+
+  Rcpp::List df = Rcpp::List::create(
+    Rcpp::Named("page")   = page,
+    Rcpp::Named("change") = change,
+    Rcpp::Named("type")   = type,
+    Rcpp::Named("a")      = a,
+    Rcpp::Named("b")      = b,
+    Rcpp::Named("delta")  = delta,
+    Rcpp::Named("gc")     = gc
+  );
+  Rcpp::IntegerVector row_names(2);
+  row_names[0] = NA_INTEGER;
+  row_names[1] = -n;
+  df.attr("row.names") = row_names;
+  df.attr("class")     = "data.frame";
+
+  return df;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Primitives on a recorded page whose bounding box intersects a rectangle
+//'
+//' Uses the page's spatial index, which is built on the first query.
+//'
+//' @param rec recording
+//' @param page 1-based page number
+//' @param x0,y0,x1,y1 rectangle in device coordinates. A point if
+//'        x0 == x1 and y0 == y1
+//'
+//' @return data.frame of index (1-based, in drawing order) and type
+//'
+// [[Rcpp::export]]
+Rcpp::List recording_query_(SEXP rec, int page, double x0, double y0, double x1, double y1) {
+  Rcpp::XPtr<dl_recording> ptr(rec);
+
+  if (page < 1 || page > (int)ptr->pages.size()) {
+    Rcpp::stop("recording_query_(): no such page: %d", page);
+  }
+  dl_page &pg = ptr->pages[page - 1];
+
+  bbox query = {std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1)};
+  std::vector<int> hits;
+  dl_page_index(pg).query(query, hits);
+
+  int n = (int)hits.size();
+  Rcpp::IntegerVector   index(n);
+  Rcpp::CharacterVector type(n);
+  for (int i = 0; i < n; i++) {
+    index[i] = hits[i] + 1;
+    type [i] = dl_op_names[pg.dl.ops[hits[i]].type];
+  }
+
+  Rcpp::List df = Rcpp::List::create(
+    Rcpp::Named("index") = index,
+    Rcpp::Named("type")  = type
+  );
+  Rcpp::IntegerVector row_names(2);
+  row_names[0] = NA_INTEGER;
+  row_names[1] = -n;
+  df.attr("row.names") = row_names;
+  df.attr("class")     = "data.frame";
+
+  return df;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//' Replay recorded pages on the current device
+//'
+//' Each page is rescaled from the extents it was recorded with to the
+//' extents of the current device, and passed to the callback as a new page
+//' followed by ordinary device calls.  The graphics engine is not involved.
+//'
+//' @param rec recording
+//' @param pages 1-based page numbers to replay
+//'
+// [[Rcpp::export]]
+int replay_(SEXP rec, Rcpp::IntegerVector pages) {
+  Rcpp::XPtr<dl_recording> ptr(rec);
+
+  pGEDevDesc gdd = GEcurrentDevice();
+  pDevDesc   dd  = gdd->dev;
+  if (dd->close != rdevice_close) {
+    Rcpp::stop("replay(): current device is not an rdevice");
+  }
+
+  cdata_struct *cdata = (cdata_struct *)dd->deviceSpecific;
+  if (cdata->pages == (dl_recording *)ptr) {
+    Rcpp::stop("replay(): can't replay a recording into itself");
+  }
+
+  int count = 0;
+  for (int i = 0; i < pages.size(); i++) {
+    int idx = pages[i] - 1;
+    if (idx < 0 || idx >= (int)ptr->pages.size()) {
+      Rcpp::warning("replay(): no such page: " + std::to_string(pages[i]));
+      continue;
+    }
+    const dl_page &page = ptr->pages[idx];
+
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    // Map the recorded extents onto this device
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    double sx = (dd->right  - dd->left) / (page.right  - page.left);
+    double sy = (dd->bottom - dd->top ) / (page.bottom - page.top );
+    double m[6] = {sx, 0, 0, sy, dd->left - page.left * sx, dd->top - page.top * sy};
+
+    dl_list scaled;
+    scaled.append(page.dl, m);
+
+    dl_gc bg = gc_to_dl(NULL);
+    bg.fill  = page.bg;
+    bg.ps    = dd->startps;
+    bg.cex   = 1;
+    bg.lwd   = 1;
+    R_GE_gcontext gc;
+    dl_to_gc(bg, &gc);
+#if R_GE_definitions > 12
+    PROTECT(gc.patternFill);
+#endif
+    rdevice_newPage(&gc, dd);
+#if R_GE_definitions > 12
+    UNPROTECT(1);
+#endif
 
+    dl_replay(scaled, dd);
+    count++;
+  }
 
+  return count;
+}
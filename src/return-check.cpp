@@ -0,0 +1,189 @@
+#include "return-check.h"
+#include "return-schema.h"
+
+#include <cstring>
+#include <vector>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Describe a type for warnings e.g. "non-negative numeric"
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static std::string type_name(int type) {
+  std::string res;
+  if (type & RET_NONNEG) res += "non-negative ";
+  if (type & RET_NUM   ) res += "numeric";
+  if (type & RET_INT   ) res += "integer";
+  if (type & RET_LGL   ) res += "logical";
+  if (type & RET_CHR   ) res += "character";
+  if (type & RET_RAW   ) res += (type & RET_CHR) ? " or raw" : "raw";
+  if (type & RET_MATRIX) res += " matrix";
+  if (type & RET_VECTOR) res += " vector";
+  return res;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Is 'value' of 'type' with 'length' elements (any length if 'length' < 0)?
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static bool value_ok(SEXP value, int type, R_xlen_t length) {
+  bool ok = false;
+  switch (TYPEOF(value)) {
+  case REALSXP: ok = type & RET_NUM;             break;
+  case INTSXP : ok = type & (RET_NUM | RET_INT); break;
+  case LGLSXP : ok = type & RET_LGL;             break;
+  case STRSXP : ok = type & RET_CHR;             break;
+  case RAWSXP : ok = type & RET_RAW;             break;
+  default     : ok = false;
+  }
+  if (!ok) return false;
+
+  if (type & RET_VECTOR) return true;
+
+  R_xlen_t n = Rf_xlength(value);
+  if (type & RET_MATRIX) {
+    SEXP dim = Rf_getAttrib(value, R_DimSymbol);
+    if (Rf_length(dim) != 2) return false;
+  } else if (n != (length < 0 ? 1 : length)) {
+    return false;
+  }
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    switch (TYPEOF(value)) {
+    case REALSXP:
+      if (ISNAN(REAL(value)[i])) return false;
+      if ((type & RET_NONNEG) && REAL(value)[i] < 0) return false;
+      break;
+    case INTSXP:
+      if (INTEGER(value)[i] == NA_INTEGER) return false;
+      if ((type & RET_NONNEG) && INTEGER(value)[i] < 0) return false;
+      break;
+    case LGLSXP:
+      if (LOGICAL(value)[i] == NA_LOGICAL) return false;
+      break;
+    }
+  }
+
+  return true;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A copy of a named 'list' without the elements flagged in 'drop'
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP without(SEXP list, const std::vector<bool> &drop) {
+  SEXP     names = Rf_getAttrib(list, R_NamesSymbol);
+  R_xlen_t n     = 0;
+  for (size_t i = 0; i < drop.size(); i++) {
+    if (!drop[i]) n++;
+  }
+
+  SEXP res       = PROTECT(Rf_allocVector(VECSXP, n));
+  SEXP res_names = PROTECT(Rf_allocVector(STRSXP, n));
+  R_xlen_t k = 0;
+  for (R_xlen_t i = 0; i < Rf_xlength(list); i++) {
+    if (drop[i]) continue;
+    SET_VECTOR_ELT(res      , k, VECTOR_ELT(list, i));
+    SET_STRING_ELT(res_names, k, STRING_ELT(names, i));
+    k++;
+  }
+  Rf_setAttrib(res, R_NamesSymbol, res_names);
+
+  UNPROTECT(2);
+  return res;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Check a returned device description
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static SEXP check_dd(SEXP dd) {
+  SEXP names = Rf_getAttrib(dd, R_NamesSymbol);
+  if (Rf_isNull(names)) return dd;
+
+  const int nspecs = sizeof(dd_specs) / sizeof(dd_specs[0]);
+
+  std::vector<bool> drop(Rf_xlength(dd), false);
+  bool any_dropped = false;
+
+  for (R_xlen_t i = 0; i < Rf_xlength(dd); i++) {
+    const char *name = CHAR(STRING_ELT(names, i));
+    for (int j = 0; j < nspecs; j++) {
+      if (strcmp(name, dd_specs[j].name) != 0) continue;
+
+      if (!value_ok(VECTOR_ELT(dd, i), dd_specs[j].type, dd_specs[j].length)) {
+        Rcpp::warning("device description: '%s' must be %d %s values (not NA). Ignoring.",
+                      name, dd_specs[j].length, type_name(dd_specs[j].type));
+        drop[i]     = true;
+        any_dropped = true;
+      }
+      break;
+    }
+  }
+
+  return any_dropped ? without(dd, drop) : dd;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Check the list returned from R for a device call
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::List check_return(const char *device_call, Rcpp::List res, SEXP sent_dd) {
+  SEXP names = Rf_getAttrib(res, R_NamesSymbol);
+  if (res.size() == 0 || Rf_isNull(names)) return res;
+
+  //--------------------------------------------------------------------------
+  // The range of specs for this device call. Most calls have none
+  //--------------------------------------------------------------------------
+  const int nspecs = sizeof(return_specs) / sizeof(return_specs[0]);
+  int first = 0;
+  while (first < nspecs && strcmp(return_specs[first].device_call, device_call) != 0) first++;
+  int last = first;
+  while (last < nspecs && strcmp(return_specs[last].device_call, device_call) == 0) last++;
+
+  std::vector<bool> drop(res.size(), false);
+  bool              changed = false;
+  R_xlen_t          dd_idx  = -1;
+  Rcpp::RObject     checked_dd;
+
+  for (R_xlen_t i = 0; i < res.size(); i++) {
+    const char *name  = CHAR(STRING_ELT(names, i));
+    SEXP        value = VECTOR_ELT(res, i);
+
+    if (strcmp(name, "dd") == 0) {
+      if (value == sent_dd) {
+        drop[i] = changed = true;
+      } else if (TYPEOF(value) == VECSXP) {
+        checked_dd = check_dd(value);
+        if ((SEXP)checked_dd != value) {
+          dd_idx  = i;
+          changed = true;
+        }
+      }
+      continue;
+    }
+
+    for (int j = first; j < last; j++) {
+      if (strcmp(name, return_specs[j].name) != 0) continue;
+
+      if (!value_ok(value, return_specs[j].type, -1)) {
+        Rcpp::warning("Ignoring invalid '%s' returned from call to '%s'. Must be %s value",
+                      name, device_call, type_name(return_specs[j].type));
+        drop[i] = changed = true;
+      }
+      break;
+    }
+  }
+
+  if (!changed) return res;
+
+  // Swap in the checked 'dd', shifted down by anything dropped before it
+  Rcpp::List out(without(res, drop));
+  if (dd_idx >= 0) {
+    R_xlen_t idx = dd_idx;
+    for (R_xlen_t i = 0; i < dd_idx; i++) {
+      if (drop[i]) idx--;
+    }
+    SET_VECTOR_ELT(out, idx, checked_dd);
+  }
+  return out;
+}
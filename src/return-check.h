@@ -0,0 +1,51 @@
+#ifndef DEVOUT_RETURN_CHECK_H
+#define DEVOUT_RETURN_CHECK_H
+
+#include <Rcpp.h>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Types of values which may be returned from a callback.
+//
+// A value is a single non-NA value of one of the given types unless it is
+// RET_VECTOR (any length) or RET_MATRIX (a matrix without NAs).  RET_NUM
+// accepts integer or double.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define RET_NUM      0x01
+#define RET_INT      0x02
+#define RET_LGL      0x04
+#define RET_CHR      0x08
+#define RET_RAW      0x10
+#define RET_VECTOR   0x20
+#define RET_MATRIX   0x40
+#define RET_NONNEG   0x80
+
+struct return_spec {
+  const char *device_call;
+  const char *name;
+  int         type;
+};
+
+struct dd_spec {
+  const char *name;
+  int         type;
+  int         length;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Check the list returned from R for a device call against the schema in
+// return-schema.h (generated from data-raw/device_calls.yml).
+//
+// Only the names in 'res' are looked up, so a callback which returns little
+// costs little.  A returned 'dd' is checked item by item against the device
+// description, unless it is 'sent_dd' itself i.e. the 'dd' given to the
+// callback, returned unchanged.  That is dropped as there is nothing to copy
+// back.
+//
+// Anything invalid is dropped with a warning, so that it never reaches the
+// device.  'res' itself is never modified.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rcpp::List check_return(const char *device_call, Rcpp::List res, SEXP sent_dd);
+
+#endif
@@ -0,0 +1,71 @@
+// Generated by data-raw/prepare-return-schema.R. Do not edit by hand.
+//
+// Return values of device calls (from data-raw/device_calls.yml) and the
+// device description (from devinfo$dd). See return-check.h
+
+#ifndef DEVOUT_RETURN_SCHEMA_H
+#define DEVOUT_RETURN_SCHEMA_H
+
+#include "return-check.h"
+
+static const return_spec return_specs[] = {
+  {"cap"            , "contents"          , RET_INT | RET_MATRIX},
+  {"flushPage"      , "contents"          , RET_VECTOR | RET_CHR | RET_RAW},
+  {"holdflush"      , "level"             , RET_INT | RET_NONNEG},
+  {"locator"        , "x"                 , RET_NUM | RET_NONNEG},
+  {"locator"        , "y"                 , RET_NUM | RET_NONNEG},
+  {"metricInfo"     , "ascent"            , RET_NUM | RET_NONNEG},
+  {"metricInfo"     , "descent"           , RET_NUM},
+  {"metricInfo"     , "width"             , RET_NUM | RET_NONNEG},
+  {"newFrameConfirm", "is_device_specific", RET_LGL},
+  {"useGroup"       , "replay"            , RET_LGL},
+  {"size"           , "left"              , RET_NUM | RET_NONNEG},
+  {"size"           , "right"             , RET_NUM | RET_NONNEG},
+  {"size"           , "top"               , RET_NUM | RET_NONNEG},
+  {"size"           , "bottom"            , RET_NUM | RET_NONNEG},
+  {"strWidth"       , "width"             , RET_NUM | RET_NONNEG},
+  {"strWidthUTF8"   , "width"             , RET_NUM | RET_NONNEG},
+};
+
+static const dd_spec dd_specs[] = {
+  {"left"                   , RET_NUM, 1},
+  {"top"                    , RET_NUM, 1},
+  {"right"                  , RET_NUM, 1},
+  {"bottom"                 , RET_NUM, 1},
+  {"clipLeft"               , RET_NUM, 1},
+  {"clipTop"                , RET_NUM, 1},
+  {"clipRight"              , RET_NUM, 1},
+  {"clipBottom"             , RET_NUM, 1},
+  {"xCharOffset"            , RET_NUM, 1},
+  {"yCharOffset"            , RET_NUM, 1},
+  {"yLineBias"              , RET_NUM, 1},
+  {"ipr"                    , RET_NUM, 2},
+  {"cra"                    , RET_NUM, 2},
+  {"gamma"                  , RET_NUM, 1},
+  {"canClip"                , RET_LGL, 1},
+  {"canHAdj"                , RET_INT, 1},
+  {"canChangeGamma"         , RET_LGL, 1},
+  {"displayListOn"          , RET_LGL, 1},
+  {"haveTransparency"       , RET_INT, 1},
+  {"haveTransparentBg"      , RET_INT, 1},
+  {"haveRaster"             , RET_INT, 1},
+  {"haveCapture"            , RET_INT, 1},
+  {"haveLocator"            , RET_INT, 1},
+  {"startfill"              , RET_INT, 4},
+  {"startcol"               , RET_INT, 4},
+  {"startps"                , RET_NUM, 1},
+  {"startlty"               , RET_INT, 1},
+  {"startfont"              , RET_INT, 1},
+  {"startgamma"             , RET_NUM, 1},
+  {"wantSymbolUTF8"         , RET_LGL, 1},
+  {"hasTextUTF8"            , RET_LGL, 1},
+  {"useRotatedTextInContour", RET_LGL, 1},
+  {"canGenMouseDown"        , RET_LGL, 1},
+  {"canGenMouseMove"        , RET_LGL, 1},
+  {"canGenMouseUp"          , RET_LGL, 1},
+  {"canGenKeybd"            , RET_LGL, 1},
+  {"canGenIdle"             , RET_LGL, 1},
+  {"gettingEvent"           , RET_LGL, 1},
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "spatial-index.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// Maximum number of entries in a node
+static const int node_size = 16;
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Sort-Tile-Recursive: order entries so that consecutive runs of
+// 'node_size' make compact nodes.  Entries are sorted by x into
+// sqrt(n / node_size) vertical slices and each slice is sorted by y
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void str_sort(std::vector<int> &idx, const std::vector<bbox> &box) {
+  std::sort(idx.begin(), idx.end(), [&box](int a, int b) {
+    return box[a].x0 + box[a].x1 < box[b].x0 + box[b].x1;
+  });
+
+  size_t nnodes = (idx.size() + node_size - 1) / node_size;
+  size_t nslice = (size_t)std::ceil(std::sqrt((double)nnodes));
+  size_t per    = nslice * node_size;
+
+  for (size_t start = 0; start < idx.size(); start += per) {
+    size_t end = std::min(idx.size(), start + per);
+    std::sort(idx.begin() + start, idx.begin() + end, [&box](int a, int b) {
+      return box[a].y0 + box[a].y1 < box[b].y0 + box[b].y1;
+    });
+  }
+}
+
+
+static bbox union_of(const std::vector<bbox> &box, const int *idx, int n) {
+  bbox u = box[idx[0]];
+  for (int i = 1; i < n; i++) {
+    const bbox &b = box[idx[i]];
+    u.x0 = std::min(u.x0, b.x0);
+    u.y0 = std::min(u.y0, b.y0);
+    u.x1 = std::max(u.x1, b.x1);
+    u.y1 = std::max(u.y1, b.y1);
+  }
+  return u;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Build bottom up: pack the boxes into leaves, then pack each level of
+// nodes into parents until there is a single root
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rtree::build(const std::vector<bbox> &boxes_, const std::vector<bool> &valid) {
+  boxes = boxes_;
+  nodes.clear();
+  items.clear();
+  children.clear();
+  root = -1;
+
+  for (size_t i = 0; i < boxes.size(); i++) {
+    if (valid.empty() || valid[i]) items.push_back((int)i);
+  }
+  if (items.empty()) return;
+
+  str_sort(items, boxes);
+
+  std::vector<bbox> level_box;
+  std::vector<int>  level;
+  for (size_t start = 0; start < items.size(); start += node_size) {
+    int n = (int)std::min((size_t)node_size, items.size() - start);
+    node nd = {union_of(boxes, &items[start], n), (int)start, n, true};
+    level.push_back((int)nodes.size());
+    level_box.push_back(nd.box);
+    nodes.push_back(nd);
+  }
+
+  while (level.size() > 1) {
+    // Sort positions within this level, then map back to node ids
+    std::vector<int> pos(level.size());
+    for (size_t i = 0; i < pos.size(); i++) pos[i] = (int)i;
+    str_sort(pos, level_box);
+
+    std::vector<bbox> next_box;
+    std::vector<int>  next;
+    for (size_t start = 0; start < pos.size(); start += node_size) {
+      int n = (int)std::min((size_t)node_size, pos.size() - start);
+      node nd = {union_of(level_box, &pos[start], n), (int)children.size(), n, false};
+      for (int k = 0; k < n; k++) {
+        children.push_back(level[pos[start + k]]);
+      }
+      next.push_back((int)nodes.size());
+      next_box.push_back(nd.box);
+      nodes.push_back(nd);
+    }
+
+    level.swap(next);
+    level_box.swap(next_box);
+  }
+
+  root = level[0];
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Query
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void rtree::query(const bbox &q, std::vector<int> &out) const {
+  out.clear();
+  if (root < 0) return;
+
+  std::vector<int> stack(1, root);
+  while (!stack.empty()) {
+    const node &nd = nodes[stack.back()];
+    stack.pop_back();
+    if (!nd.box.intersects(q)) continue;
+
+    if (nd.leaf) {
+      for (int k = 0; k < nd.count; k++) {
+        int i = items[nd.first + k];
+        if (boxes[i].intersects(q)) out.push_back(i);
+      }
+    } else {
+      for (int k = 0; k < nd.count; k++) {
+        stack.push_back(children[nd.first + k]);
+      }
+    }
+  }
+
+  std::sort(out.begin(), out.end());
+}
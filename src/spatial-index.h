@@ -0,0 +1,55 @@
+#ifndef DEVOUT_SPATIAL_INDEX_H
+#define DEVOUT_SPATIAL_INDEX_H
+
+#include <cstddef>
+#include <vector>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Axis aligned bounding box.  (x0, y0) <= (x1, y1)
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct bbox {
+  double x0, y0, x1, y1;
+
+  bool intersects(const bbox &other) const {
+    return x0 <= other.x1 && other.x0 <= x1 && y0 <= other.y1 && other.y0 <= y1;
+  }
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Static R-tree of bounding boxes, bulk loaded with Sort-Tile-Recursive
+// packing (every node is full except the last in each tile).
+//
+// Building is O(n log n).  A query visits only the nodes whose bounds
+// intersect it, i.e. O(log n) plus the number of results for small queries.
+// The tree can't be updated: rebuild it when the boxes change.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class rtree {
+public:
+  rtree() : root(-1) {}
+
+  // 'valid[i]' false leaves box 'i' out of the tree.  May be empty
+  void build(const std::vector<bbox> &boxes, const std::vector<bool> &valid);
+
+  // Indices of the boxes which intersect 'query', in increasing order
+  void query(const bbox &query, std::vector<int> &out) const;
+
+  size_t size() const { return boxes.size(); }
+
+private:
+  struct node {
+    bbox box;
+    int  first;   // into 'items' (leaf) or 'children'
+    int  count;
+    bool leaf;
+  };
+
+  std::vector<bbox> boxes;
+  std::vector<node> nodes;
+  std::vector<int>  items;
+  std::vector<int>  children;
+  int               root;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "string-intern.h"
+
+#include <cstdint>
+
+
+string_intern::string_intern(size_t max_size) : strings(R_NilValue), max_size(max_size) {}
+
+
+string_intern::~string_intern() {
+  if (strings != R_NilValue) R_ReleaseObject(strings);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Length and FNV-1a hash of a C string, in one pass
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+string_intern::key string_intern::make_key(const char *str) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  const char *p = str;
+  for (; *p; p++) {
+    h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+  }
+
+  key k;
+  k.str  = str;
+  k.len  = (size_t)(p - str);
+  k.hash = (size_t)h;
+  return k;
+}
+
+
+Rcpp::RObject string_intern::get(const char *str, int *id) {
+  key k = make_key(str);
+
+  std::unordered_map<key, int, key_hash>::const_iterator it = index.find(k);
+  if (it != index.end()) {
+    *id = it->second + 1;
+    return VECTOR_ELT(strings, it->second);
+  }
+
+  Rcpp::RObject res = Rf_mkString(str);
+  if (index.size() >= max_size) {
+    *id = NA_INTEGER;
+    return res;
+  }
+
+  //--------------------------------------------------------------------------
+  // Grow the list of strings by doubling
+  //--------------------------------------------------------------------------
+  R_xlen_t n = (R_xlen_t)index.size();
+  if (strings == R_NilValue || n == Rf_xlength(strings)) {
+    SEXP grown = PROTECT(Rf_allocVector(VECSXP, n == 0 ? 64 : 2 * n));
+    for (R_xlen_t i = 0; i < n; i++) {
+      SET_VECTOR_ELT(grown, i, VECTOR_ELT(strings, i));
+    }
+    R_PreserveObject(grown);
+    UNPROTECT(1);
+    if (strings != R_NilValue) R_ReleaseObject(strings);
+    strings = grown;
+  }
+
+  SET_VECTOR_ELT(strings, n, res);
+  k.str = CHAR(STRING_ELT(res, 0));
+  index[k] = (int)n;
+
+  *id = (int)n + 1;
+  return res;
+}
@@ -0,0 +1,57 @@
+#ifndef DEVOUT_STRING_INTERN_H
+#define DEVOUT_STRING_INTERN_H
+
+#include <Rcpp.h>
+#include <cstring>
+#include <unordered_map>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Per-device table of the strings passed to text/strWidth callbacks.
+//
+// Plots draw and measure the same few labels (tick labels, strip titles,
+// legend keys) over and over.  Each distinct string is made into an R
+// string once and the same object is handed to every later call, along
+// with a stable integer id (1, 2, ...) which callbacks can use as a cache
+// key.  The strings are kept in one preserved list which grows by doubling.
+//
+// The table holds at most 'max_size' strings.  After that, new strings are
+// created for each call as before, with id NA.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+class string_intern {
+public:
+  explicit string_intern(size_t max_size = 10000);
+  ~string_intern();
+
+  // Character vector (length 1) of 'str'.  'id' is set to its id, or
+  // NA_INTEGER if the table is full
+  Rcpp::RObject get(const char *str, int *id);
+
+  size_t size() const { return index.size(); }
+
+private:
+  string_intern(const string_intern &);
+  string_intern &operator=(const string_intern &);
+
+  // Keys point at the bytes of the interned R strings (which don't move
+  // while the list holds them), or at the caller's string for a lookup, so
+  // no copy is made to look a string up
+  struct key {
+    const char *str;
+    size_t      len;
+    size_t      hash;
+    bool operator==(const key &other) const {
+      return len == other.len && std::memcmp(str, other.str, len) == 0;
+    }
+  };
+  struct key_hash {
+    size_t operator()(const key &k) const { return k.hash; }
+  };
+  static key make_key(const char *str);
+
+  std::unordered_map<key, int, key_hash> index;
+  SEXP                                   strings;
+  size_t                                 max_size;
+};
+
+#endif
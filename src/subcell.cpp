@@ -0,0 +1,113 @@
+#include "subcell.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdint.h>
+
+
+void subcell_size(int mode, int &xpix, int &ypix) {
+  switch (mode) {
+  case SUBCELL_BRAILLE  : xpix = 2; ypix = 4; break;
+  case SUBCELL_HALFBLOCK: xpix = 1; ypix = 2; break;
+  default               : xpix = 1; ypix = 1; break;
+  }
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Brightness (0-255) of an R packed colour
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static int grey(unsigned int col) {
+  return (int)((30 * (col & 0xff) + 59 * ((col >> 8) & 0xff) + 11 * ((col >> 16) & 0xff)) / 100);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Braille dot bit for each (pixel row, 2 pixel columns).  Dots 1-3 and 4-6
+// run down the left and right columns, and dots 7-8 form the bottom row
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static const unsigned char braille_bits[4][4] = {
+  {0, 0x01, 0x08, 0x09},
+  {0, 0x02, 0x10, 0x12},
+  {0, 0x04, 0x20, 0x24},
+  {0, 0x40, 0x80, 0xc0}
+};
+
+static const unsigned int halfblock_glyphs[4] = {' ', 0x2580, 0x2584, 0x2588};
+
+
+void subcell_pack(const rgba_image &img, int mode, int cols, int rows, unsigned int bg,
+                  std::vector<unsigned int> &glyphs, std::vector<int> &colours) {
+
+  int xpix, ypix;
+  subcell_size(mode, xpix, ypix);
+
+  glyphs .assign((size_t)cols * rows, ' ');
+  colours.assign((size_t)cols * rows, -1);
+
+  // Transparent background counts as white
+  if ((bg >> 24) == 0) bg = 0xffffffff;
+  int bg_grey = grey(bg);
+
+  //--------------------------------------------------------------------------
+  // One row of ink bits at a time. Bit k of 'bits' = pixel column k
+  //--------------------------------------------------------------------------
+  int nwords = (cols * xpix + 63) / 64;
+  std::vector<uint64_t> bits((size_t)nwords * ypix);
+
+  for (int row = 0; row < rows; row++) {
+    std::fill(bits.begin(), bits.end(), 0);
+
+    for (int sy = 0; sy < ypix; sy++) {
+      int py = row * ypix + sy;
+      if (py >= img.height) break;
+      const unsigned int *src = img.pixels.data() + (size_t)py * img.width;
+      uint64_t *dst = bits.data() + (size_t)sy * nwords;
+      int npx = std::min(img.width, cols * xpix);
+      for (int px = 0; px < npx; px++) {
+        unsigned int col = src[px];
+        if ((col >> 24) != 0 && std::abs(grey(col) - bg_grey) > 32) {
+          dst[px >> 6] |= (uint64_t)1 << (px & 63);
+        }
+      }
+    }
+
+    //------------------------------------------------------------------------
+    // Gather each cell's bits. 'xpix' divides 64 so a cell never straddles
+    // two words
+    //------------------------------------------------------------------------
+    for (int c = 0; c < cols; c++) {
+      int bit  = c * xpix;
+      unsigned int mask = (1u << xpix) - 1;
+      unsigned int pattern = 0;
+
+      for (int sy = 0; sy < ypix; sy++) {
+        unsigned int b = (unsigned int)(bits[(size_t)sy * nwords + (bit >> 6)] >> (bit & 63)) & mask;
+        if (mode == SUBCELL_BRAILLE) {
+          pattern |= braille_bits[sy][b];
+        } else {
+          pattern |= b << sy;
+        }
+      }
+
+      size_t idx = (size_t)row * cols + c;
+      if (pattern == 0) continue;
+
+      glyphs[idx] = (mode == SUBCELL_BRAILLE) ? 0x2800 + pattern : halfblock_glyphs[pattern & 3];
+
+      //----------------------------------------------------------------------
+      // Colour of the cell: first ink pixel
+      //----------------------------------------------------------------------
+      for (int sy = 0; sy < ypix && colours[idx] < 0; sy++) {
+        uint64_t w = bits[(size_t)sy * nwords + (bit >> 6)] >> (bit & 63);
+        for (int sx = 0; sx < xpix; sx++) {
+          if (w & ((uint64_t)1 << sx)) {
+            unsigned int col = img.pixels[(size_t)(row * ypix + sy) * img.width + bit + sx];
+            colours[idx] = (int)(((col & 0xff) << 16) | (col & 0xff00) | ((col >> 16) & 0xff));
+            break;
+          }
+        }
+      }
+    }
+  }
+}
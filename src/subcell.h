@@ -0,0 +1,35 @@
+#ifndef DEVOUT_SUBCELL_H
+#define DEVOUT_SUBCELL_H
+
+#include <vector>
+
+#include "rasterise.h"
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Sub-cell modes: how many pixels are packed into each character cell
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#define SUBCELL_NONE      0
+#define SUBCELL_BRAILLE   1  // 2 x 4 dots, U+2800 - U+28FF
+#define SUBCELL_HALFBLOCK 2  // 1 x 2 blocks, U+2580 / U+2584 / U+2588
+
+void subcell_size(int mode, int &xpix, int &ypix);
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Pack a rendered image (of 'cols' x 'rows' cells, at the resolution given
+// by 'subcell_size()') into one glyph per cell.
+//
+// A pixel is 'ink' if its brightness differs noticeably from 'bg' (an R
+// packed colour; transparent pixels count as background).  Ink is first
+// packed into one bit per pixel per row, 64 pixels to a word, so each cell
+// is built from a few shifts and a table lookup per pixel row.
+//
+// 'glyphs' gets a code point per cell (' ' if a cell has no ink) and
+// 'colours' the 0xRRGGBB colour of the first ink pixel in each cell (-1 if
+// none), both row by row.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void subcell_pack(const rgba_image &img, int mode, int cols, int rows, unsigned int bg,
+                  std::vector<unsigned int> &glyphs, std::vector<int> &colours);
+
+#endif